@@ -1,5 +1,10 @@
 ﻿// Copyright Epic Games, Inc. All Rights Reserved.
 
+using System.Globalization;
+using System.IO;
+using System.Linq;
+using System.Text;
+using System.Xml.Linq;
 using UnrealBuildTool;
 
 public class BlinkOpenCV : ModuleRules
@@ -17,6 +22,7 @@ public class BlinkOpenCV : ModuleRules
 		
 		PrivateIncludePaths.AddRange(
 			new string[] {
+				GenerateHaarCascades(),
 				// ... add other private include paths required here ...
 			}
 		);
@@ -39,6 +45,7 @@ public class BlinkOpenCV : ModuleRules
 			{
 				"CoreUObject",
 				"Engine",
+				"RenderCore",
 				"Slate",
 				"SlateCore",
 				// ... add private dependencies that you statically link with here ...	
@@ -53,4 +60,127 @@ public class BlinkOpenCV : ModuleRules
 			}
 		);
 	}
+
+	/// <summary>
+	/// Converts the Haar cascades FHaarCascadeEvaluator evaluates into C++ tables with the same values, one header per
+	/// cascade. Headers are only rewritten when a cascade changes, so nothing is recompiled otherwise.
+	/// </summary>
+	/// <returns>The directory the headers are generated into.</returns>
+	private string GenerateHaarCascades()
+	{
+		string CascadeDirectory = Path.Combine(PluginDirectory, "Content", "Cascades");
+		string OutputDirectory = Path.Combine(PluginDirectory, "Intermediate", "HaarCascades");
+		Directory.CreateDirectory(OutputDirectory);
+
+		GenerateHaarCascade(Path.Combine(CascadeDirectory, "haarcascade_frontalface_default.xml"), "FrontalFaceDefault",
+			OutputDirectory);
+		GenerateHaarCascade(Path.Combine(CascadeDirectory, "haarcascade_eye.xml"), "Eye", OutputDirectory);
+
+		return OutputDirectory;
+	}
+
+	private void GenerateHaarCascade(string CascadePath, string CascadeName, string OutputDirectory)
+	{
+		// Rerun the rules when the cascade changes.
+		ExternalDependencies.Add(CascadePath);
+
+		string FileName = Path.GetFileName(CascadePath);
+		XElement Cascade = XDocument.Load(CascadePath).Root.Element("cascade");
+		if (Cascade == null || Cascade.Element("stageType").Value.Trim() != "BOOST"
+			|| Cascade.Element("featureType").Value.Trim() != "HAAR")
+		{
+			throw new BuildException("{0} is not a boosted Haar cascade in the current format", FileName);
+		}
+
+		XElement[] Stages = Cascade.Element("stages").Elements("_").ToArray();
+		XElement[] Features = Cascade.Element("features").Elements("_").ToArray();
+
+		StringBuilder StagesText = new StringBuilder();
+		StringBuilder StumpsText = new StringBuilder();
+		int NumStumps = 0;
+		foreach (XElement Stage in Stages)
+		{
+			XElement[] WeakClassifiers = Stage.Element("weakClassifiers").Elements("_").ToArray();
+			StagesText.AppendFormat("\t\t{{{0}, {1}, {2}}},\n", NumStumps, WeakClassifiers.Length,
+				FormatFloat(Stage.Element("stageThreshold").Value));
+
+			foreach (XElement WeakClassifier in WeakClassifiers)
+			{
+				// A stump is a single node whose children are both leaves: "0 -1 FeatureIndex Threshold".
+				string[] Nodes = SplitValues(WeakClassifier.Element("internalNodes").Value);
+				string[] Leaves = SplitValues(WeakClassifier.Element("leafValues").Value);
+				if (Nodes.Length != 4 || Nodes[0] != "0" || Nodes[1] != "-1" || Leaves.Length != 2)
+				{
+					throw new BuildException("{0} has weak classifiers that aren't stumps, which FHaarCascadeEvaluator doesn't support", FileName);
+				}
+
+				StumpsText.AppendFormat("\t\t{{{0}, {1}, {2}, {3}}},\n", Nodes[2], FormatFloat(Nodes[3]),
+					FormatFloat(Leaves[0]), FormatFloat(Leaves[1]));
+				NumStumps++;
+			}
+		}
+
+		StringBuilder FeaturesText = new StringBuilder();
+		foreach (XElement Feature in Features)
+		{
+			XElement Tilted = Feature.Element("tilted");
+			XElement[] Rects = Feature.Element("rects").Elements("_").ToArray();
+			if ((Tilted != null && Tilted.Value.Trim() != "0") || Rects.Length < 2 || Rects.Length > 3)
+			{
+				throw new BuildException("{0} has tilted features or features without 2 or 3 rects, which FHaarCascadeEvaluator doesn't support", FileName);
+			}
+
+			string[] RectsText = new string[] { "{0, 0, 0, 0, 0.f}", "{0, 0, 0, 0, 0.f}", "{0, 0, 0, 0, 0.f}" };
+			for (int i = 0; i < Rects.Length; i++)
+			{
+				string[] Values = SplitValues(Rects[i].Value);
+				RectsText[i] = string.Format("{{{0}, {1}, {2}, {3}, {4}}}", Values[0], Values[1], Values[2], Values[3],
+					FormatFloat(Values[4]));
+			}
+			FeaturesText.AppendFormat("\t\t{{{{{0}}}}},\n", string.Join(", ", RectsText));
+		}
+
+		StringBuilder Text = new StringBuilder();
+		Text.AppendFormat("// Generated by BlinkOpenCV.Build.cs from {0}. Do not edit.\n\n", FileName);
+		Text.Append("#pragma once\n\n");
+		Text.Append("#include \"HaarCascadeEvaluator.h\"\n\n");
+		Text.AppendFormat("struct FHaarCascade{0}\n{{\n", CascadeName);
+		Text.AppendFormat("\tstatic constexpr const TCHAR* Name = TEXT(\"{0}\");\n", FileName);
+		Text.AppendFormat("\tstatic constexpr int32 WindowWidth = {0};\n", Cascade.Element("width").Value.Trim());
+		Text.AppendFormat("\tstatic constexpr int32 WindowHeight = {0};\n", Cascade.Element("height").Value.Trim());
+		Text.AppendFormat("\tstatic constexpr int32 NumStages = {0};\n", Stages.Length);
+		Text.AppendFormat("\tstatic constexpr int32 NumStumps = {0};\n", NumStumps);
+		Text.AppendFormat("\tstatic constexpr int32 NumFeatures = {0};\n\n", Features.Length);
+		Text.AppendFormat("\tstatic constexpr FHaarStage Stages[NumStages] = {{\n{0}\t}};\n\n", StagesText);
+		Text.AppendFormat("\tstatic constexpr FHaarStump Stumps[NumStumps] = {{\n{0}\t}};\n\n", StumpsText);
+		Text.AppendFormat("\tstatic constexpr FHaarFeature Features[NumFeatures] = {{\n{0}\t}};\n", FeaturesText);
+		Text.Append("};\n");
+
+		string OutputPath = Path.Combine(OutputDirectory, string.Format("HaarCascade{0}.gen.h", CascadeName));
+		string NewText = Text.ToString();
+		if (!File.Exists(OutputPath) || File.ReadAllText(OutputPath) != NewText)
+		{
+			File.WriteAllText(OutputPath, NewText);
+		}
+	}
+
+	private static string[] SplitValues(string Values)
+	{
+		return Values.Split(new char[] { ' ', '\t', '\r', '\n' }, System.StringSplitOptions.RemoveEmptyEntries);
+	}
+
+	/// <summary>
+	/// Formats a value the way cv::FileStorage reads it, as the float closest to it, as a C++ float literal that
+	/// round-trips exactly.
+	/// </summary>
+	private static string FormatFloat(string Value)
+	{
+		float Parsed = (float)double.Parse(Value.Trim(), NumberStyles.Float, CultureInfo.InvariantCulture);
+		string Text = Parsed.ToString("R", CultureInfo.InvariantCulture);
+		if (!Text.Contains(".") && !Text.Contains("E"))
+		{
+			Text += ".0";
+		}
+		return Text + "f";
+	}
 }
@@ -1,20 +1,101 @@
 ﻿// Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "BlinkOpenCV.h"
+#include "Async/Async.h"
+#include "BlinkOpenCVStats.h"
+#include "CapturePipeline.h"
+#include "Misc/ConfigCacheIni.h"
+#include "VideoReader.h"
 
 #define LOCTEXT_NAMESPACE "FBlinkOpenCVModule"
 
 DEFINE_LOG_CATEGORY(LogBlinkOpenCV);
 
+UE_TRACE_CHANNEL_DEFINE(BlinkOpenCVChannel);
+
+DEFINE_STAT(STAT_BlinkOpenCV_FramesCaptured);
+DEFINE_STAT(STAT_BlinkOpenCV_FramesDropped);
+DEFINE_STAT(STAT_BlinkOpenCV_FramesProcessed);
+DEFINE_STAT(STAT_BlinkOpenCV_Read);
+DEFINE_STAT(STAT_BlinkOpenCV_Publish);
+DEFINE_STAT(STAT_BlinkOpenCV_Detect);
+DEFINE_STAT(STAT_BlinkOpenCV_Preprocess);
+DEFINE_STAT(STAT_BlinkOpenCV_Face);
+DEFINE_STAT(STAT_BlinkOpenCV_Eyes);
+DEFINE_STAT(STAT_BlinkOpenCV_TemporalFilter);
+DEFINE_STAT(STAT_BlinkOpenCV_Render);
+
 void FBlinkOpenCVModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
+	WarmStartVideoStream();
 }
 
 void FBlinkOpenCVModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+
+	// Nobody claimed the pre-opened VideoStream, so release it. Taken out under the lock but waited for outside it,
+	// so a camera that hangs while opening can't also hang anything else that wants the lock.
+	TFuture<TSharedPtr<cv::VideoCapture>> UnclaimedVideoStream;
+	{
+		FScopeLock Lock(&WarmVideoStreamLock);
+		WarmPipeline.Empty();
+		UnclaimedVideoStream = MoveTemp(WarmVideoStream);
+	}
+
+	if (UnclaimedVideoStream.IsValid()
+		&& !UnclaimedVideoStream.WaitFor(FTimespan::FromSeconds(WarmVideoStreamShutdownTimeout)))
+	{
+		// Same as the VideoReader: it is released once its thread finishes, rather than holding up shutdown.
+		UE_LOG(LogBlinkOpenCV, Warning, TEXT("BlinkOpenCV: Pre-opened VideoStream is still opening, not waiting for it"));
+	}
+}
+
+FBlinkOpenCVModule* FBlinkOpenCVModule::GetPtr()
+{
+	return FModuleManager::GetModulePtr<FBlinkOpenCVModule>(TEXT("BlinkOpenCV"));
+}
+
+TFuture<TSharedPtr<cv::VideoCapture>> FBlinkOpenCVModule::ClaimWarmVideoStream(const FString& Pipeline)
+{
+	FScopeLock Lock(&WarmVideoStreamLock);
+	if (!WarmVideoStream.IsValid() || WarmPipeline != Pipeline)
+		return TFuture<TSharedPtr<cv::VideoCapture>>();
+
+	WarmPipeline.Empty();
+	return MoveTemp(WarmVideoStream);
+}
+
+void FBlinkOpenCVModule::WarmStartVideoStream()
+{
+	// The settings must match the CameraReader's for it to claim the pre-opened VideoStream.
+	const TCHAR* Section = TEXT("BlinkOpenCV");
+	bool bWarmStart = false;
+	if (!GConfig || !GConfig->GetBool(Section, TEXT("bWarmStartCamera"), bWarmStart, GGameIni) || !bWarmStart)
+		return;
+
+	int32 CameraIndex = 0;
+	GConfig->GetInt(Section, TEXT("CameraIndex"), CameraIndex, GGameIni);
+	
+	FCaptureSettings CaptureSettings = FCaptureSettings::Camera(CameraIndex);
+	GConfig->GetInt(Section, TEXT("CaptureWidth"), CaptureSettings.Width, GGameIni);
+	GConfig->GetInt(Section, TEXT("CaptureHeight"), CaptureSettings.Height, GGameIni);
+	GConfig->GetInt(Section, TEXT("CaptureFrameRate"), CaptureSettings.FrameRate, GGameIni);
+	GConfig->GetString(Section, TEXT("CapturePixelFormat"), CaptureSettings.PixelFormat, GGameIni);
+	GConfig->GetBool(Section, TEXT("bCaptureLumaOnly"), CaptureSettings.bLumaOnly, GGameIni);
+	GConfig->GetInt(Section, TEXT("OutputWidth"), CaptureSettings.OutputWidth, GGameIni);
+	GConfig->GetInt(Section, TEXT("OutputHeight"), CaptureSettings.OutputHeight, GGameIni);
+
+	FScopeLock Lock(&WarmVideoStreamLock);
+	WarmPipeline = FCapturePipelineBuilder(CaptureSettings).Build();
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("BlinkOpenCV: Pre-opening pipeline '%s'"), *WarmPipeline);
+	
+	WarmVideoStream = Async(EAsyncExecution::Thread, [Pipeline = WarmPipeline]()
+	{
+		return FVideoReader::OpenVideoStream(Pipeline);
+	});
 }
 
 #undef LOCTEXT_NAMESPACE
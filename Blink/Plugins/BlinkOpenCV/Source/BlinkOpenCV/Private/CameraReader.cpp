@@ -5,11 +5,26 @@
 #include "CameraReader.h"
 #include "BlinkOpenCV.h"
 #include "EyeDetector.h"
+#include "ImageBackend.h"
 #include "TestVideoReader.h"
 #include "VideoReader.h"
+#include "RenderCore.h"
+#include "Async/Async.h"
 #include "Kismet/KismetSystemLibrary.h"
+#include "Misc/CoreDelegates.h"
 #include "opencv2/unreal.hpp"
 
+FBlinkFrameStats FBlinkFrameStats::FromStageStats(const FFrameStageStats& Stats)
+{
+	FBlinkFrameStats Snapshot;
+	Snapshot.NumProcessed = Stats.NumProcessed.load(std::memory_order_relaxed);
+	Snapshot.NumSuperseded = Stats.NumSuperseded.load(std::memory_order_relaxed);
+	Snapshot.NumExpired = Stats.NumExpired.load(std::memory_order_relaxed);
+	Snapshot.NumOverBudget = Stats.NumOverBudget.load(std::memory_order_relaxed);
+	Snapshot.NumThrottled = Stats.NumThrottled.load(std::memory_order_relaxed);
+	return Snapshot;
+}
+
 UCameraReader::UCameraReader()
 {
 	PrimaryComponentTick.bCanEverTick = true;
@@ -17,6 +32,12 @@ UCameraReader::UCameraReader()
 	PrimaryComponentTick.bStartWithTickEnabled = false;
 	bUseCamera = true;
 	CameraIndex = 0;
+	CaptureResolution = FIntPoint::ZeroValue;
+	CaptureFrameRate = 0;
+	bUseTestPattern = false;
+	bReplayUnthrottled = false;
+	bAdaptCaptureRate = true;
+	bCaptureLumaOnly = true;
 	VideoFileLocation = TEXT("C:/Users/Liamk/Downloads/destiny2.mp4");
 	bResize = true;
 	ResizeDimensions = FVector2D(1280, 720);
@@ -24,10 +45,29 @@ UCameraReader::UCameraReader()
 	WindowName = TEXT("Camera");
 	VideoReader = nullptr;
 	VideoReaderTickRate = 1.f / 30.f;
-	EyeSampleRate = 1.f / 30.f;
 	BlinkResetTime = 3;
 	WinkResetTime = 3;
 	ConsiderAsOpenTime = .25f;
+	bWakeDetectorOnNewFrame = true;
+	DetectorFrameWaitTimeout = .1f;
+	DetectorFrameDeadline = .033f;
+	bSplitDetectorIntoStages = true;
+	DetectorWorkers = 1;
+	bRunDetectorOnTasks = false;
+	bTrackFace = true;
+	FaceRedetectInterval = 10;
+	ImageBackend = EBlinkImageBackend::Auto;
+	bUseCompiledCascades = true;
+	bBenchmarkCompiledCascades = false;
+	bShareCascadePyramid = false;
+	bDispatchEyeEventsImmediately = false;
+	bAutoThreadScheduling = false;
+	CaptureThreadPriority = EBlinkThreadPriority::AboveNormal;
+	CaptureThreadAffinity = 0;
+	DetectorThreadPriority = EBlinkThreadPriority::AboveNormal;
+	DetectorThreadAffinity = 0;
+	LastEventLatency = 0;
+	LastEventConfidence = 0;
 }
 
 void UCameraReader::BeginPlay()
@@ -49,6 +89,8 @@ void UCameraReader::TickComponent(float DeltaTime, ELevelTick TickType, FActorCo
 			bVideoActive = !bVideoActive;
 			bVideoActive ? OnCameraFound() : OnCameraLost();
 		}
+
+		ConsumeEyeEvents();
 	}
 
 	#if UE_BUILD_DEVELOPMENT || UE_EDITOR
@@ -73,28 +115,56 @@ void UCameraReader::Activate(bool bReset)
 		// If VideoReader exists, stop it (can happen if bReset is true).
 		if (VideoReader)
 			Stop();
+
+		FFeatureDetectorSettings DetectorSettings;
+		DetectorSettings.bWaitForFrames = bWakeDetectorOnNewFrame;
+		DetectorSettings.FrameWaitTimeout = DetectorFrameWaitTimeout;
+		DetectorSettings.FrameDeadline = DetectorFrameDeadline;
+		DetectorSettings.bUseStageGraph = bSplitDetectorIntoStages;
+		DetectorSettings.NumWorkers = DetectorWorkers;
+		DetectorSettings.bUseTasks = bRunDetectorOnTasks;
+		DetectorSettings.bTrackFace = bTrackFace;
+		DetectorSettings.FaceRedetectInterval = FaceRedetectInterval;
+		DetectorSettings.ImageBackend = ToImageBackend(ImageBackend);
+		DetectorSettings.bUseCompiledCascades = bUseCompiledCascades;
+		DetectorSettings.bBenchmarkCompiledCascades = bBenchmarkCompiledCascades;
+		DetectorSettings.bShareCascadePyramid = bShareCascadePyramid;
+		DetectorSettings.Scheduling = GetDetectorScheduling();
 		
+		FCaptureSettings CaptureSettings;
 		if (bUseCamera)
 		{
-			VideoReader = new FTestVideoReader(
-				CameraIndex,
-				VideoReaderTickRate,
-				bResize ? ResizeDimensions : FVector2D());
+			CaptureSettings = FCaptureSettings::Camera(CameraIndex);
+			CaptureSettings.Width = CaptureResolution.X;
+			CaptureSettings.Height = CaptureResolution.Y;
+			CaptureSettings.FrameRate = CaptureFrameRate;
+			CaptureSettings.PixelFormat = CapturePixelFormat;
+		}
+		else if (bUseTestPattern)
+		{
+			CaptureSettings = FCaptureSettings::TestPattern();
 		}
 		else
 		{
-			VideoReader = new FTestVideoReader(
-				VideoFileLocation,
-				VideoReaderTickRate,
-				bResize ? ResizeDimensions : FVector2D());
+			CaptureSettings = bReplayUnthrottled
+				? FCaptureSettings::Replay(VideoFileLocation)
+				: FCaptureSettings::File(VideoFileLocation);
 		}
+		CaptureSettings.bLumaOnly = bCaptureLumaOnly;
+		CaptureSettings.bAdaptRefreshRate = bAdaptCaptureRate;
+		CaptureSettings.Scheduling = GetCaptureScheduling();
 		
-		GetWorld()->GetTimerManager().SetTimer(
-			EyeSampleTimer,
-			this,
-			&UCameraReader::OnEyeSampleTick,
-			EyeSampleRate,
-			true);
+		VideoReader = new FTestVideoReader(
+			CaptureSettings,
+			VideoReaderTickRate,
+			bResize ? ResizeDimensions : FVector2D(),
+			DetectorSettings);
+		
+		EndFrameHandle = FCoreDelegates::OnEndFrame.AddUObject(this, &UCameraReader::RecordGameThreadTime);
+
+		// The new eye detector starts with both eyes open.
+		bEyesOpen = true;
+		EyesOpenTime = 0;
 	}
 }
 
@@ -107,6 +177,11 @@ void UCameraReader::BeginDestroy()
 void UCameraReader::Deactivate()
 {
 	Super::Deactivate();
+
+	// A comparison would otherwise reactivate it.
+	if (GetWorld())
+		GetWorld()->GetTimerManager().ClearTimer(ExecutionModeTimer);
+	bAwaitingExecutionModeStart = false;
 	Stop();
 }
 
@@ -115,14 +190,60 @@ void UCameraReader::PrintOpenCVBuildInfo()
 	UE_LOG(LogBlinkOpenCV, Display, TEXT("%s"), *FString(cv::getBuildInformation().c_str()));
 }
 
+FBlinkFrameStats UCameraReader::GetCaptureFrameStats() const
+{
+	return VideoReader ? FBlinkFrameStats::FromStageStats(VideoReader->GetFrameStats()) : FBlinkFrameStats();
+}
+
+FBlinkFrameStats UCameraReader::GetDetectorFrameStats() const
+{
+	if (const FTestVideoReader* Casted = static_cast<FTestVideoReader*>(VideoReader))
+	{
+		if (const TSharedPtr<FEyeDetector> EyeDetector = Casted->GetEyeDetector().Pin())
+			return FBlinkFrameStats::FromStageStats(EyeDetector->GetFrameStats());
+	}
+	return FBlinkFrameStats();
+}
+
 void UCameraReader::Stop()
 {
 	// It's possible for world not to exist, such as game being stopped.
 	if (GetWorld())
-		GetWorld()->GetTimerManager().ClearTimer(EyeSampleTimer);
+		GetWorld()->GetTimerManager().ClearTimer(BothOpenTimer);
+	UnbindEyeEventDispatch();
+
+	if (EventLatency.Count > 0)
+	{
+		const TCHAR* DispatchMode = bDispatchEyeEventsImmediately ? TEXT("immediate") : TEXT("polled");
+		UE_LOG(LogBlinkOpenCV, Display, TEXT("CameraReader: Capture-to-event latency (%s dispatch): %s"), DispatchMode,
+			*EventLatency.ToString());
+		UE_LOG(LogBlinkOpenCV, Display, TEXT("CameraReader: Commit-to-event latency (%s dispatch): %s"), DispatchMode,
+			*DispatchLatency.ToString());
+		EventLatency.Reset();
+		DispatchLatency.Reset();
+	}
+
+	if (VideoReader)
+	{
+		// Replaying a clip with known blinks and winks (or none) shows how accurate the detector's settings are.
+		UE_LOG(LogBlinkOpenCV, Display, TEXT("CameraReader: Events (face %s): %d blinks, %d left winks, %d right winks"),
+			bTrackFace ? TEXT("tracked") : TEXT("detected every frame"), BlinkCount, LeftWinkCount, RightWinkCount);
+	}
+
+	FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+	EndFrameHandle.Reset();
+	if (GameThreadTime.Count > 0)
+	{
+		UE_LOG(LogBlinkOpenCV, Display, TEXT("CameraReader: Game thread time (detector on %s): %s"),
+			bRunDetectorOnTasks ? TEXT("tasks") : TEXT("dedicated threads"), *GameThreadTime.ToString());
+		GameThreadTime.Reset();
+	}
 	
 	if (VideoReader)
 	{
+		// Waits for the VideoReader and its detectors to finish what they're doing, rather than killing them.
+		VideoReader->StopThread();
+		
 		#if UE_BUILD_DEVELOPMENT || UE_EDITOR
 		if (bShowInSeparateWindow)
 			VideoReader->StopRendering();
@@ -133,63 +254,256 @@ void UCameraReader::Stop()
 	}
 }
 
-void UCameraReader::OnEyeSampleTick()
+void UCameraReader::ConsumeEyeEvents()
 {
-	if (VideoReader && VideoReader->IsVideoActive())
+	// Ensure correct Video Reader type.
+	const FTestVideoReader* Casted = static_cast<FTestVideoReader*>(VideoReader);
+	if (!Casted)
+		return;
+
+	// Safely retrieve the eye detector.
+	const TSharedPtr<FEyeDetector> EyeDetector = Casted->GetEyeDetector().Pin();
+	if (!EyeDetector.IsValid())
+		return;
+
+	// The eye detector is created once the video opens, so it can only be bound once it exists. Immediate dispatch can
+	// also be turned on and off while running.
+	if (bDispatchEyeEventsImmediately)
+		BindEyeEventDispatch(EyeDetector);
+	else
+		UnbindEyeEventDispatch();
+
+	// Every transition is consumed in the order it happened, so a blink that opened again before this tick still fires.
+	FEyeEvent Event;
+	while (EyeDetector->PopEyeEvent(OUT Event))
 	{
-		// Ensure correct Video Reader type.
-		if (const FTestVideoReader* Casted = static_cast<FTestVideoReader*>(VideoReader))
+		UE_LOG(LogBlinkOpenCV, Verbose, TEXT("CameraReader: %s -> %s after %.2fs (confidence %.2f)"),
+			*UEnum::GetValueAsString(Event.PreviousStatus), *UEnum::GetValueAsString(Event.Status),
+			Event.PreviousDuration, Event.Confidence);
+
+		bEyesOpen = Event.Status == EEyeStatus::BothOpen;
+		switch (Event.Status)
 		{
-			// Safely retrieve the eye detector.
-			if (const auto EyeDetector = Casted->GetEyeDetector().Pin())
+		case EEyeStatus::BothOpen:
+			EyesOpenTime = Event.OnsetTime;
+			break;
+		case EEyeStatus::Blink:
+			if (Event.OnsetTime > PreviousBlinkTime + BlinkResetTime /* different blink */)
+			{
+				bWasOpenLast = false;
+				PreviousBlinkTime = Event.OnsetTime;
+				LastEventConfidence = Event.Confidence;
+				RecordEventLatency(Event);
+				OnBlink();
+			}
+			break;
+		case EEyeStatus::WinkLeft:
+			if (Event.OnsetTime > PreviousLeftWinkTime + WinkResetTime)
+			{
+				bWasOpenLast = false;
+				PreviousLeftWinkTime = Event.OnsetTime;
+				LastEventConfidence = Event.Confidence;
+				RecordEventLatency(Event);
+				OnLeftEyeWink();
+			}
+			break;
+		case EEyeStatus::WinkRight:
+			if (Event.OnsetTime > PreviousRightWinkTime + WinkResetTime)
 			{
-				const double CurrentTime = FPlatformTime::Seconds();
-
-				double LastBlinkTimeValue = 0;
-				if (const auto LastBlinkTime = EyeDetector->GetLastBlinkTime().Pin())
-					LastBlinkTimeValue = *LastBlinkTime;
-
-				if (CurrentTime > PreviousBlinkTime + BlinkResetTime /* different* blink */ && LastBlinkTimeValue > PreviousBlinkTime /* new blink */)
-				{
-					bWasOpenLast = false;
-					PreviousBlinkTime = CurrentTime;
-					OnBlink();
-					return;
-				}
-
-				double LastLeftWinkTimeValue = 0;
-				if (const auto LastLeftWinkTime = EyeDetector->GetLastLeftWinkTime().Pin())
-					LastLeftWinkTimeValue = *LastLeftWinkTime;
-				
-				if (LastLeftWinkTimeValue > PreviousLeftWinkTime && CurrentTime > PreviousLeftWinkTime + WinkResetTime)
-				{
-					bWasOpenLast = false;
-					PreviousLeftWinkTime = CurrentTime;
-					OnLeftEyeWink();
-					return;
-				}
-
-				double LastRightWinkTimeValue = 0;
-				if (const auto LastRightWinkTime = EyeDetector->GetLastRightWinkTime().Pin())
-					LastRightWinkTimeValue = *LastRightWinkTime;
-				
-				if (LastRightWinkTimeValue > PreviousRightWinkTime && CurrentTime > PreviousRightWinkTime + WinkResetTime)
-				{
-					bWasOpenLast = false;
-					PreviousRightWinkTime = CurrentTime;
-					OnRightEyeWink();
-					return;
-				}
-
-				double OpenTime = CurrentTime - ConsiderAsOpenTime;
-				if (!bWasOpenLast && LastBlinkTimeValue < OpenTime && LastLeftWinkTimeValue < OpenTime && LastRightWinkTimeValue < OpenTime)
-				{
-					bWasOpenLast = true;
-					OnBothOpen();
-				}
+				bWasOpenLast = false;
+				PreviousRightWinkTime = Event.OnsetTime;
+				LastEventConfidence = Event.Confidence;
+				RecordEventLatency(Event);
+				OnRightEyeWink();
 			}
+			break;
+		default:
+			break;
 		}
 	}
+
+	// Only count the eyes as open once they have stayed open for a while, so a flicker doesn't fire it.
+	if (!bWasOpenLast && bEyesOpen && VideoReader->IsVideoActive())
+	{
+		const double TimeUntilOpen = EyesOpenTime + ConsiderAsOpenTime - FPlatformTime::Seconds();
+		if (TimeUntilOpen <= 0)
+		{
+			bWasOpenLast = true;
+			OnBothOpen();
+		}
+		else if (bDispatchEyeEventsImmediately && GetWorld())
+		{
+			// Rather than waiting for a tick to notice.
+			GetWorld()->GetTimerManager().SetTimer(BothOpenTimer, this, &UCameraReader::ConsumeEyeEvents,
+				TimeUntilOpen, false);
+		}
+	}
+}
+
+void UCameraReader::BindEyeEventDispatch(const TSharedPtr<FEyeDetector>& EyeDetector)
+{
+	if (DispatchingEyeDetector.HasSameObject(EyeDetector.Get()))
+		return;
+
+	DispatchingEyeDetector = EyeDetector;
+
+	// Whether a dispatch is already queued on the game thread. Owned by the callback and its dispatches rather than
+	// this, since they can outlive it. This is only reached through a weak pointer, on the game thread.
+	const TSharedRef<std::atomic<bool>, ESPMode::ThreadSafe> bDispatchPending =
+		MakeShared<std::atomic<bool>, ESPMode::ThreadSafe>(false);
+
+	EyeDetector->SetOnEyeEvent([WeakThis = TWeakObjectPtr<UCameraReader>(this), bDispatchPending]()
+	{
+		// Executed on worker thread.
+
+		// Only one dispatch is queued at a time. It consumes every event committed before it runs, so events arriving
+		// within one frame are dispatched together.
+		if (bDispatchPending->exchange(true))
+			return;
+
+		// Runs when the game thread next processes its task queue, at the latest at the start of the next frame.
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, bDispatchPending]()
+		{
+			// Cleared first, so an event committed while consuming queues another dispatch instead of being missed.
+			*bDispatchPending = false;
+			if (UCameraReader* CameraReader = WeakThis.Get())
+				CameraReader->ConsumeEyeEvents();
+		});
+	});
+}
+
+void UCameraReader::UnbindEyeEventDispatch()
+{
+	// Takes the detector's lock, so once this returns the callback isn't running and won't be called again.
+	if (const TSharedPtr<FEyeDetector> EyeDetector = DispatchingEyeDetector.Pin())
+		EyeDetector->SetOnEyeEvent(nullptr);
+
+	DispatchingEyeDetector.Reset();
+}
+
+void UCameraReader::RecordEventLatency(const FEyeEvent& Event)
+{
+	const double CurrentTime = FPlatformTime::Seconds();
+	DispatchLatency.Add(CurrentTime - Event.CommitTime);
+
+	LastEventLatency = CurrentTime - Event.OnsetTime;
+	EventLatency.Add(LastEventLatency);
+	UE_LOG(LogBlinkOpenCV, Log, TEXT("CameraReader: Event fired %.2fms after its frame was captured"),
+		LastEventLatency * 1000.0);
+}
+
+FThreadSchedulingSettings UCameraReader::GetCaptureScheduling() const
+{
+	if (bAutoThreadScheduling)
+		return FThreadSchedulingSettings::AutomaticCapture();
+
+	FThreadSchedulingSettings Scheduling;
+	Scheduling.Priority = ToThreadPriority(CaptureThreadPriority);
+	Scheduling.AffinityMask = static_cast<uint64>(CaptureThreadAffinity);
+	return Scheduling;
+}
+
+FThreadSchedulingSettings UCameraReader::GetDetectorScheduling() const
+{
+	if (bAutoThreadScheduling)
+		return FThreadSchedulingSettings::AutomaticDetector();
+
+	FThreadSchedulingSettings Scheduling;
+	Scheduling.Priority = ToThreadPriority(DetectorThreadPriority);
+	Scheduling.AffinityMask = static_cast<uint64>(DetectorThreadAffinity);
+	return Scheduling;
+}
+
+EThreadPriority UCameraReader::ToThreadPriority(EBlinkThreadPriority Priority)
+{
+	switch (Priority)
+	{
+	case EBlinkThreadPriority::Lowest:
+		return TPri_Lowest;
+	case EBlinkThreadPriority::BelowNormal:
+		return TPri_BelowNormal;
+	case EBlinkThreadPriority::SlightlyBelowNormal:
+		return TPri_SlightlyBelowNormal;
+	case EBlinkThreadPriority::AboveNormal:
+		return TPri_AboveNormal;
+	case EBlinkThreadPriority::Highest:
+		return TPri_Highest;
+	case EBlinkThreadPriority::TimeCritical:
+		return TPri_TimeCritical;
+	case EBlinkThreadPriority::Normal:
+	default:
+		return TPri_Normal;
+	}
+}
+
+EImageBackend UCameraReader::ToImageBackend(EBlinkImageBackend Backend)
+{
+	switch (Backend)
+	{
+	case EBlinkImageBackend::Cuda:
+		return EImageBackend::Cuda;
+	case EBlinkImageBackend::Cpu:
+		return EImageBackend::Cpu;
+	case EBlinkImageBackend::Auto:
+	default:
+		return EImageBackend::Auto;
+	}
+}
+
+void UCameraReader::RecordGameThreadTime()
+{
+	// Reconnecting and warming up the mode being compared would otherwise count towards it, so its measurement only
+	// starts once it has processed a frame.
+	if (bAwaitingExecutionModeStart)
+	{
+		if (GetDetectorFrameStats().NumProcessed == 0 || !GetWorld())
+			return;
+
+		bAwaitingExecutionModeStart = false;
+		GetWorld()->GetTimerManager().SetTimer(ExecutionModeTimer, this, &UCameraReader::OnExecutionModeMeasured,
+			SecondsPerExecutionMode, false);
+	}
+
+	// GGameThreadTime excludes time spent waiting for the render thread, so it only shows the work done on the game
+	// thread itself.
+	GameThreadTime.Add(FPlatformTime::ToSeconds(GGameThreadTime));
+}
+
+void UCameraReader::CompareDetectorExecutionModes(float SecondsPerMode)
+{
+	if (!GetWorld() || ExecutionModeTimer.IsValid() || bAwaitingExecutionModeStart)
+		return;
+
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("CameraReader: Measuring game thread time for %.0fs per detector execution mode"),
+		SecondsPerMode);
+
+	SecondsPerExecutionMode = SecondsPerMode;
+	bRunDetectorOnTasksBeforeComparison = bRunDetectorOnTasks;
+	bRunDetectorOnTasks = false;
+	bAwaitingExecutionModeStart = true;
+	Activate(true);
+}
+
+void UCameraReader::OnExecutionModeMeasured()
+{
+	// Restarting stops and resets the measurement, so take it first.
+	if (!bRunDetectorOnTasks)
+	{
+		DedicatedThreadsGameThreadTime = GameThreadTime.ToString();
+		bRunDetectorOnTasks = true;
+		bAwaitingExecutionModeStart = true;
+		Activate(true);
+		return;
+	}
+
+	GetWorld()->GetTimerManager().ClearTimer(ExecutionModeTimer);
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("CameraReader: Game thread time with the detector on dedicated threads: %s"),
+		*DedicatedThreadsGameThreadTime);
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("CameraReader: Game thread time with the detector on tasks: %s"),
+		*GameThreadTime.ToString());
+
+	bRunDetectorOnTasks = bRunDetectorOnTasksBeforeComparison;
+	Activate(true);
 }
 
 void UCameraReader::OnBothOpen_Implementation()
@@ -0,0 +1,187 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#include "CapturePipeline.h"
+
+FCaptureSettings FCaptureSettings::Camera(int32 InCameraIndex)
+{
+	FCaptureSettings Settings;
+	Settings.Source = ECaptureSource::Camera;
+	Settings.CameraIndex = InCameraIndex;
+	return Settings;
+}
+
+FCaptureSettings FCaptureSettings::File(const FString& InFilePath)
+{
+	FCaptureSettings Settings;
+	Settings.Source = ECaptureSource::File;
+	Settings.FilePath = InFilePath;
+	// A file would otherwise be decoded as fast as possible and the dropped frames would never be seen.
+	Settings.bSyncToClock = true;
+	return Settings;
+}
+
+FCaptureSettings FCaptureSettings::Replay(const FString& InFilePath)
+{
+	FCaptureSettings Settings = File(InFilePath);
+	Settings.bReplay = true;
+	// Block the decoder instead of dropping frames, and decode as fast as the frames are taken.
+	Settings.bDropFrames = false;
+	Settings.bSyncToClock = false;
+	return Settings;
+}
+
+FCaptureSettings FCaptureSettings::TestPattern(int32 InWidth, int32 InHeight, int32 InFrameRate)
+{
+	FCaptureSettings Settings;
+	Settings.Source = ECaptureSource::TestPattern;
+	Settings.Width = InWidth;
+	Settings.Height = InHeight;
+	Settings.FrameRate = InFrameRate;
+	return Settings;
+}
+
+FCapturePipelineBuilder::FCapturePipelineBuilder(const FCaptureSettings& InSettings)
+	: Settings(InSettings)
+{ }
+
+FString FCapturePipelineBuilder::Build() const
+{
+	FString Pipeline = GetSourceElement();
+
+	if (const FString SourceCaps = GetSourceCaps(); !SourceCaps.IsEmpty())
+		Pipeline += TEXT(" ! ") + SourceCaps;
+
+	if (const FString DecodeElements = GetDecodeElements(); !DecodeElements.IsEmpty())
+		Pipeline += TEXT(" ! ") + DecodeElements;
+
+	if (const FString ScaleElements = GetScaleElements(); !ScaleElements.IsEmpty())
+		Pipeline += TEXT(" ! ") + ScaleElements;
+
+	Pipeline += TEXT(" ! videoconvert ! ") + GetOutputCaps();
+	Pipeline += TEXT(" ! ") + GetSinkElement();
+	return Pipeline;
+}
+
+ECaptureOutputFormat FCapturePipelineBuilder::GetOutputFormat() const
+{
+	if (!Settings.bLumaOnly)
+		return ECaptureOutputFormat::BGR;
+
+	// Keep planar formats as they are; the luma plane can then be used without any conversion.
+	if (Settings.Source == ECaptureSource::Camera)
+	{
+		if (Settings.PixelFormat.Equals(TEXT("NV12"), ESearchCase::IgnoreCase))
+			return ECaptureOutputFormat::NV12;
+		if (Settings.PixelFormat.Equals(TEXT("I420"), ESearchCase::IgnoreCase))
+			return ECaptureOutputFormat::I420;
+		if (Settings.PixelFormat.Equals(TEXT("YV12"), ESearchCase::IgnoreCase))
+			return ECaptureOutputFormat::YV12;
+	}
+
+	return ECaptureOutputFormat::Gray;
+}
+
+FString FCapturePipelineBuilder::GetSourceElement() const
+{
+	switch (Settings.Source)
+	{
+	case ECaptureSource::File:
+		return FString::Printf(TEXT("filesrc location=\"%s\""), *Settings.FilePath);
+	case ECaptureSource::TestPattern:
+		// Live so it is paced like a camera instead of generating frames as fast as possible.
+		return TEXT("videotestsrc is-live=true pattern=ball");
+	case ECaptureSource::Camera:
+	default:
+		#if PLATFORM_LINUX
+		return FString::Printf(TEXT("v4l2src device=/dev/video%d"), Settings.CameraIndex);
+		#elif PLATFORM_MAC
+		return FString::Printf(TEXT("avfvideosrc device-index=%d"), Settings.CameraIndex);
+		#else
+		return FString::Printf(TEXT("ksvideosrc device-index=%d"), Settings.CameraIndex);
+		#endif
+	}
+}
+
+FString FCapturePipelineBuilder::GetSourceCaps() const
+{
+	// Files describe their own format.
+	if (Settings.Source == ECaptureSource::File)
+		return FString();
+
+	FString Caps = IsJpegFormat() ? TEXT("image/jpeg") : TEXT("video/x-raw");
+	if (!IsJpegFormat() && !Settings.PixelFormat.IsEmpty())
+		Caps.Appendf(TEXT(",format=%s"), *Settings.PixelFormat);
+	AppendDimensionCaps(Caps);
+
+	// Nothing was requested, let the source and decodebin negotiate between themselves.
+	if (Caps == TEXT("video/x-raw"))
+		return FString();
+
+	return Caps;
+}
+
+FString FCapturePipelineBuilder::GetDecodeElements() const
+{
+	if (IsJpegFormat())
+		return TEXT("jpegdec");
+
+	// Raw caps were requested so there is nothing to decode. Avoids decodebin's slow start-up.
+	if (!GetSourceCaps().IsEmpty())
+		return FString();
+
+	return TEXT("decodebin");
+}
+
+FString FCapturePipelineBuilder::GetScaleElements() const
+{
+	if (Settings.OutputWidth <= 0 || Settings.OutputHeight <= 0)
+		return FString();
+
+	// Scaling before videoconvert means the conversion (and everything after it) works on the smaller frame.
+	return FString::Printf(TEXT("videoscale ! video/x-raw,width=%d,height=%d"), Settings.OutputWidth,
+		Settings.OutputHeight);
+}
+
+FString FCapturePipelineBuilder::GetOutputCaps() const
+{
+	switch (GetOutputFormat())
+	{
+	case ECaptureOutputFormat::Gray:
+		return TEXT("video/x-raw,format=GRAY8");
+	case ECaptureOutputFormat::NV12:
+		return TEXT("video/x-raw,format=NV12");
+	case ECaptureOutputFormat::I420:
+		return TEXT("video/x-raw,format=I420");
+	case ECaptureOutputFormat::YV12:
+		return TEXT("video/x-raw,format=YV12");
+	case ECaptureOutputFormat::BGR:
+	default:
+		return TEXT("video/x-raw,format=BGR");
+	}
+}
+
+FString FCapturePipelineBuilder::GetSinkElement() const
+{
+	return FString::Printf(TEXT("appsink drop=%s max-buffers=%d sync=%s"),
+		Settings.bDropFrames ? TEXT("true") : TEXT("false"),
+		FMath::Max(Settings.MaxBufferedFrames, 0),
+		Settings.bSyncToClock ? TEXT("true") : TEXT("false"));
+}
+
+bool FCapturePipelineBuilder::IsJpegFormat() const
+{
+	return Settings.PixelFormat.Equals(TEXT("MJPG"), ESearchCase::IgnoreCase)
+		|| Settings.PixelFormat.Equals(TEXT("JPEG"), ESearchCase::IgnoreCase);
+}
+
+void FCapturePipelineBuilder::AppendDimensionCaps(FString& Caps) const
+{
+	if (Settings.Width > 0)
+		Caps.Appendf(TEXT(",width=%d"), Settings.Width);
+	if (Settings.Height > 0)
+		Caps.Appendf(TEXT(",height=%d"), Settings.Height);
+	if (Settings.FrameRate > 0)
+		Caps.Appendf(TEXT(",framerate=%d/1"), Settings.FrameRate);
+}
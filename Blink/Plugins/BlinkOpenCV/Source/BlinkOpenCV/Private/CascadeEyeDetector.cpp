@@ -3,6 +3,7 @@
 // NHE2422 Advanced Computer Games Development Assignment 2.
 
 #include "CascadeEyeDetector.h"
+#include "BlinkOpenCVStats.h"
 #include "PreOpenCVHeaders.h"
 #include "opencv2/imgproc.hpp"
 #include "opencv2/core/cuda.hpp"
@@ -15,10 +16,10 @@
 #include "PostOpenCVHeaders.h"
 #include "BlinkOpenCV.h"
 
-FCascadeEyeDetector::FCascadeEyeDetector(FVideoReader* InVideoReader)
-	: FEyeDetector(InVideoReader)
+FCascadeEyeDetector::FCascadeEyeDetector(FVideoReader* InVideoReader, const FFeatureDetectorSettings& InSettings)
+	: FEyeDetector(InVideoReader, InSettings)
 {
-	ThreadName = TEXT("CascadeEyeDetectorThread");
+	SetName(TEXT("CascadeEyeDetectorThread"));
 	
 	FString CascadeDirectory =
     FPaths::Combine(FPaths::ProjectContentDir(), TEXT("Blink"), TEXT("Cascades"));
@@ -31,88 +32,270 @@ FCascadeEyeDetector::FCascadeEyeDetector(FVideoReader* InVideoReader)
 	checkf(FileManager.FileExists(*CascadeFilePath), TEXT("The OpenCV Face cascade filter does not exist"));
 		
 	//FaceClassifier = cv::cuda::CascadeClassifier::create(TCHAR_TO_UTF8(*CascadeFilePath));
-	FaceClassifier = MakeShared<cv::CascadeClassifier>(TCHAR_TO_UTF8(*CascadeFilePath));
+	for (int32 i = 0; i < GetNumWorkers(); i++)
+		FaceClassifiers.Add(MakeShared<cv::CascadeClassifier>(TCHAR_TO_UTF8(*CascadeFilePath)));
 	//checkf(EyeClassifier, TEXT("Face Classifier could not be loaded."));
 	
 	// Load the Eye cascade filter.
 	CascadeFilePath = FPaths::Combine(CascadeDirectory, TEXT("haarcascade_eye.xml"));
 	checkf(FileManager.FileExists(*CascadeFilePath), TEXT("The OpenCV Eye cascade filter does not exist"));
 
-	EyeClassifier = MakeShared<cv::CascadeClassifier>(TCHAR_TO_UTF8(*CascadeFilePath));
+	for (int32 i = 0; i < GetNumWorkers(); i++)
+		EyeClassifiers.Add(MakeShared<cv::CascadeClassifier>(TCHAR_TO_UTF8(*CascadeFilePath)));
 	//checkf(EyeClassifier, TEXT("Eye Classifier could not be loaded."));
 
-	BlurFilter = MakeShared<cv::Ptr<cv::cuda::Filter>>(cv::cuda::createGaussianFilter(0, 0, {7, 7}, 0));
-	EdgeFilter = MakeShared<cv::Ptr<cv::cuda::CannyEdgeDetector>>(cv::cuda::createCannyEdgeDetector(20, 50));
+	if (GetSettings().bUseCompiledCascades)
+	{
+		for (int32 i = 0; i < GetNumWorkers(); i++)
+		{
+			FaceEvaluators.Add(FHaarCascadeEvaluator::CreateFrontalFace());
+			EyeEvaluators.Add(FHaarCascadeEvaluator::CreateEye());
+		}
+
+		UE_LOG(LogBlinkOpenCV, Display, TEXT("CascadeEyeDetector: Using the cascades compiled into the plugin (%s)"),
+			*FHaarCascadeEvaluator::GetInstructionSet());
+
+		// Benchmarked searches scale their own area down, so the classifier is compared on exactly the same pixels.
+		if (GetSettings().bShareCascadePyramid && !GetSettings().bBenchmarkCompiledCascades)
+		{
+			for (int32 i = 0; i < GetNumWorkers(); i++)
+				PyramidPools.Add(MakeUnique<FFramePool>());
+			PyramidBuildTimes.SetNum(GetNumWorkers());
+		}
+	}
 
-	CreateThread();
+	FaceCascadeBenchmarks.SetNum(GetNumWorkers());
+	EyeCascadeBenchmarks.SetNum(GetNumWorkers());
+	FaceTracks.SetNum(GetNumWorkers());
+	LeftEyePriors.SetNum(GetNumWorkers());
+	RightEyePriors.SetNum(GetNumWorkers());
+	NumEyeBandSearches.SetNumZeroed(GetNumWorkers());
+
+	CreateWorkers();
+	StartThread();
 }
 
 FCascadeEyeDetector::~FCascadeEyeDetector()
 {
-	EyeClassifier.Reset();
-	FaceClassifier.Reset();
-	BlurFilter.Reset();
-	EdgeFilter.Reset();
+	// The stages must not be using the classifiers while they're destroyed.
+	StopThread();
+
+	EyeEvaluators.Empty();
+	FaceEvaluators.Empty();
+	PyramidPools.Empty();
+	EyeClassifiers.Empty();
+	FaceClassifiers.Empty();
+}
+
+void FCascadeEyeDetector::OnStop()
+{
+	// Executed on worker thread, or game thread when running on tasks.
+
+	// Waits for the frames still in flight, so the face tracks are no longer being written to.
+	FEyeDetector::OnStop();
+
+	for (int32 i = 0; i < FaceTracks.Num(); i++)
+	{
+		const FFaceTrack& Track = FaceTracks[i];
+		UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' worker %d face detection: %d found, %d missed, %s."),
+			*GetName(), i, Track.NumDetected, Track.NumMissed, *Track.DetectTime.ToString());
+
+		if (Track.TrackTime.Count > 0 || Track.NumLost > 0)
+		{
+			UE_LOG(LogBlinkOpenCV, Display,
+				TEXT("Thread '%s' worker %d face tracking: %d tracked, %d lost, %.2f overlap with the cascade, %s."),
+				*GetName(), i, Track.TrackTime.Count, Track.NumLost,
+				Track.NumDriftSamples > 0 ? Track.TotalDriftOverlap / Track.NumDriftSamples : 0,
+				*Track.TrackTime.ToString());
+		}
+
+		UE_LOG(LogBlinkOpenCV, Display,
+			TEXT("Thread '%s' worker %d eye searches: %d around the last eye, %d in the whole eye area, "
+				"%d frames searched for both eyes in one pass."), *GetName(), i,
+			LeftEyePriors[i].NumPriorSearches + RightEyePriors[i].NumPriorSearches,
+			LeftEyePriors[i].NumAreaSearches + RightEyePriors[i].NumAreaSearches, NumEyeBandSearches[i]);
+
+		if (PyramidBuildTimes.IsValidIndex(i))
+		{
+			UE_LOG(LogBlinkOpenCV, Display,
+				TEXT("Thread '%s' worker %d frame pyramids: %s, %d allocated outside the pool."), *GetName(), i,
+				*PyramidBuildTimes[i].ToString(), PyramidPools[i]->GetNumFallbackAllocations());
+		}
+
+		for (const ECascade Cascade : {ECascade::Face, ECascade::Eye})
+		{
+			const FCascadeBenchmark& Benchmark =
+				Cascade == ECascade::Face ? FaceCascadeBenchmarks[i] : EyeCascadeBenchmarks[i];
+			if (Benchmark.CompiledTime.Count == 0)
+				continue;
+
+			UE_LOG(LogBlinkOpenCV, Display,
+				TEXT("Thread '%s' worker %d %s cascade: compiled %s, cv::CascadeClassifier %s, %d of %d searches differed."),
+				*GetName(), i, Cascade == ECascade::Face ? TEXT("face") : TEXT("eye"),
+				*Benchmark.CompiledTime.ToString(), *Benchmark.ClassifierTime.ToString(), Benchmark.NumMismatches,
+				Benchmark.CompiledTime.Count);
+		}
+	}
+}
+
+void FCascadeEyeDetector::PreprocessFrame(FEyeDetectionWork& Work)
+{
+	// Convert to greyscale at the captured resolution. Does nothing if captured in luma only.
+	PrepareFrame(Work.Frame.Image, Work.Frame.Image.size(), 1, Work.WorkerIndex);
+
+	if (PyramidPools.Num() > 0)
+		BuildPyramid(Work.Frame.Image, OUT Work.Pyramid, Work.WorkerIndex);
 }
 
-uint32 FCascadeEyeDetector::ProcessNextFrame(cv::Mat& Frame, const double& DeltaTime)
+void FCascadeEyeDetector::DetectFace(FEyeDetectionWork& Work) const
 {
-	// Convert to greyscale using CUDA.
-	cv::cuda::GpuMat Src;
-	Src.upload(Frame);
-	cv::cuda::cvtColor(Src, Src, cv::COLOR_BGR2GRAY);
-	Src.download(Frame);
+	Work.Face = GetFace(Work.Frame.Image, Work.Pyramid, Work.WorkerIndex, Work.Annotations);
+}
+
+void FCascadeEyeDetector::DetectEyes(FEyeDetectionWork& Work) const
+{
+	if (!Work.Face.empty())
+	{
+		GetEyes(Work.Frame.Image, Work.Face, OUT Work.LeftEyeArea, OUT Work.RightEyeArea, OUT Work.LeftEye,
+			OUT Work.RightEye, Work.WorkerIndex, Work.Annotations);
+	}
 
 	// Get the assumed eye status from frame.
-	const EEyeStatus FrameEyeStatus = GetEyeStatusFromFrame(Frame);
-	
-	UpdateEyeState(FrameEyeStatus, DeltaTime);
+	Work.FrameEyeStatus = GetEyeStatusFromEyes(Work.Face, Work.LeftEye, Work.RightEye);
+}
+
+void FCascadeEyeDetector::FilterEyeStatus(FEyeDetectionWork& Work)
+{
+	const EEyeStatus FrameEyeStatus = Work.FrameEyeStatus;
+	UpdateEyeState(FrameEyeStatus, Work.DeltaTime);
 	
 	// Do additional processing to determine the actual eye status by taking errors into account.
 	const EEyeStatus ErroredEyeStatus = GetEyeStatusWithError(FrameEyeStatus);
 
-	// Record the last eye(s) closed time so it can be used by external objects (i.e. CameraReader).
-	const double CurrentTime = FPlatformTime::Seconds();
-	switch (ErroredEyeStatus)
+	// Push an event if the status changed, so it can be used by external objects (i.e. CameraReader).
+	// Timestamped with when the frame was captured rather than now, so the game can tell how old the event is.
+	const float Confidence = GetEyeStatusConfidence(ErroredEyeStatus, TimeLeftEyeClosed / SampleRate,
+		TimeRightEyeClosed / SampleRate, ClosedEyeThreshold);
+	CommitEyeStatus(ErroredEyeStatus, Work.Frame.CaptureTime, Confidence);
+
+	if (Work.Annotations.IsEnabled())
 	{
-		case EEyeStatus::WinkLeft:
-			SetLastLeftWinkTime(CurrentTime);
-			break;
-		case EEyeStatus::WinkRight:
-			SetLastRightWinkTime(CurrentTime);
-			break;
-		case EEyeStatus::Blink:
-			SetLastBlinkTime(CurrentTime);
-			break;
+		Work.Annotations.AddLabel({8, 24}, FString::Printf(TEXT("%s (%.2f)"),
+			*UEnum::GetValueAsString(ErroredEyeStatus), Confidence), {0, 0, 255});
 	}
 
-	#if UE_BUILD_DEBUG || UE_EDITOR
-	UE_LOG(LogBlinkOpenCV, Warning, TEXT("State: %s"), *UEnum::GetValueAsString(FrameEyeStatus));
-	UE_LOG(LogBlinkOpenCV, Error, TEXT("State: %s"), *UEnum::GetValueAsString(ErroredEyeStatus));
-	#endif
-	
-	return 0;
+	BLINKOPENCV_LOG_RATE_LIMITED(Verbose, TEXT("Thread '%s' eye status: %s, filtered to %s (%.2f)."), *GetName(),
+		*UEnum::GetValueAsString(FrameEyeStatus), *UEnum::GetValueAsString(ErroredEyeStatus), Confidence);
 }
 
-cv::Rect FCascadeEyeDetector::GetFace(const cv::Mat& Frame) const
+cv::Rect FCascadeEyeDetector::GetFace(const cv::Mat& Frame, const FHaarPyramid& Pyramid, int32 WorkerIndex,
+                                      FFrameAnnotations& Annotations) const
 {
-	// Finds potential faces from frame.
-	std::vector<cv::Rect> Faces;
-	if (const auto FaceClass = GetFaceClassifier().Pin(); FaceClass.IsValid())
+	FFaceTrack& Track = FaceTracks[WorkerIndex];
+	const double StartTime = FPlatformTime::Seconds();
+
+	// The head barely moves between frames, so follow the face found last rather than searching the whole frame again.
+	// Only for so long though, so the face's size is kept up to date and a drifting track can't last.
+	if (GetSettings().bTrackFace && !Track.Template.empty()
+		&& Track.NumTrackedFrames < GetSettings().FaceRedetectInterval)
 	{
-		FaceClass->detectMultiScale(Frame, OUT Faces, 1.3f, 5,
-			cv::CASCADE_FIND_BIGGEST_OBJECT,
-			cv::Size(MinFaceSize, MinFaceSize));
+		float Score;
+		const cv::Rect TrackedFace = TrackFace(Frame, Track, OUT Score);
+		if (!TrackedFace.empty() && Score >= MinFaceTrackScore)
+		{
+			Track.Face = TrackedFace;
+			Track.NumTrackedFrames++;
+			Track.TrackTime.Add(FPlatformTime::Seconds() - StartTime);
+
+			AnnotateTrackedFace(Annotations, TrackedFace, Score);
+			return TrackedFace;
+		}
+
+		Track.NumLost++;
 	}
 
-	DrawPreFilteredFaces(Frame, Faces);
+	const cv::Rect Face = DetectFaceWithCascade(Frame, Pyramid, WorkerIndex, Annotations);
+	if (Face.empty())
+	{
+		Track.NumMissed++;
+		Track.Template.release();
+	}
+	else
+	{
+		Track.NumDetected++;
+		if (Track.NumTrackedFrames > 0)
+		{
+			const double Intersection = (Face & Track.Face).area();
+			Track.TotalDriftOverlap += Intersection / (Face.area() + Track.Face.area() - Intersection);
+			Track.NumDriftSamples++;
+		}
+
+		if (GetSettings().bTrackFace)
+			ResetFaceTrack(Frame, Face, Track);
+	}
+	Track.DetectTime.Add(FPlatformTime::Seconds() - StartTime);
+
+	return Face;
+}
+
+cv::Rect FCascadeEyeDetector::TrackFace(const cv::Mat& Frame, FFaceTrack& Track, float& OutScore) const
+{
+	OutScore = -1;
+
+	// Only search as far as the face could have moved since the last frame.
+	const int32 MarginX = FMath::RoundToInt(Track.Face.width * FaceSearchMargin);
+	const int32 MarginY = FMath::RoundToInt(Track.Face.height * FaceSearchMargin);
+	const cv::Rect SearchArea = cv::Rect(Track.Face.x - MarginX, Track.Face.y - MarginY,
+		Track.Face.width + MarginX * 2, Track.Face.height + MarginY * 2) & cv::Rect(0, 0, Frame.cols, Frame.rows);
+	if (SearchArea.empty())
+		return cv::Rect();
+
+	// Matched at the template's scale, which is where most of the saving comes from.
+	cv::resize(Frame(SearchArea), OUT Track.SearchImage, cv::Size(), Track.TemplateScale, Track.TemplateScale,
+		cv::INTER_AREA);
+	if (Track.SearchImage.cols < Track.Template.cols || Track.SearchImage.rows < Track.Template.rows)
+		return cv::Rect();
+
+	cv::matchTemplate(Track.SearchImage, Track.Template, OUT Track.MatchScores, cv::TM_CCOEFF_NORMED);
+
+	double BestScore;
+	cv::Point BestLocation;
+	cv::minMaxLoc(Track.MatchScores, nullptr, OUT &BestScore, nullptr, OUT &BestLocation);
+	OutScore = BestScore;
+
+	// Rounding can push it just past the edge of the frame.
+	return cv::Rect(
+		SearchArea.x + FMath::RoundToInt(BestLocation.x / Track.TemplateScale),
+		SearchArea.y + FMath::RoundToInt(BestLocation.y / Track.TemplateScale),
+		Track.Face.width, Track.Face.height) & cv::Rect(0, 0, Frame.cols, Frame.rows);
+}
+
+void FCascadeEyeDetector::ResetFaceTrack(const cv::Mat& Frame, const cv::Rect& Face, FFaceTrack& Track) const
+{
+	Track.Face = Face;
+	Track.NumTrackedFrames = 0;
+
+	// A copy, since the frame's pixels go back to the pool once it has been processed.
+	Track.TemplateScale = FMath::Min((float)FaceTemplateWidth / Face.width, 1.f);
+	cv::resize(Frame(Face), OUT Track.Template, cv::Size(), Track.TemplateScale, Track.TemplateScale, cv::INTER_AREA);
+}
+
+cv::Rect FCascadeEyeDetector::DetectFaceWithCascade(const cv::Mat& Frame, const FHaarPyramid& Pyramid,
+                                                    int32 WorkerIndex, FFrameAnnotations& Annotations) const
+{
+	// Finds potential faces from frame.
+	std::vector<cv::Rect> Faces;
+	DetectMultiScale(ECascade::Face, Frame, &Pyramid, cv::Rect(0, 0, Frame.cols, Frame.rows), OUT Faces,
+		FaceScaleFactor, 5, cv::Size(MinFaceSize, MinFaceSize), cv::Size(), WorkerIndex);
+
+	AnnotatePreFilteredFaces(Annotations, Faces);
 
 	FilterFaces(Frame, IN OUT Faces);
 
 	// This will most likely be the real face.
 	if (Faces.size() > 0)
 	{
-		DrawFace(Frame, Faces[0]);
+		AnnotateFace(Annotations, Faces[0]);
 		
 		return Faces[0];
 	}
@@ -143,55 +326,172 @@ void FCascadeEyeDetector::FilterFaces(const cv::Mat& Frame, std::vector<cv::Rect
 	Faces.emplace_back(BiggestFace);
 }
 
-void FCascadeEyeDetector::GetEyes(const cv::Mat& Frame, const cv::Rect& Face, cv::Rect& LeftEye, cv::Rect& RightEye) const
+void FCascadeEyeDetector::GetEyes(const cv::Mat& Frame, const cv::Rect& Face, cv::Rect& LeftEyeArea,
+                                  cv::Rect& RightEyeArea, cv::Rect& LeftEye, cv::Rect& RightEye, int32 WorkerIndex,
+                                  FFrameAnnotations& Annotations) const
 {
 	// Trim the Face rectangle to a small part where the eyes are typically located.
 	// Saves processing time and reduces false positives.
-	cv::Rect LeftEyeArea, RightEyeArea;
 	TrimFaceToEyes(Face, OUT LeftEyeArea, OUT RightEyeArea);
 
-	DrawEyeArea(Frame, LeftEyeArea);
-	DrawEyeArea(Frame, RightEyeArea);
+	// Eyes barely move from one frame to the next, so search even closer around where they were last found.
+	FEyePrior& LeftPrior = LeftEyePriors[WorkerIndex];
+	FEyePrior& RightPrior = RightEyePriors[WorkerIndex];
+	cv::Size LeftMinSize, LeftMaxSize, RightMinSize, RightMaxSize;
+	NarrowEyeSearch(Face, LeftPrior, IN OUT LeftEyeArea, OUT LeftMinSize, OUT LeftMaxSize);
+	NarrowEyeSearch(Face, RightPrior, IN OUT RightEyeArea, OUT RightMinSize, OUT RightMaxSize);
+
+	AnnotateEyeArea(Annotations, LeftEyeArea);
+	AnnotateEyeArea(Annotations, RightEyeArea);
 
 	std::vector<cv::Rect> LeftEyes;
 	std::vector<cv::Rect> RightEyes;
 
-	if (const auto EyeClass = GetEyeClassifier().Pin(); EyeClass.IsValid())
+	// Both eyes are searched for at the same scales over neighbouring pixels, so while the gap between the areas is
+	// small one pass over the band covering both scales and integrates each level once, instead of once for each eye.
+	// Once the areas have narrowed down to small windows far apart, the gap would cost more.
+	const cv::Rect EyeBand = LeftEyeArea | RightEyeArea;
+	const bool bSearchEyeBand = EyeBand.area() <= (LeftEyeArea.area() + RightEyeArea.area()) * MaxEyeBandOverhead;
+
+	if (bSearchEyeBand)
+	{
+		// Covers the sizes both searches would, and each eye is then held to its own. No maximum means no limit.
+		const cv::Size BandMinSize(FMath::Min(LeftMinSize.width, RightMinSize.width),
+		                           FMath::Min(LeftMinSize.height, RightMinSize.height));
+		const cv::Size BandMaxSize = LeftMaxSize.empty() || RightMaxSize.empty()
+			? cv::Size()
+			: cv::Size(FMath::Max(LeftMaxSize.width, RightMaxSize.width),
+			           FMath::Max(LeftMaxSize.height, RightMaxSize.height));
+
+		// Not grouped, so each eye's detections are grouped without the other eye's, or any between the two.
+		std::vector<cv::Rect> BandEyes;
+		DetectMultiScale(ECascade::Eye, Frame, nullptr, EyeBand, OUT BandEyes, EyeScaleFactor, 0, BandMinSize,
+			BandMaxSize, WorkerIndex);
+
+		GetEyesInArea(BandEyes, EyeBand, LeftEyeArea, LeftMinSize, LeftMaxSize, EyeMinNeighbors, OUT LeftEyes);
+		GetEyesInArea(BandEyes, EyeBand, RightEyeArea, RightMinSize, RightMaxSize, EyeMinNeighbors, OUT RightEyes);
+		NumEyeBandSearches[WorkerIndex]++;
+	}
+	else
 	{
 		// Search for eyes in the calculated Left Eye Area.
-		auto FaceRoi = Frame(LeftEyeArea);
-		EyeClass->detectMultiScale(
-			FaceRoi,
-			OUT LeftEyes,
-			1.3,
-			2,
-			cv::CASCADE_SCALE_IMAGE,
-			cv::Size(MinEyeSize, MinEyeSize));
+		DetectMultiScale(ECascade::Eye, Frame, nullptr, LeftEyeArea, OUT LeftEyes, EyeScaleFactor, EyeMinNeighbors,
+			LeftMinSize, LeftMaxSize, WorkerIndex);
 
 		// Search for eyes in the calculated Right Eye Area.
-		FaceRoi = Frame(RightEyeArea);
-		EyeClass->detectMultiScale(
-			FaceRoi,
-			OUT RightEyes,
-			1.3,
-			2,
-			cv::CASCADE_SCALE_IMAGE,
-			cv::Size(MinEyeSize, MinEyeSize));
+		DetectMultiScale(ECascade::Eye, Frame, nullptr, RightEyeArea, OUT RightEyes, EyeScaleFactor, EyeMinNeighbors,
+			RightMinSize, RightMaxSize, WorkerIndex);
 	}
 
-	DrawPreFilteredEyes(Frame, LeftEyeArea, LeftEyes);
-	DrawPreFilteredEyes(Frame, RightEyeArea, RightEyes);
+	AnnotatePreFilteredEyes(Annotations, LeftEyeArea, LeftEyes);
+	AnnotatePreFilteredEyes(Annotations, RightEyeArea, RightEyes);
 
 	// Remove eyes that are likely false positives.
 	FilterEyes(IN OUT LeftEyes, IN OUT RightEyes, Face);
 
-	if (LeftEyes.size() > 0)
-		LeftEye = LeftEyes[0];
-	if (RightEyes.size() > 0)
-		RightEye = RightEyes[0];
+	LeftEye = LeftEyes.size() > 0 ? LeftEyes[0] : cv::Rect();
+	RightEye = RightEyes.size() > 0 ? RightEyes[0] : cv::Rect();
+
+	UpdateEyePrior(LeftPrior, Face, LeftEyeArea, LeftEye);
+	UpdateEyePrior(RightPrior, Face, RightEyeArea, RightEye);
+
+	AnnotateEye(Annotations, LeftEyeArea, LeftEye);
+	AnnotateEye(Annotations, RightEyeArea, RightEye);
+}
+
+void FCascadeEyeDetector::DetectMultiScale(ECascade Cascade, const cv::Mat& Frame, const FHaarPyramid* Pyramid,
+                                           const cv::Rect& Area, std::vector<cv::Rect>& Objects, double ScaleFactor,
+                                           int32 MinNeighbors, const cv::Size& MinSize, const cv::Size& MaxSize,
+                                           int32 WorkerIndex) const
+{
+	const cv::Mat Image = Frame(Area);
+
+	const TArray<TUniquePtr<FHaarCascadeEvaluator>>& Evaluators =
+		Cascade == ECascade::Face ? FaceEvaluators : EyeEvaluators;
+	const TSharedPtr<cv::CascadeClassifier> Classifier =
+		(Cascade == ECascade::Face ? GetFaceClassifier(WorkerIndex) : GetEyeClassifier(WorkerIndex)).Pin();
+
+	if (Evaluators.Num() == 0)
+	{
+		// The flags are only used by cascades in the old format, which the bundled ones aren't in.
+		if (Classifier.IsValid())
+		{
+			Classifier->detectMultiScale(Image, OUT Objects, ScaleFactor, MinNeighbors, cv::CASCADE_SCALE_IMAGE,
+				MinSize, MaxSize);
+		}
+		return;
+	}
+
+	FHaarCascadeEvaluator& Evaluator = *Evaluators[WorkerIndex];
+	if (!GetSettings().bBenchmarkCompiledCascades || !Classifier.IsValid())
+	{
+		if (Pyramid && !Pyramid->IsEmpty())
+			Evaluator.DetectMultiScale(*Pyramid, Area, OUT Objects, ScaleFactor, MinNeighbors, MinSize, MaxSize);
+		else
+			Evaluator.DetectMultiScale(Image, OUT Objects, ScaleFactor, MinNeighbors, MinSize, MaxSize);
+		return;
+	}
+
+	// Both search the same image one after the other, so they're timed under the same conditions.
+	FCascadeBenchmark& Benchmark =
+		Cascade == ECascade::Face ? FaceCascadeBenchmarks[WorkerIndex] : EyeCascadeBenchmarks[WorkerIndex];
+
+	double StartTime = FPlatformTime::Seconds();
+	Evaluator.DetectMultiScale(Image, OUT Objects, ScaleFactor, MinNeighbors, MinSize, MaxSize);
+	Benchmark.CompiledTime.Add(FPlatformTime::Seconds() - StartTime);
+
+	std::vector<cv::Rect> ClassifierObjects;
+	StartTime = FPlatformTime::Seconds();
+	Classifier->detectMultiScale(Image, OUT ClassifierObjects, ScaleFactor, MinNeighbors, cv::CASCADE_SCALE_IMAGE,
+		MinSize, MaxSize);
+	Benchmark.ClassifierTime.Add(FPlatformTime::Seconds() - StartTime);
+
+	// cv::CascadeClassifier tests stripes of the image in parallel, so the same objects can come out in another order.
+	auto IsBefore = [](const cv::Rect& A, const cv::Rect& B)
+	{
+		return std::tie(A.x, A.y, A.width, A.height) < std::tie(B.x, B.y, B.width, B.height);
+	};
+	std::vector<cv::Rect> SortedObjects = Objects;
+	std::sort(SortedObjects.begin(), SortedObjects.end(), IsBefore);
+	std::sort(ClassifierObjects.begin(), ClassifierObjects.end(), IsBefore);
+	if (SortedObjects != ClassifierObjects)
+		Benchmark.NumMismatches++;
+}
+
+void FCascadeEyeDetector::GetEyesInArea(const std::vector<cv::Rect>& BandEyes, const cv::Rect& EyeBand,
+                                        const cv::Rect& EyeArea, const cv::Size& MinSize, const cv::Size& MaxSize,
+                                        int32 MinNeighbors, std::vector<cv::Rect>& OutEyes)
+{
+	OutEyes.clear();
+	for (const cv::Rect& BandEye : BandEyes)
+	{
+		const cv::Rect Eye = BandEye + EyeBand.tl();
+		if ((Eye & EyeArea) != Eye)
+			continue;
+		if (Eye.width < MinSize.width || Eye.height < MinSize.height)
+			continue;
+		if (!MaxSize.empty() && (Eye.width > MaxSize.width || Eye.height > MaxSize.height))
+			continue;
+
+		OutEyes.push_back(Eye - EyeArea.tl());
+	}
+
+	// Grouped the same way as cv::CascadeClassifier and FHaarCascadeEvaluator group their own detections.
+	cv::groupRectangles(IN OUT OutEyes, MinNeighbors, .2);
+}
+
+void FCascadeEyeDetector::BuildPyramid(const cv::Mat& Frame, FHaarPyramid& Pyramid, int32 WorkerIndex)
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	// Only the levels the face search uses: from the smallest one whose window can round up to the minimum face size,
+	// to the last one the face window fits in. The eye search covers a small part of the frame, which it scales down
+	// itself.
+	const cv::Size FaceWindowSize = FaceEvaluators[WorkerIndex]->GetWindowSize();
+	const double MinScale = (MinFaceSize - .5) / FMath::Max(FaceWindowSize.width, FaceWindowSize.height);
 
-	DrawEye(Frame, LeftEyeArea, LeftEye);
-	DrawEye(Frame, RightEyeArea, RightEye);
+	Pyramid.Build(Frame, FaceScaleFactor, MinScale, FaceWindowSize, PyramidPools[WorkerIndex].Get());
+	PyramidBuildTimes[WorkerIndex].Add(FPlatformTime::Seconds() - StartTime);
 }
 
 void FCascadeEyeDetector::TrimFaceToEyes(const cv::Rect& Face, cv::Rect& LeftEyeArea, cv::Rect& RightEyeArea)
@@ -213,6 +513,60 @@ void FCascadeEyeDetector::TrimFaceToEyes(const cv::Rect& Face, cv::Rect& LeftEye
 	RightEyeArea.x = Face.x + (Face.width * .83f) - RightEyeArea.width;
 }
 
+void FCascadeEyeDetector::NarrowEyeSearch(const cv::Rect& Face, FEyePrior& Prior, cv::Rect& EyeArea,
+                                          cv::Size& MinSize, cv::Size& MaxSize) const
+{
+	MinSize = cv::Size(MinEyeSize, MinEyeSize);
+	MaxSize = cv::Size();
+
+	// Missing for a few frames is most likely a blink, but any longer and the eye has probably moved (i.e. the head
+	// turned), so fall back to searching the whole area.
+	if (Prior.Eye.empty() || Prior.NumMissedFrames > MaxMissedEyeFrames)
+	{
+		Prior.NumAreaSearches++;
+		return;
+	}
+
+	const cv::Rect LastEye = Prior.Eye + Face.tl();
+	const int32 MarginX = FMath::RoundToInt(LastEye.width * EyeSearchMargin);
+	const int32 MarginY = FMath::RoundToInt(LastEye.height * EyeSearchMargin);
+	const cv::Rect Window = cv::Rect(LastEye.x - MarginX, LastEye.y - MarginY, LastEye.width + MarginX * 2,
+		LastEye.height + MarginY * 2) & Face;
+
+	// One level of the scale pyramid either side of the eye's last size.
+	const cv::Size NarrowMinSize(
+		FMath::Max(FMath::FloorToInt(LastEye.width / EyeScaleFactor), MinEyeSize),
+		FMath::Max(FMath::FloorToInt(LastEye.height / EyeScaleFactor), MinEyeSize));
+	const cv::Size NarrowMaxSize(
+		FMath::CeilToInt(LastEye.width * EyeScaleFactor),
+		FMath::CeilToInt(LastEye.height * EyeScaleFactor));
+
+	// The face was found further away than the eye, so it can't fit in the window any more.
+	if (Window.width < NarrowMinSize.width || Window.height < NarrowMinSize.height)
+	{
+		Prior.NumAreaSearches++;
+		return;
+	}
+
+	EyeArea = Window;
+	MinSize = NarrowMinSize;
+	MaxSize = NarrowMaxSize;
+	Prior.NumPriorSearches++;
+}
+
+void FCascadeEyeDetector::UpdateEyePrior(FEyePrior& Prior, const cv::Rect& Face, const cv::Rect& EyeArea,
+                                         const cv::Rect& Eye)
+{
+	if (Eye.empty())
+	{
+		Prior.NumMissedFrames++;
+		return;
+	}
+
+	Prior.Eye = Eye + EyeArea.tl() - Face.tl();
+	Prior.NumMissedFrames = 0;
+}
+
 void FCascadeEyeDetector::FilterEyes(std::vector<cv::Rect>& LeftEyes, std::vector<cv::Rect>& RightEyes, const cv::Rect& Face) const
 {
 	// Basic algorithm to determine which eyes are the real ones.
@@ -279,69 +633,42 @@ bool FCascadeEyeDetector::IsEyeTooLarge(const cv::Rect& Eye, const cv::Rect& Fac
 	return EyeProportion >= .1f;
 }
 
-void FCascadeEyeDetector::DrawPreFilteredFaces(const cv::Mat& Frame, const std::vector<cv::Rect>& Faces) const
+void FCascadeEyeDetector::AnnotatePreFilteredFaces(FFrameAnnotations& Annotations, const std::vector<cv::Rect>& Faces)
 {
 	// Show faces on frame as a rectangle.
-	for (auto Face : Faces)
-	{
-		cv::rectangle(Frame,
-			{Face.x, Face.y}, {Face.x + Face.width, Face.y + Face.height},
-			{255, 255, 0}, 2);
-	}
+	for (const cv::Rect& Face : Faces)
+		Annotations.AddRect(Face, {255, 255, 0}, 2);
 }
 
-void FCascadeEyeDetector::DrawFace(const cv::Mat& Frame, const cv::Rect& Face) const
+void FCascadeEyeDetector::AnnotateFace(FFrameAnnotations& Annotations, const cv::Rect& Face)
 {
-	cv::rectangle(Frame,
-			{Face.x, Face.y}, {Face.x + Face.width, Face.y + Face.height},
-			{175, 255, 0}, 2);
+	Annotations.AddRect(Face, {175, 255, 0}, 2);
 }
 
-void FCascadeEyeDetector::DrawEyeArea(const cv::Mat& Frame, const cv::Rect& EyeArea) const
+void FCascadeEyeDetector::AnnotateTrackedFace(FFrameAnnotations& Annotations, const cv::Rect& Face, float Score)
 {
-	cv::rectangle(Frame,
-			{EyeArea.x, EyeArea.y}, {EyeArea.x + EyeArea.width, EyeArea.y + EyeArea.height},
-			{125, 255, 0}, 2);
+	Annotations.AddRect(Face, {0, 175, 255}, 2);
+	Annotations.AddLabel({Face.x, Face.y - 6}, FString::Printf(TEXT("Tracked (%.2f)"), Score), {0, 175, 255});
 }
 
-void FCascadeEyeDetector::DrawPreFilteredEyes(const cv::Mat& Frame, const cv::Rect& Face, const std::vector<cv::Rect>& Eyes) const
+void FCascadeEyeDetector::AnnotateEyeArea(FFrameAnnotations& Annotations, const cv::Rect& EyeArea)
 {
-	// Show eyes on frame as a rectangle.
-	for (auto Eye : Eyes)
-	{
-		cv::rectangle(Frame(Face),
-			{Eye.x, Eye.y}, {Eye.x + Eye.width, Eye.y + Eye.height},
-			{0, 255, 255}, 1);
-	}
+	Annotations.AddRect(EyeArea, {125, 255, 0}, 2);
 }
 
-void FCascadeEyeDetector::DrawEye(const cv::Mat& Frame, const cv::Rect& EyeArea, const cv::Rect& Eye) const
+void FCascadeEyeDetector::AnnotatePreFilteredEyes(FFrameAnnotations& Annotations, const cv::Rect& EyeArea,
+                                                  const std::vector<cv::Rect>& Eyes)
 {
-	const auto EyeCentre = cv::Point(Eye.x + Eye.width / 2, Eye.y + Eye.height / 2);
-	const int32 Radius = FMath::RoundToInt((Eye.width + Eye.height) * .15f);
-	cv::circle(Frame(EyeArea), EyeCentre, Radius, {150, 255, 255}, 1);
+	// Show eyes on frame as a rectangle. Eyes are relative to their eye area.
+	for (const cv::Rect& Eye : Eyes)
+		Annotations.AddRect(Eye + EyeArea.tl(), {0, 255, 255}, 1);
 }
 
-EEyeStatus FCascadeEyeDetector::GetEyeStatusFromFrame(const cv::Mat& Frame) const
+void FCascadeEyeDetector::AnnotateEye(FFrameAnnotations& Annotations, const cv::Rect& EyeArea, const cv::Rect& Eye)
 {
-	// Get faces.
-	const cv::Rect Face = GetFace(Frame);
-	if (Face.empty())
-		return EEyeStatus::Error;
-	
-	// Get eyes.
-	cv::Rect LeftEye, RightEye;
-	GetEyes(Frame, Face, OUT LeftEye, OUT RightEye);
-	
-	// Treat no eyes found as a blink.
-	if (LeftEye.empty() && RightEye.empty())
-		return EEyeStatus::Blink;
-	if (LeftEye.empty())
-		return EEyeStatus::WinkLeft;
-	if (RightEye.empty())
-		return EEyeStatus::WinkRight;
-
-	return EEyeStatus::BothOpen;
+	const auto EyeCentre = cv::Point(Eye.x + Eye.width / 2, Eye.y + Eye.height / 2);
+	const int32 Radius = FMath::RoundToInt((Eye.width + Eye.height) * .15f);
+	Annotations.AddCircle(EyeCentre + EyeArea.tl(), Radius, {150, 255, 255}, 1);
 }
 
 void FCascadeEyeDetector::UpdateEyeState(EEyeStatus FrameEyeStatus, const double& DeltaTime)
@@ -5,18 +5,26 @@
 #include "DnnCascadeEyeDetector.h"
 
 #include "BlinkOpenCV.h"
-#include "opencv2/cudaimgproc.hpp"
+#include "BlinkOpenCVStats.h"
 
 
-FDnnCascadeEyeDetector::FDnnCascadeEyeDetector(FVideoReader* InVideoReader) : FEyeDetector(InVideoReader)
+FDnnCascadeEyeDetector::FDnnCascadeEyeDetector(FVideoReader* InVideoReader, const FFeatureDetectorSettings& InSettings)
+	: FEyeDetector(InVideoReader, InSettings)
 {
-	ThreadName = TEXT("DnnCascadeEyeDetectorThread");
+	SetName(TEXT("DnnCascadeEyeDetectorThread"));
 
-	CreateThread();
+	for (int32 i = 0; i < GetNumWorkers(); i++)
+		FaceImageBackends.Add(FImageBackend::Create(GetImageBackendType()));
+
+	// The models are only loaded in OnStart, but no frame reaches the stages before then.
+	CreateWorkers();
+	StartThread();
 }
 
-bool FDnnCascadeEyeDetector::Init()
+void FDnnCascadeEyeDetector::OnStart()
 {
+	// Executed on worker thread.
+
 	FString DnnDirectory = FPaths::Combine(FPaths::ProjectPluginsDir(), TEXT("BlinkOpenCV"), TEXT("Content"), TEXT("DNN"));
 	FString CascadeDirectory = FPaths::Combine(FPaths::ProjectPluginsDir(), TEXT("BlinkOpenCV"), TEXT("Content"), TEXT("Cascades"));
 	
@@ -26,79 +34,121 @@ bool FDnnCascadeEyeDetector::Init()
 	// Load the Face ONNX model.
 	FString FilePath = FPaths::Combine(DnnDirectory, TEXT("face_detection_yunet_2022mar.onnx"));
 	checkf(FileManager.FileExists(*FilePath), TEXT("The OpenCV Face model does not exist"));
-	LoadedFaceDetector = MakeShared<cv::Ptr<cv::FaceDetectorYN>>(cv::FaceDetectorYN::create(TCHAR_TO_UTF8(*FilePath), "", {100, 100},
-		FaceConfidenceThreshold, NmsThreshold, TopKBoxes, cv::dnn::DNN_BACKEND_CUDA, cv::dnn::DNN_TARGET_CUDA));
-	checkf(LoadedFaceDetector.IsValid(), TEXT("The OpenCV Face model failed to load"));
+	for (int32 i = 0; i < GetNumWorkers(); i++)
+	{
+		LoadedFaceDetectors.Add(MakeShared<cv::Ptr<cv::FaceDetectorYN>>(cv::FaceDetectorYN::create(TCHAR_TO_UTF8(*FilePath), "", {100, 100},
+			FaceConfidenceThreshold, NmsThreshold, TopKBoxes, FImageBackend::GetDnnBackend(GetImageBackendType()),
+			FImageBackend::GetDnnTarget(GetImageBackendType()))));
+		checkf(LoadedFaceDetectors.Last().IsValid(), TEXT("The OpenCV Face model failed to load"));
+	}
 
 	// Load the Right Eye Haar classifier.
 	FilePath = FPaths::Combine(CascadeDirectory, TEXT("haarcascade_eye.xml"));
 	checkf(FileManager.FileExists(*FilePath), TEXT("The OpenCV Right Eye cascade filter does not exist"));
-	LoadedRightEyeClassifier = MakeShared<cv::CascadeClassifier>(TCHAR_TO_UTF8(*FilePath));
+	for (int32 i = 0; i < GetNumWorkers(); i++)
+		LoadedRightEyeClassifiers.Add(MakeShared<cv::CascadeClassifier>(TCHAR_TO_UTF8(*FilePath)));
 
 	// Load the Left Eye Haar classifier.
 	FilePath = FPaths::Combine(CascadeDirectory, TEXT("haarcascade_eye.xml"));
 	checkf(FileManager.FileExists(*FilePath), TEXT("The OpenCV Left Eye cascade filter does not exist"));
-	LoadedLeftEyeClassifier = MakeShared<cv::CascadeClassifier>(TCHAR_TO_UTF8(*FilePath));
+	for (int32 i = 0; i < GetNumWorkers(); i++)
+		LoadedLeftEyeClassifiers.Add(MakeShared<cv::CascadeClassifier>(TCHAR_TO_UTF8(*FilePath)));
 
 	
-	return FEyeDetector::Init();
+	FEyeDetector::OnStart();
 }
 
 FDnnCascadeEyeDetector::~FDnnCascadeEyeDetector()
 {
-	LoadedFaceDetector.Reset();
-	LoadedRightEyeClassifier.Reset();
-	LoadedLeftEyeClassifier.Reset();
+	// The stages must not be using the models while they're destroyed.
+	StopThread();
+
+	LoadedFaceDetectors.Empty();
+	LoadedRightEyeClassifiers.Empty();
+	LoadedLeftEyeClassifiers.Empty();
+	FaceImageBackends.Empty();
+}
+
+void FDnnCascadeEyeDetector::PreprocessFrame(FEyeDetectionWork& Work)
+{
+	// The face detector needs colour input. Skips the resize if the capture pipeline is already scaling to 720p.
+	PrepareFrame(Work.Frame.Image, {1280, 720}, 3, Work.WorkerIndex);
 }
 
-uint32 FDnnCascadeEyeDetector::ProcessNextFrame(cv::Mat& Frame, const double& DeltaTime)
+void FDnnCascadeEyeDetector::DetectFace(FEyeDetectionWork& Work) const
 {
-	cv::cuda::GpuMat CMat;
-	CMat.upload(Frame);
-	cv::cuda::resize(CMat, CMat, {1280, 720});
-	CMat.download(Frame);
-	
-	const EEyeStatus FrameEyeStatus = GetEyeStatusFromFrame(Frame);
+	const cv::Mat& Frame = Work.Frame.Image;
+	Work.Face = GetFace(Frame, OUT Work.FoundFaces, OUT Work.FaceIndex, Work.WorkerIndex);
+	if (Work.FaceIndex < 0)
+		return;
+
+	AnnotateFace(Work.Annotations, Work.FoundFaces, Work.FaceIndex, true);
+
+	// Get the approximate eye location using the eye landmarks from the face detection model.
+	const cv::Point RightEyeApproxLocation = GetRightEyeApproxLocation(Work.FoundFaces, Work.FaceIndex);
+	const cv::Point LeftEyeApproxLocation = GetLeftEyeApproxLocation(Work.FoundFaces, Work.FaceIndex);
+
+	// Convert the approximate eye location from a point to a rectangle proportional to the face width.
+	Work.RightEyeArea = GetEyeApproxLocationArea(Work.Face, RightEyeApproxLocation);
+	Work.LeftEyeArea = GetEyeApproxLocationArea(Work.Face, LeftEyeApproxLocation);
+
+	AnnotateEyeApproxArea(Work.Annotations, Work.RightEyeArea);
+	AnnotateEyeApproxArea(Work.Annotations, Work.LeftEyeArea);
+}
+
+void FDnnCascadeEyeDetector::DetectEyes(FEyeDetectionWork& Work) const
+{
+	if (Work.FaceIndex < 0)
+	{
+		Work.FrameEyeStatus = EEyeStatus::Error;
+		return;
+	}
 
-	UpdateEyeState(FrameEyeStatus, DeltaTime);
+	// Find and retrieve the actual eyes from the approximate eye location.
+	GetEyes(Work.Frame.Image, Work.Face, Work.RightEyeArea, Work.LeftEyeArea, OUT Work.RightEye, OUT Work.LeftEye,
+		Work.WorkerIndex, Work.Annotations);
+
+	AnnotateEye(Work.Annotations, Work.RightEyeArea, Work.RightEye);
+	AnnotateEye(Work.Annotations, Work.LeftEyeArea, Work.LeftEye);
+
+	Work.FrameEyeStatus = GetEyeStatusFromEyes(Work.Face, Work.LeftEye, Work.RightEye);
+}
+
+void FDnnCascadeEyeDetector::FilterEyeStatus(FEyeDetectionWork& Work)
+{
+	const EEyeStatus FrameEyeStatus = Work.FrameEyeStatus;
+	UpdateEyeState(FrameEyeStatus, Work.DeltaTime);
 	
 	// Do additional processing to determine the actual eye status by taking errors into account.
 	const EEyeStatus ErroredEyeStatus = GetEyeStatusWithError(FrameEyeStatus);
 
-	// Record the last eye(s) closed time so it can be used by external objects.
-	const double CurrentTime = FPlatformTime::Seconds();
-	switch (ErroredEyeStatus)
+	// Push an event if the status changed, so it can be used by external objects (i.e. CameraReader).
+	// Timestamped with when the frame was captured rather than now, so the game can tell how old the event is.
+	const float Confidence = GetEyeStatusConfidence(ErroredEyeStatus, TimeLeftEyeClosed / SampleRate,
+		TimeRightEyeClosed / SampleRate, ClosedEyeThreshold);
+	CommitEyeStatus(ErroredEyeStatus, Work.Frame.CaptureTime, Confidence);
+
+	if (Work.Annotations.IsEnabled())
 	{
-	case EEyeStatus::WinkLeft:
-		SetLastLeftWinkTime(CurrentTime);
-		break;
-	case EEyeStatus::WinkRight:
-		SetLastRightWinkTime(CurrentTime);
-		break;
-	case EEyeStatus::Blink:
-		SetLastBlinkTime(CurrentTime);
-		break;
+		Work.Annotations.AddLabel({8, 24}, FString::Printf(TEXT("%s (%.2f)"),
+			*UEnum::GetValueAsString(ErroredEyeStatus), Confidence), {0, 0, 255});
 	}
 
-	UE_LOG(LogBlinkOpenCV, Warning, TEXT("State: %s"), *UEnum::GetValueAsString(FrameEyeStatus));
-	UE_LOG(LogBlinkOpenCV, Error, TEXT("State: %s"), *UEnum::GetValueAsString(ErroredEyeStatus));
-	
-	return 0;
+	BLINKOPENCV_LOG_RATE_LIMITED(Verbose, TEXT("Thread '%s' eye status: %s, filtered to %s (%.2f)."), *GetName(),
+		*UEnum::GetValueAsString(FrameEyeStatus), *UEnum::GetValueAsString(ErroredEyeStatus), Confidence);
 }
 
-cv::Rect FDnnCascadeEyeDetector::GetFace(const cv::Mat& Frame, cv::Mat& FoundFaces, int32& BestFaceIndex) const
+cv::Rect FDnnCascadeEyeDetector::GetFace(const cv::Mat& Frame, cv::Mat& FoundFaces, int32& BestFaceIndex,
+                                         int32 WorkerIndex) const
 {
 	BestFaceIndex = -1;
 
 	// Downscale frame since the face detector performs very poorly at high resolution, with no improvement to
 	// accuracy.
-	cv::Mat DownscaledFrame = Frame;
-	cv::cuda::GpuMat CMat;
-	CMat.upload(DownscaledFrame);
-	cv::cuda::resize(CMat, CMat, {640, 360});
-	CMat.download(DownscaledFrame);
+	cv::Mat DownscaledFrame;
+	FaceImageBackends[WorkerIndex]->Resize(Frame, {640, 360}, Frame.channels(), OUT DownscaledFrame);
 	
-	if (const auto FaceDetector = GetFaceDetector().Pin(); FaceDetector.IsValid())
+	if (const auto FaceDetector = GetFaceDetector(WorkerIndex).Pin(); FaceDetector.IsValid())
 	{
 		FaceDetector->get()->setInputSize({DownscaledFrame.cols, DownscaledFrame.rows});
 		FaceDetector->get()->detect(DownscaledFrame, OUT FoundFaces);
@@ -132,84 +182,46 @@ int32 FDnnCascadeEyeDetector::CalculateBestFace(const cv::Mat& FoundFaces) const
 	return BiggestFaceIndex;
 }
 
-void FDnnCascadeEyeDetector::DrawFace(const cv::Mat& Frame, const cv::Mat& Faces, int32 FaceIndex,
+void FDnnCascadeEyeDetector::AnnotateFace(FFrameAnnotations& Annotations, const cv::Mat& Faces, int32 FaceIndex,
 	bool bIncludeApproxEyes) const
 {
 	// Face box.
-	cv::rectangle(Frame,
-			GetFaceRect(Faces, FaceIndex),
-			{175, 255, 0}, 2);
+	Annotations.AddRect(GetFaceRect(Faces, FaceIndex), {175, 255, 0}, 2);
+
+	if (!bIncludeApproxEyes)
+		return;
 
 	// Right eye (from person pov)
-	cv::circle(Frame, GetRightEyeApproxLocation(Faces, FaceIndex), 3, {150, 255, 255}, 1);
+	Annotations.AddCircle(GetRightEyeApproxLocation(Faces, FaceIndex), 3, {150, 255, 255}, 1);
 
 	// Left eye (from person pov)
-	cv::circle(Frame, GetLeftEyeApproxLocation(Faces, FaceIndex), 3, {150, 255, 255}, 1);
+	Annotations.AddCircle(GetLeftEyeApproxLocation(Faces, FaceIndex), 3, {150, 255, 255}, 1);
 }
 
-void FDnnCascadeEyeDetector::DrawEyeApproxArea(const cv::Mat& Frame, const cv::Rect& EyeApproxArea) const
+void FDnnCascadeEyeDetector::AnnotateEyeApproxArea(FFrameAnnotations& Annotations, const cv::Rect& EyeApproxArea)
 {
-	cv::rectangle(Frame, EyeApproxArea, {0, 255, 0}, 1);
+	Annotations.AddRect(EyeApproxArea, {0, 255, 0}, 1);
 }
 
-void FDnnCascadeEyeDetector::DrawPrefilteredEye(const cv::Mat& Frame, const cv::Rect& EyeApproxArea,
-	const cv::Rect& Eye) const
+void FDnnCascadeEyeDetector::AnnotatePrefilteredEye(FFrameAnnotations& Annotations, const cv::Rect& EyeApproxArea,
+	const cv::Rect& Eye)
 {
-	cv::rectangle(Frame(EyeApproxArea), Eye, {50, 50, 50}, 1);
+	// Eyes are relative to their eye area.
+	Annotations.AddRect(Eye + EyeApproxArea.tl(), {50, 50, 50}, 1);
 }
 
-void FDnnCascadeEyeDetector::DrawEye(const cv::Mat& Frame, const cv::Rect& EyeApproxArea, const cv::Rect& Eye) const
+void FDnnCascadeEyeDetector::AnnotateEye(FFrameAnnotations& Annotations, const cv::Rect& EyeApproxArea,
+	const cv::Rect& Eye)
 {
 	if (Eye.area() == 0)
 		return;
 	
 	const int32 Radius = Eye.width / 2;
 	const auto EyeCentre = cv::Point(Eye.x + Radius, Eye.y + Radius);
-	cv::circle(Frame(EyeApproxArea), EyeCentre, Radius, {0, 0, 255}, 1);
+	Annotations.AddCircle(EyeCentre + EyeApproxArea.tl(), Radius, {0, 0, 255}, 1);
 }
 
 
-EEyeStatus FDnnCascadeEyeDetector::GetEyeStatusFromFrame(const cv::Mat& Frame) const
-{	
-	cv::Mat FoundFaces;
-	int32 BestFaceIndex;
-	cv::Rect FaceRect = GetFace(Frame, OUT FoundFaces, OUT BestFaceIndex);
-	
-	if (BestFaceIndex >= 0)
-	{
-		DrawFace(Frame, FoundFaces, BestFaceIndex, true);
-
-		// Get the approximate eye location using the eye landmarks from the face detection model.
-		const cv::Point RightEyeApproxLocation = GetRightEyeApproxLocation(FoundFaces, BestFaceIndex);
-		const cv::Point LeftEyeApproxLocation = GetLeftEyeApproxLocation(FoundFaces, BestFaceIndex);
-
-		// Convert the approximate eye location from a point to a rectangle proportional to the face width.
-		const cv::Rect RightEyeApproxArea = GetEyeApproxLocationArea(FaceRect, RightEyeApproxLocation);
-		const cv::Rect LeftEyeApproxArea = GetEyeApproxLocationArea(FaceRect, LeftEyeApproxLocation);
-
-		DrawEyeApproxArea(Frame, RightEyeApproxArea);
-		DrawEyeApproxArea(Frame, LeftEyeApproxArea);
-
-		// Find and retrieve the actual eyes from the approximate eye location.
-		cv::Rect RightEye, LeftEye;
-		GetEyes(Frame, FaceRect, RightEyeApproxArea, LeftEyeApproxArea, OUT RightEye, OUT LeftEye);
-
-		DrawEye(Frame, RightEyeApproxArea, RightEye);
-		DrawEye(Frame, LeftEyeApproxArea, LeftEye);
-		
-		if (RightEye.empty() && LeftEye.empty())
-			return EEyeStatus::Blink;
-		if (RightEye.empty())
-			return EEyeStatus::WinkRight;
-		if (LeftEye.empty())
-			return EEyeStatus::WinkLeft;
-		
-		return EEyeStatus::BothOpen;
-	}
-
-	return EEyeStatus::Error;
-}
-
 void FDnnCascadeEyeDetector::UpdateEyeState(EEyeStatus FrameEyeStatus, const double& DeltaTime)
 {
 	// Keeps track of frame changes so we can figure out which events were likely errors.
@@ -294,17 +306,14 @@ cv::Size FDnnCascadeEyeDetector::GetMinEyeSize(const cv::Rect& EyeApproxLocation
 }
 
 std::vector<cv::Rect> FDnnCascadeEyeDetector::GetRightEyesByCascade(const cv::Mat& Frame,
-                                                                    const cv::Rect& RightEyeApproxArea) const
+                                                                    const cv::Rect& RightEyeApproxArea,
+                                                                    int32 WorkerIndex) const
 {
-	if (const auto RightEyeClassifier = GetRightEyeClassifier().Pin(); RightEyeClassifier.IsValid())
+	if (const auto RightEyeClassifier = GetRightEyeClassifier(WorkerIndex).Pin(); RightEyeClassifier.IsValid())
 	{
-		cv::Mat EyeRoi = Frame(RightEyeApproxArea);
-
-		// Cascade appears to work better in greyscale.
-		cv::cuda::GpuMat CMat;
-		CMat.upload(EyeRoi);
-		cv::cuda::cvtColor(CMat, CMat, cv::COLOR_BGR2GRAY);
-		CMat.download(EyeRoi);
+		// Cascade appears to work better in greyscale. The area is too small to be worth a GPU round trip.
+		cv::Mat EyeRoi;
+		cv::cvtColor(Frame(RightEyeApproxArea), OUT EyeRoi, cv::COLOR_BGR2GRAY);
 	
 		// Search for eyes in the calculated Right Eye Area.
 		std::vector<cv::Rect> RightEyes;
@@ -324,17 +333,13 @@ std::vector<cv::Rect> FDnnCascadeEyeDetector::GetRightEyesByCascade(const cv::Ma
 }
 
 std::vector<cv::Rect> FDnnCascadeEyeDetector::GetLeftEyesByCascade(const cv::Mat& Frame,
-	const cv::Rect& LeftEyeApproxArea) const
+	const cv::Rect& LeftEyeApproxArea, int32 WorkerIndex) const
 {
-	if (const auto LeftEyeClassifier = GetLeftEyeClassifier().Pin(); LeftEyeClassifier.IsValid())
+	if (const auto LeftEyeClassifier = GetLeftEyeClassifier(WorkerIndex).Pin(); LeftEyeClassifier.IsValid())
 	{
-		cv::Mat EyeRoi = Frame(LeftEyeApproxArea);
-	
-		// Cascade appears to work better in greyscale.
-		cv::cuda::GpuMat CMat;
-		CMat.upload(EyeRoi);
-		cv::cuda::cvtColor(CMat, CMat, cv::COLOR_BGR2GRAY);
-		CMat.download(EyeRoi);
+		// Cascade appears to work better in greyscale. The area is too small to be worth a GPU round trip.
+		cv::Mat EyeRoi;
+		cv::cvtColor(Frame(LeftEyeApproxArea), OUT EyeRoi, cv::COLOR_BGR2GRAY);
 	
 		// Search for eyes in the calculated Left Eye Area.
 		std::vector<cv::Rect> LeftEyes;
@@ -371,16 +376,17 @@ void FDnnCascadeEyeDetector::FilterEyes(std::vector<cv::Rect>& LeftEyes, std::ve
 }
 
 void FDnnCascadeEyeDetector::GetEyes(const cv::Mat& Frame, const cv::Rect& Face, const cv::Rect& RightEyeApproxArea,
-                                     const cv::Rect& LeftEyeApproxArea, cv::Rect& RightEye, cv::Rect& LeftEye) const
+                                     const cv::Rect& LeftEyeApproxArea, cv::Rect& RightEye, cv::Rect& LeftEye,
+                                     int32 WorkerIndex, FFrameAnnotations& Annotations) const
 {	
-	auto RightEyes = GetRightEyesByCascade(Frame, RightEyeApproxArea);
-	auto LeftEyes = GetLeftEyesByCascade(Frame, LeftEyeApproxArea);
+	auto RightEyes = GetRightEyesByCascade(Frame, RightEyeApproxArea, WorkerIndex);
+	auto LeftEyes = GetLeftEyesByCascade(Frame, LeftEyeApproxArea, WorkerIndex);
 
 	for (const auto& CurrentRightEye : RightEyes)
-		DrawPrefilteredEye(Frame, RightEyeApproxArea, CurrentRightEye);
+		AnnotatePrefilteredEye(Annotations, RightEyeApproxArea, CurrentRightEye);
 
 	for (const auto& CurrentLeftEye : LeftEyes)
-		DrawPrefilteredEye(Frame, LeftEyeApproxArea, CurrentLeftEye);
+		AnnotatePrefilteredEye(Annotations, LeftEyeApproxArea, CurrentLeftEye);
 
 	// Remove likely incorrect eyes.
 	FilterEyes(IN OUT LeftEyes, IN OUT RightEyes, Face, RightEyeApproxArea, LeftEyeApproxArea);
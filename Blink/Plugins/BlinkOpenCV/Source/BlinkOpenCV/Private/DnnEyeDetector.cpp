@@ -4,15 +4,18 @@
 
 #include "DnnEyeDetector.h"
 
-FDnnEyeDetector::FDnnEyeDetector(FVideoReader* VideoReader) : FEyeDetector(VideoReader)
+FDnnEyeDetector::FDnnEyeDetector(FVideoReader* VideoReader, const FFeatureDetectorSettings& InSettings)
+	: FEyeDetector(VideoReader, InSettings)
 {
-	ThreadName = TEXT("DnnEyeDetectorThread");
+	SetName(TEXT("DnnEyeDetectorThread"));
 
-	CreateThread();
+	StartThread();
 }
 
-bool FDnnEyeDetector::Init()
+void FDnnEyeDetector::OnStart()
 {
+	// Executed on worker thread.
+
 	FString DnnDirectory = FPaths::Combine(FPaths::ProjectPluginsDir(), TEXT("BlinkOpenCV"), TEXT("Content"), TEXT("DNN"));
     
 	IPlatformFile& FileManager = FPlatformFileManager::Get().GetPlatformFile();
@@ -23,16 +26,17 @@ bool FDnnEyeDetector::Init()
 	checkf(FileManager.FileExists(*FilePath), TEXT("The OpenCV Face model does not exist"));
 
 	FaceDetector = cv::FaceDetectorYN::create(TCHAR_TO_UTF8(*FilePath), "", FaceSize,
-		FaceConfidenceThreshold, NmsThreshold, TopKBoxes, cv::dnn::DNN_BACKEND_CUDA, cv::dnn::DNN_TARGET_CUDA);
+		FaceConfidenceThreshold, NmsThreshold, TopKBoxes, FImageBackend::GetDnnBackend(GetImageBackendType()),
+		FImageBackend::GetDnnTarget(GetImageBackendType()));
 
 	checkf(FaceDetector && FaceDetector.get(), TEXT("The OpenCV Face model failed to load"));
 	
-	return FEyeDetector::Init();
+	FEyeDetector::OnStart();
 }
 
-void FDnnEyeDetector::Exit()
+void FDnnEyeDetector::OnStop()
 {
-	FEyeDetector::Exit();
+	FEyeDetector::OnStop();
 	FaceDetector.reset();
 }
 
@@ -40,10 +44,8 @@ uint32 FDnnEyeDetector::ProcessNextFrame(cv::Mat& Frame, const double& DeltaTime
 {
 	// The DNN model is really really slow. Resizing the frame to a smaller size, dramatically decreases processing times
 	// while retaining accuracy.
-	cv::cuda::GpuMat CMat;
-	CMat.upload(Frame);
-	cv::cuda::resize(CMat, CMat, {320, 180});
-	CMat.download(Frame);
+	// The face detector needs colour input.
+	PrepareFrame(Frame, {320, 180}, 3);
 	
 	FaceDetector->setInputSize({Frame.cols, Frame.rows});
 	
@@ -53,7 +55,7 @@ uint32 FDnnEyeDetector::ProcessNextFrame(cv::Mat& Frame, const double& DeltaTime
 	
 	if (BestFaceIndex >= 0)
 	{
-		DrawFace(Frame, FoundFaces, BestFaceIndex);
+		AnnotateFace(GetFrameAnnotations(), FoundFaces, BestFaceIndex);
 	}
 	
 	return 0;
@@ -92,18 +94,16 @@ int32 FDnnEyeDetector::CalculateBestFace(cv::Mat& FoundFaces)
 	return BiggestFaceIndex;
 }
 
-void FDnnEyeDetector::DrawFace(const cv::Mat& Frame, const cv::Mat& Faces, int32 FaceIndex) const
+void FDnnEyeDetector::AnnotateFace(FFrameAnnotations& Annotations, const cv::Mat& Faces, int32 FaceIndex)
 {	
 	// Face box.
-	cv::rectangle(Frame,
-			GetFaceRect(Faces, FaceIndex),
-			{175, 255, 0}, 2);
+	Annotations.AddRect(GetFaceRect(Faces, FaceIndex), {175, 255, 0}, 2);
 
 	// Right eye (from person pov)
-	cv::circle(Frame, GetRightEye(Faces, FaceIndex), 10, {150, 255, 255}, 1);
+	Annotations.AddCircle(GetRightEye(Faces, FaceIndex), 10, {150, 255, 255}, 1);
 
 	// Left eye (from person pov)
-	cv::circle(Frame, GetLeftEye(Faces, FaceIndex), 10, {150, 255, 255}, 1);
+	Annotations.AddCircle(GetLeftEye(Faces, FaceIndex), 10, {150, 255, 255}, 1);
 }
 
 cv::Rect FDnnEyeDetector::GetFaceRect(const cv::Mat& Faces, int32 FaceIndex)
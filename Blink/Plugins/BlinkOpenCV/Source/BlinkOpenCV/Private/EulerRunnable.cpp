@@ -3,3 +3,347 @@
 // NHE2422 Advanced Computer Games Development Assignment 2.
 
 #include "EulerRunnable.h"
+#include "BlinkOpenCV.h"
+#include "Misc/ScopeLock.h"
+
+FEulerThread::FEulerThread(FString InThreadName, double InTickRate, EThreadPriority InThreadPriority)
+	: ThreadName(MoveTemp(InThreadName))
+	, ThreadTickRate(FMath::Max(InTickRate, 0.0))
+	, ThreadPriority(InThreadPriority)
+	, ThreadAffinityMask(0)
+	, ThreadMode(EEulerThreadMode::DedicatedThread)
+	, bThreadActive(false)
+	, bTickEnabled(true)
+	, bConstructed(false)
+	, bStarted(false)
+	, Thread(nullptr)
+	, NumTickRequests(0)
+	, TickRequestTime(0)
+	, bTickTaskStarted(false)
+	, PreviousTickTaskTime(0)
+	, NumMissedTicks(0)
+{
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+}
+
+bool FEulerThread::Init()
+{
+	// Executed on worker thread.
+	
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' has been initialised"), *ThreadName);
+	OnStart();
+	return true;
+}
+
+uint32 FEulerThread::Run()
+{
+	// Executed on worker thread.
+	
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' is running"), *ThreadName);
+
+	double NextTickTime = FPlatformTime::Seconds();
+	double PreviousTickTime = NextTickTime;
+	
+	while (IsActive())
+	{
+		const double TickRate = GetTickRate();
+		if (!IsTickEnabled())
+		{
+			// Nothing to keep time for, so just check back occasionally.
+			WakeEvent->Wait(FTimespan::FromSeconds(FMath::Max(TickRate, .01)));
+			NextTickTime = FPlatformTime::Seconds();
+			continue;
+		}
+
+		if (TickRate > 0)
+		{
+			// A tick overran by more than a whole tick. Skip the ticks it missed rather than running them back to back,
+			// but stay on the same schedule.
+			if (const double Behind = FPlatformTime::Seconds() - NextTickTime; Behind > TickRate)
+			{
+				const double MissedTicks = FMath::FloorToDouble(Behind / TickRate);
+				NextTickTime += MissedTicks * TickRate;
+				NumMissedTicks.fetch_add(static_cast<uint64>(MissedTicks), std::memory_order_relaxed);
+			}
+			
+			WaitUntil(NextTickTime);
+			if (!IsActive())
+				break;
+		}
+
+		const double TickStartTime = FPlatformTime::Seconds();
+		if (TickRate > 0)
+		{
+			SchedulingDelay.Add(TickStartTime - NextTickTime);
+			
+			// Advance from the deadline rather than from when the tick started, so lateness doesn't add up.
+			NextTickTime += TickRate;
+		}
+		else
+		{
+			NextTickTime = TickStartTime;
+		}
+
+		OnTick(TickStartTime - PreviousTickTime);
+		PreviousTickTime = TickStartTime;
+	}
+
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' has stopped running."), *ThreadName);
+	return 0;
+}
+
+void FEulerThread::Exit()
+{
+	// Executed on worker thread.
+	
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' is exiting."), *ThreadName);
+	if (SchedulingDelay.Count > 0)
+	{
+		UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' scheduling delay: %s, %llu missed ticks."), *ThreadName,
+			*SchedulingDelay.ToString(), GetNumMissedTicks());
+	}
+	
+	OnStop();
+}
+
+void FEulerThread::Stop()
+{
+	// Executed on owning thread.
+	
+	bThreadActive = false;
+	WakeEvent->Trigger();
+}
+
+void FEulerThread::WaitUntil(double Deadline) const
+{
+	// Executed on worker thread.
+
+	// Sleep through most of the wait. The event lets StopThread cut it short.
+	if (const double SleepTime = Deadline - FPlatformTime::Seconds() - SpinWaitSeconds; SleepTime > 0)
+		WakeEvent->Wait(FTimespan::FromSeconds(SleepTime));
+
+	// Then spin for the rest, giving up the rest of the time slice each time so other threads on this core can run.
+	while (IsActive() && FPlatformTime::Seconds() < Deadline)
+		FPlatformProcess::YieldThread();
+}
+
+void FEulerThread::TriggerTick()
+{
+	if (!IsUsingTasks())
+		return;
+
+	FScopeLock Lock(&TickTaskLock);
+	
+	// If a tick task is already queued or running, it ticks again once it's done instead.
+	if (!IsActive() || NumTickRequests.fetch_add(1, std::memory_order_acq_rel) > 0)
+		return;
+
+	TickRequestTime.store(FPlatformTime::Seconds(), std::memory_order_relaxed);
+	TickTask = UE::Tasks::Launch(*ThreadName, [this] { RunTickTask(); }, GetTaskPriority());
+}
+
+void FEulerThread::RunTickTask()
+{
+	// Executed on a task worker thread.
+
+	// Only one tick task runs at a time, so this doesn't need to be synchronised.
+	if (!bTickTaskStarted)
+	{
+		bTickTaskStarted = true;
+		Init();
+		PreviousTickTaskTime = FPlatformTime::Seconds();
+	}
+
+	SchedulingDelay.Add(FPlatformTime::Seconds() - TickRequestTime.load(std::memory_order_relaxed));
+	
+	int32 NumRequests = NumTickRequests.load(std::memory_order_acquire);
+	do
+	{
+		if (IsActive() && IsTickEnabled())
+		{
+			const double TickStartTime = FPlatformTime::Seconds();
+			OnTick(TickStartTime - PreviousTickTaskTime);
+			PreviousTickTaskTime = TickStartTime;
+		}
+
+		// Any requests that arrived while ticking get one more tick between them.
+		NumRequests = NumTickRequests.fetch_sub(NumRequests, std::memory_order_acq_rel) - NumRequests;
+	}
+	while (NumRequests > 0);
+}
+
+UE::Tasks::ETaskPriority FEulerThread::GetTaskPriority() const
+{
+	switch (ThreadPriority)
+	{
+	case TPri_TimeCritical:
+	case TPri_Highest:
+	case TPri_AboveNormal:
+		return UE::Tasks::ETaskPriority::High;
+	case TPri_BelowNormal:
+	case TPri_SlightlyBelowNormal:
+	case TPri_Lowest:
+		return UE::Tasks::ETaskPriority::BackgroundNormal;
+	case TPri_Normal:
+	default:
+		return UE::Tasks::ETaskPriority::Normal;
+	}
+}
+
+void FEulerThread::SetPriority(EThreadPriority InThreadPriority)
+{
+	ThreadPriority = InThreadPriority;
+	if (Thread)
+		Thread->SetThreadPriority(ThreadPriority);
+}
+
+void FEulerThread::SetScheduling(const FThreadSchedulingSettings& InScheduling)
+{
+	SetPriority(InScheduling.Priority);
+	ThreadAffinityMask = InScheduling.GetThreadAffinityMask();
+}
+
+void FEulerThread::SetTickRate(double InTickRate)
+{
+	ThreadTickRate.store(FMath::Max(InTickRate, 0.0), std::memory_order_relaxed);
+}
+
+void FEulerThread::SetTickEnabled(bool bInTickEnabled)
+{
+	bTickEnabled.store(bInTickEnabled, std::memory_order_relaxed);
+	WakeEvent->Trigger();
+}
+
+void FEulerThread::StartThread()
+{
+	// Executed on owning thread.
+	
+	if (bStarted)
+		return;
+	bStarted = true;
+
+	if (!bConstructed)
+	{
+		bConstructed = true;
+		OnConstruction();
+	}
+	
+	OnPreStart();
+
+	// Set before the thread exists, so it is never seen as inactive while starting up.
+	bThreadActive = true;
+
+	// Started by the first tick instead.
+	if (IsUsingTasks())
+	{
+		UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' is running on tasks"), *ThreadName);
+		return;
+	}
+	
+	Thread = FRunnableThread::Create(this, *ThreadName, 0, ThreadPriority,
+		ThreadAffinityMask != 0 ? ThreadAffinityMask : FPlatformAffinity::GetNoAffinityMask());
+	checkf(Thread, TEXT("Could not create Thread '%s'"), *ThreadName);
+}
+
+void FEulerThread::StopThread()
+{
+	// Executed on owning thread.
+	
+	if (!bStarted)
+		return;
+	bStarted = false;
+
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' has been requested to stop."), *ThreadName);
+	UE::Tasks::FTask LastTickTask;
+	{
+		// No tick task can be launched once this is released.
+		FScopeLock Lock(&TickTaskLock);
+		bThreadActive = false;
+		LastTickTask = TickTask;
+		TickTask = UE::Tasks::FTask();
+	}
+	WakeEvent->Trigger();
+	OnPreStop();
+
+	// Cooperative: waits for the current tick to finish instead of killing the thread part way through it.
+	if (Thread)
+	{
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+	else if (LastTickTask.IsValid())
+	{
+		LastTickTask.Wait();
+	}
+
+	// Nothing else will run on a task, so finish up here.
+	if (IsUsingTasks() && bTickTaskStarted)
+	{
+		bTickTaskStarted = false;
+		Exit();
+	}
+
+	// Stopped after this thread so it can't add another one while they're being stopped.
+	TArray<TSharedPtr<FEulerThread>> Children;
+	{
+		FScopeLock Lock(&ChildRunnablesLock);
+		Children = ChildRunnables;
+	}
+	for (const TSharedPtr<FEulerThread>& Child : Children)
+		Child->StopThread();
+
+	OnDestroy();
+}
+
+void FEulerThread::OnConstruction()
+{ }
+
+void FEulerThread::OnPreStart()
+{ }
+
+void FEulerThread::OnStart()
+{ }
+
+void FEulerThread::OnTick(const double& DeltaTime)
+{ }
+
+void FEulerThread::OnPreStop()
+{ }
+
+void FEulerThread::OnStop()
+{ }
+
+void FEulerThread::OnDestroy()
+{ }
+
+void FEulerThread::AddChildThread(const TSharedPtr<FEulerThread>& Runnable)
+{
+	if (!Runnable.IsValid())
+		return;
+	
+	FScopeLock Lock(&ChildRunnablesLock);
+	ChildRunnables.AddUnique(Runnable);
+}
+
+void FEulerThread::RemoveChildThread(const TSharedPtr<FEulerThread>& Runnable)
+{
+	FScopeLock Lock(&ChildRunnablesLock);
+	ChildRunnables.Remove(Runnable);
+}
+
+bool FEulerThread::ContainsChildThread(const TSharedPtr<FEulerThread>& Runnable) const
+{
+	FScopeLock Lock(&ChildRunnablesLock);
+	return ChildRunnables.Contains(Runnable);
+}
+
+FEulerThread::~FEulerThread()
+{
+	// Executed on owning thread.
+	
+	StopThread();
+
+	FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	WakeEvent = nullptr;
+}
@@ -3,12 +3,306 @@
 // NHE2422 Advanced Computer Games Development Assignment 2.
 
 #include "EyeDetector.h"
+#include "BlinkOpenCVStats.h"
 
-FEyeDetector::FEyeDetector(FVideoReader* InVideoReader): FFeatureDetector(InVideoReader)
+FEyeDetector::FEyeDetector(FVideoReader* InVideoReader, const FFeatureDetectorSettings& InSettings)
+	: FFeatureDetector(InVideoReader, InSettings)
+	, EyeEvents(EyeEventQueueSize)
+	, NumDroppedEyeEvents(0)
 {
-	ThreadName = TEXT("EyeDetectorThread");
+	SetName(TEXT("EyeDetectorThread"));
+}
+
+void FEyeDetector::OnPreStop()
+{
+	// Executed on game thread.
+
+	FFeatureDetector::OnPreStop();
+
+	// Stop the stages first; they call into the subclass, and the detector thread may be waiting to push to them.
+	if (StageGraph.IsValid())
+		StageGraph->Stop();
+	if (WorkerPool.IsValid())
+		WorkerPool->Stop();
+}
+
+void FEyeDetector::OnStop()
+{
+	// Executed on worker thread, or game thread when running on tasks.
+
+	// Frames still in flight call into the subclass, so let them finish first.
+	if (LastFilterTask.IsValid())
+	{
+		LastFilterTask.Wait();
+		LastFilterTask = UE::Tasks::FTask();
+	}
+
+	if (const uint64 NumDropped = NumDroppedEyeEvents.load(std::memory_order_relaxed); NumDropped > 0)
+	{
+		UE_LOG(LogBlinkOpenCV, Warning, TEXT("Thread '%s' dropped %llu eye events the game didn't consume in time."),
+			*GetName(), NumDropped);
+	}
+
+	FFeatureDetector::OnStop();
+}
+
+void FEyeDetector::CreateWorkers()
+{
+	// Executed on game thread.
+
+	if (IsUsingTasks())
+	{
+		for (int32 i = 0; i < GetNumWorkers(); i++)
+			FreeWorkerIndices.Add(i);
+		return;
+	}
+
+	if (GetNumWorkers() > 1)
+	{
+		WorkerPool = MakeUnique<TOrderedWorkerPool<FEyeDetectionWork>>(GetName(), GetNumWorkers(),
+			[this](FEyeDetectionWork& Work, int32 WorkerIndex)
+			{
+				Work.WorkerIndex = WorkerIndex;
+				DetectFrame(Work);
+			},
+			[this](FEyeDetectionWork& Work)
+			{
+				// The temporal filter depends on the previous frames, so it has to see them in capture order.
+				FilterAndFinishFrame(Work);
+			});
+		WorkerPool->Start(GetSettings().Scheduling);
+		return;
+	}
+
+	if (!GetSettings().bUseStageGraph)
+		return;
+
+	StageGraph = MakeUnique<TStageGraph<FEyeDetectionWork>>(GetName(), GetSettings().StageQueueCapacity);
+	StageGraph->AddStage(TEXT("Preprocess"), [this](FEyeDetectionWork& Work) { RunPreprocessStage(Work); });
+	StageGraph->AddStage(TEXT("Face"), [this](FEyeDetectionWork& Work) { RunFaceStage(Work); });
+	StageGraph->AddStage(TEXT("Eyes"), [this](FEyeDetectionWork& Work) { RunEyesStage(Work); });
+	StageGraph->AddStage(TEXT("TemporalFilter"), [this](FEyeDetectionWork& Work) { FilterAndFinishFrame(Work); });
+	StageGraph->Start(GetSettings().Scheduling);
+}
+
+uint32 FEyeDetector::ProcessNextFrame(cv::Mat& Frame, const double& DeltaTime)
+{
+	FEyeDetectionWork Work;
+	Work.Frame.Image = Frame;
+	Work.Frame.CaptureTime = GetFrameCaptureTime();
+	Work.DeltaTime = DeltaTime;
+	Work.Annotations = MoveTemp(GetFrameAnnotations());
+
+	DetectFrame(Work);
+	RunTemporalFilterStage(Work);
+
+	// Show the preprocessed frame in the debug window, with everything that was found in it.
+	Frame = Work.Frame.Image;
+	GetFrameAnnotations() = MoveTemp(Work.Annotations);
+	return 0;
+}
+
+void FEyeDetector::DetectFrame(FEyeDetectionWork& Work)
+{
+	RunPreprocessStage(Work);
+	RunFaceStage(Work);
+	RunEyesStage(Work);
+}
+
+void FEyeDetector::FilterAndFinishFrame(FEyeDetectionWork& Work)
+{
+	RunTemporalFilterStage(Work);
+
+	AttachAnnotations(Work.Frame, MoveTemp(Work.Annotations));
+	FinishFrame(Work.Frame);
+}
+
+void FEyeDetector::RunPreprocessStage(FEyeDetectionWork& Work)
+{
+	BLINKOPENCV_SCOPE(Preprocess);
+	RunStage(Work, TEXT("Preprocess"), [this, &Work]() { PreprocessFrame(Work); });
+}
+
+void FEyeDetector::RunFaceStage(FEyeDetectionWork& Work)
+{
+	BLINKOPENCV_SCOPE(Face);
+	RunStage(Work, TEXT("Face"), [this, &Work]() { DetectFace(Work); });
+}
+
+void FEyeDetector::RunEyesStage(FEyeDetectionWork& Work)
+{
+	BLINKOPENCV_SCOPE(Eyes);
+	RunStage(Work, TEXT("Eyes"), [this, &Work]() { DetectEyes(Work); });
+}
+
+void FEyeDetector::RunTemporalFilterStage(FEyeDetectionWork& Work)
+{
+	BLINKOPENCV_SCOPE(TemporalFilter);
+	RunStage(Work, TEXT("TemporalFilter"), [this, &Work]() { FilterEyeStatus(Work); });
+}
+
+bool FEyeDetector::WaitUntilReadyForFrame(double TimeoutSeconds)
+{
+	// Executed on worker thread.
+
+	if (IsUsingTasks())
+	{
+		FScopeLock Lock(&FreeWorkerIndicesLock);
+		return FreeWorkerIndices.Num() > 0;
+	}
+	if (WorkerPool.IsValid() && WorkerPool->IsRunning())
+		return WorkerPool->WaitUntilCanPush(TimeoutSeconds);
+	if (StageGraph.IsValid() && StageGraph->IsRunning())
+		return StageGraph->WaitUntilCanPush(TimeoutSeconds);
+
+	return true;
+}
+
+void FEyeDetector::DispatchFrame(FVideoFrame& Frame, double DeltaTime)
+{
+	// Executed on worker thread.
+
+	if (!WorkerPool.IsValid() && !StageGraph.IsValid() && !IsUsingTasks())
+	{
+		FFeatureDetector::DispatchFrame(Frame, DeltaTime);
+		return;
+	}
+
+	// The temporal filter stage finishes the frame.
+	FEyeDetectionWork Work;
+	Work.Frame = Frame;
+	Work.DeltaTime = DeltaTime;
+	Work.Annotations = FFrameAnnotations(HasFrameSubscribers());
+	if (IsUsingTasks())
+		LaunchFrameTasks(MoveTemp(Work));
+	else if (WorkerPool.IsValid())
+		WorkerPool->Push(MoveTemp(Work));
+	else
+		StageGraph->Push(MoveTemp(Work));
+}
+
+void FEyeDetector::LaunchFrameTasks(FEyeDetectionWork&& Work)
+{
+	// Executed on a task worker thread.
+
+	{
+		// WaitUntilReadyForFrame has already checked that there's a free worker.
+		FScopeLock Lock(&FreeWorkerIndicesLock);
+		Work.WorkerIndex = FreeWorkerIndices.Pop(false);
+	}
+
+	// Detecting consecutive frames can happen at the same time...
+	UE::Tasks::TTask<FEyeDetectionWork> DetectTask = UE::Tasks::Launch(*GetName(),
+		[this, Work = MoveTemp(Work)]() mutable
+		{
+			DetectFrame(Work);
+			return MoveTemp(Work);
+		},
+		GetTaskPriority());
+
+	auto Filter = [this, DetectTask]() mutable
+	{
+		FEyeDetectionWork& DetectedWork = DetectTask.GetResult();
+		FilterAndFinishFrame(DetectedWork);
+
+		const int32 WorkerIndex = DetectedWork.WorkerIndex;
+		DetectedWork = FEyeDetectionWork();
+		{
+			FScopeLock Lock(&FreeWorkerIndicesLock);
+			FreeWorkerIndices.Add(WorkerIndex);
+		}
+
+		// A frame may have arrived while every worker was busy.
+		TriggerTick();
+	};
+
+	// ...but the temporal filter has to see them in capture order, so also waits for the previous frame's.
+	LastFilterTask = LastFilterTask.IsValid()
+		? UE::Tasks::Launch(*GetName(), MoveTemp(Filter), UE::Tasks::Prerequisites(DetectTask, LastFilterTask),
+			GetTaskPriority())
+		: UE::Tasks::Launch(*GetName(), MoveTemp(Filter), UE::Tasks::Prerequisites(DetectTask), GetTaskPriority());
+}
+
+EEyeStatus FEyeDetector::GetEyeStatusFromFrame(const cv::Mat& Frame) const
+{
+	FEyeDetectionWork Work;
+	Work.Frame.Image = Frame;
+
+	DetectFace(Work);
+	DetectEyes(Work);
+	return Work.FrameEyeStatus;
+}
+
+void FEyeDetector::CommitEyeStatus(EEyeStatus Status, double CaptureTime, float Confidence)
+{
+	// Executed on worker thread.
+
+	// Nothing can be said about the eyes, so they are left as they were.
+	if (Status == EEyeStatus::Error || Status == CommittedEyeStatus)
+		return;
+
+	FEyeEvent Event;
+	Event.Status = Status;
+	Event.OnsetTime = CaptureTime;
+	Event.PreviousStatus = CommittedEyeStatus;
+	Event.PreviousDuration = CommittedEyeStatusOnset > 0 ? CaptureTime - CommittedEyeStatusOnset : 0;
+	Event.Confidence = Confidence;
+	Event.CommitTime = FPlatformTime::Seconds();
+
+	CommittedEyeStatus = Status;
+	CommittedEyeStatusOnset = CaptureTime;
+
+	if (!EyeEvents.Enqueue(MoveTemp(Event)))
+	{
+		NumDroppedEyeEvents.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	FScopeLock Lock(&OnEyeEventLock);
+	if (OnEyeEvent)
+		OnEyeEvent();
+}
+
+void FEyeDetector::SetOnEyeEvent(TFunction<void()> InOnEyeEvent)
+{
+	FScopeLock Lock(&OnEyeEventLock);
+	OnEyeEvent = MoveTemp(InOnEyeEvent);
+}
+
+float FEyeDetector::GetEyeStatusConfidence(EEyeStatus Status, float LeftEyeClosedAmount, float RightEyeClosedAmount,
+                                           float ClosedAmountThreshold)
+{
+	if (Status == EEyeStatus::Error)
+		return 0;
+
+	// How far an eye's amount is past the threshold, as a fraction of how far it could possibly be.
+	const auto GetEyeConfidence = [ClosedAmountThreshold](float ClosedAmount, bool bClosed)
+	{
+		const float Margin = bClosed ? ClosedAmount - ClosedAmountThreshold : ClosedAmountThreshold - ClosedAmount;
+		const float MaxMargin = bClosed ? 1.f - ClosedAmountThreshold : ClosedAmountThreshold;
+		return MaxMargin > 0 ? FMath::Clamp(Margin / MaxMargin, 0.f, 1.f) : 1.f;
+	};
+
+	const bool bLeftEyeClosed = Status == EEyeStatus::Blink || Status == EEyeStatus::WinkLeft;
+	const bool bRightEyeClosed = Status == EEyeStatus::Blink || Status == EEyeStatus::WinkRight;
+
+	// The status is only as certain as the least certain eye.
+	return FMath::Min(GetEyeConfidence(LeftEyeClosedAmount, bLeftEyeClosed),
+		GetEyeConfidence(RightEyeClosedAmount, bRightEyeClosed));
+}
+
+EEyeStatus FEyeDetector::GetEyeStatusFromEyes(const cv::Rect& Face, const cv::Rect& LeftEye, const cv::Rect& RightEye)
+{
+	if (Face.empty())
+		return EEyeStatus::Error;
 	
-	LastBlinkTime = MakeShared<double>();
-	LastLeftWinkTime = MakeShared<double>();
-	LastRightWinkTime = MakeShared<double>();
+	// Treat no eyes found as a blink.
+	if (LeftEye.empty() && RightEye.empty())
+		return EEyeStatus::Blink;
+	if (LeftEye.empty())
+		return EEyeStatus::WinkLeft;
+	if (RightEye.empty())
+		return EEyeStatus::WinkRight;
+
+	return EEyeStatus::BothOpen;
 }
@@ -4,130 +4,274 @@
 
 #include "FeatureDetector.h"
 #include "BlinkOpenCV.h"
+#include "BlinkOpenCVStats.h"
 #include "VideoReader.h"
 
-void FFeatureDetector::CreateThread()
-{
-	Thread = FRunnableThread::Create(this, ThreadName, 0, TPri_AboveNormal);
-	checkf(Thread, TEXT("Could not create Thread '%s'"), ThreadName);
-}
-
-FFeatureDetector::FFeatureDetector(FVideoReader* InVideoReader)
+FFeatureDetector::FFeatureDetector(FVideoReader* InVideoReader, const FFeatureDetectorSettings& InSettings)
+	: FEulerThread(TEXT("UnnamedFeatureDetectorThread"), 0, TPri_AboveNormal)
 {
 	// Executed on game thread.
 
 	checkf(InVideoReader, TEXT("FeatureDetector is missing a valid VideoReader"));
 	VideoReader = InVideoReader;
-	CurrentFrame = MakeShared<cv::Mat>();
+	Settings = InSettings;
+	FrameMailbox = VideoReader->CreateFrameMailbox();
+
+	// Picked once, so every frame is processed the same way.
+	ImageBackendType = FImageBackend::Resolve(Settings.ImageBackend);
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("FeatureDetector: Using the %s image backend (requested %s)"),
+		FImageBackend::GetName(ImageBackendType), FImageBackend::GetName(Settings.ImageBackend));
+
+	for (int32 i = 0; i < FMath::Max(Settings.NumWorkers, 1); i++)
+	{
+		TUniquePtr<FWorkerBuffers>& Buffers = WorkerBuffers.Add_GetRef(MakeUnique<FWorkerBuffers>());
+		Buffers->ImageBackend = FImageBackend::Create(ImageBackendType);
+	}
+
+	// Waiting for frames paces the thread by itself. Otherwise, poll for them at the refresh rate.
+	SetTickRate(Settings.bWaitForFrames ? 0 : RefreshRate);
+	SetScheduling(Settings.Scheduling);
+
+	if (Settings.bUseTasks)
+	{
+		SetThreadMode(EEulerThreadMode::Tasks);
+		
+		// Ignored until the detector is started.
+		FrameMailbox->SetOnPublished([this]() { TriggerTick(); });
+	}
 }
 
-bool FFeatureDetector::Init()
+void FFeatureDetector::OnPreStart()
 {
-	// Executed on game thread.
-	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' has been initialised"), ThreadName);
-	return true;
+	// Executed on owning thread.
+
+	// Only count this run's frames if the thread is restarted.
+	FrameStats.Reset();
 }
 
-uint32 FFeatureDetector::Run()
+void FFeatureDetector::OnTick(const double& DeltaTime)
 {
 	// Executed on worker thread.
-	
-	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' is running"), ThreadName);
-	
-	bActive = true;
-	
-	while (IsActive())
+
+	// Don't take a frame that would then have to wait to be processed. Tasks must not block, and tick again once the
+	// detector is ready instead.
+	const double ReadyTimeout = IsUsingTasks() ? 0 : (Settings.FrameWaitTimeout >= 0 ? Settings.FrameWaitTimeout : .1);
+	if (!WaitUntilReadyForFrame(ReadyTimeout))
+		return;
+
+	// Sleep until the VideoReader publishes a frame we haven't seen, rather than for a fixed amount of time.
+	bool bWaitedForFrame = false;
+	if (Settings.bWaitForFrames && !IsUsingTasks())
 	{
-		const double DeltaTime = UpdateAndGetDeltaTime();
-		#if UE_BUILD_DEVELOPMENT || UE_EDITOR
-		UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' is ticking."), ThreadName);
-		#endif
+		bWaitedForFrame = !FrameMailbox->HasNewFrame(LastFrameSequenceNumber);
+		FrameMailbox->WaitForNewFrame(LastFrameSequenceNumber, Settings.FrameWaitTimeout);
+	}
+
+	if (FVideoFrame NextFrame; IsActive() && GetNextFrame(OUT NextFrame))
+	{
+		// How long it took to wake up once the frame was published.
+		if (bWaitedForFrame)
+			AddSchedulingDelay(FPlatformTime::Seconds() - NextFrame.PublishTime);
+		
 
-		if (auto NextFrame = GetNextFrame(); !NextFrame.empty())
+		CaptureToDetectionLatency.Add(FPlatformTime::Seconds() - NextFrame.CaptureTime);
+		FrameCaptureTime = NextFrame.CaptureTime;
+		FrameStreamPosition = NextFrame.StreamPosition;
+		
+		// Only measured between processed frames, so skipped ticks don't shrink the delta time.
+		// Replays run faster than real-time, so use the stream's clock there to get the same results at any speed.
+		double FrameDeltaTime;
+		if (VideoReader->IsReplaying() && NextFrame.StreamPosition >= 0)
+		{
+			FrameDeltaTime = PreviousStreamPosition >= 0 ? NextFrame.StreamPosition - PreviousStreamPosition : 0;
+			PreviousStreamPosition = NextFrame.StreamPosition;
+		}
+		else
 		{
-			#if UE_BUILD_DEVELOPMENT || UE_EDITOR
-			const double CurrentTime = FPlatformTime::Seconds();
-			UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' is processing a frame."), ThreadName);
-			#endif
-			
-			ProcessNextFrame(NextFrame, DeltaTime);
-
-			#if UE_BUILD_DEVELOPMENT || UE_EDITOR
-			const double SecondsTook = FPlatformTime::Seconds() - CurrentTime;
-			UE_LOG(LogBlinkOpenCV, Display,
-				TEXT("Thread '%s' processed a frame (%fms)."), ThreadName, SecondsTook * 1000.f);
-			#endif
-
-			CurrentFrame = MakeShared<cv::Mat>(NextFrame.clone());
+			FrameDeltaTime = UpdateAndGetDeltaTime();
 		}
 
-		// Sleep until next refresh. Ensure minimum sleep time so it doesn't waste the OS resources.
-		const float SleepTime = FMath::Max(.01f, RefreshRate - (FPlatformTime::Seconds() - PreviousTime));
-		FPlatformProcess::Sleep(SleepTime);
+		DispatchFrame(NextFrame, FrameDeltaTime);
 	}
+}
 
-	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' has stopped running."), ThreadName);
+void FFeatureDetector::DispatchFrame(FVideoFrame& Frame, double DeltaTime)
+{
+	// Executed on worker thread.
 
-	return 0;
+	{
+		BLINKOPENCV_SCOPE(Detect);
+
+		FrameAnnotations = FFrameAnnotations(HasFrameSubscribers());
+		ProcessNextFrame(Frame.Image, DeltaTime);
+		AttachAnnotations(Frame, MoveTemp(FrameAnnotations));
+	}
+
+	FinishFrame(Frame);
+}
+
+void FFeatureDetector::FinishFrame(const FVideoFrame& Frame)
+{
+	// Executed on worker thread, or the detector's last stage thread.
+
+	const double CaptureToProcessedTime = FPlatformTime::Seconds() - Frame.CaptureTime;
+	CaptureToProcessedLatency.Add(CaptureToProcessedTime);
+
+	FFrameStageStats::Increment(FrameStats.NumProcessed);
+	INC_DWORD_STAT(STAT_BlinkOpenCV_FramesProcessed);
+	if (Settings.FrameDeadline > 0 && CaptureToProcessedTime > Settings.FrameDeadline)
+		FFrameStageStats::Increment(FrameStats.NumOverBudget);
+
+	// No copy is needed: the frame is either the detector's own buffer, which it won't touch again, or still the
+	// VideoReader's read-only frame. Holding onto it would keep its buffer out of the pool for nothing though.
+	if (HasFrameSubscribers())
+		RenderMailbox.Publish(Frame);
 }
 
-void FFeatureDetector::Exit()
+void FFeatureDetector::OnStop()
 {
 	// Executed on worker thread.
 	
-	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' is exiting."), ThreadName);
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' capture-to-detection latency (%s): %s."), *GetName(),
+		Settings.bWaitForFrames ? TEXT("woken by frames") : TEXT("polling"), *CaptureToDetectionLatency.ToString());
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' capture-to-processed latency: %s."), *GetName(),
+		*CaptureToProcessedLatency.ToString());
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' frames: %s."), *GetName(), *FrameStats.ToString());
 }
 
-void FFeatureDetector::Stop()
+void FFeatureDetector::OnPreStop()
 {
 	// Executed on game thread.
 	
-	UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' has been requested to stop."), ThreadName);
-	bActive = false;
+	// Don't make the thread wait for the next frame (or timeout) before it notices.
+	FrameMailbox->Wake();
+
+	// The VideoReader may outlive this.
+	FrameMailbox->SetOnPublished(nullptr);
 }
 
 void FFeatureDetector::Render()
 {
+	// Executed on game thread.
+
+	BLINKOPENCV_SCOPE(Render);
+
+	SubscribeWindow();
 	if (IsActive())
 	{
-		const auto Frame = GetCurrentFrame();
-		if (Frame.IsValid() && Frame->data != nullptr && Frame->rows > 0)
-			cv::imshow(TCHAR_TO_UTF8(ThreadName), *Frame);
+		// Keep showing the last frame if a new one hasn't been processed yet.
+		if (RenderMailbox.Consume(OUT RenderFrame, RenderFrame.SequenceNumber) && RenderFrame.IsValid())
+		{
+			bRenderFrameAnnotated = RenderFrame.Annotations.IsValid() && !RenderFrame.Annotations->IsEmpty();
+			if (bRenderFrameAnnotated)
+			{
+				// Draw onto a copy, in colour so the annotations can be told apart. The frame's pixels may still be
+				// shared with the VideoReader or the detector's pool.
+				if (RenderFrame.Image.channels() == 3)
+					RenderFrame.Image.copyTo(OUT AnnotatedRenderImage);
+				else
+					cv::cvtColor(RenderFrame.Image, OUT AnnotatedRenderImage, cv::COLOR_GRAY2BGR);
+				RenderFrame.Annotations->Draw(AnnotatedRenderImage);
+			}
+		}
+
+		if (RenderFrame.IsValid())
+			cv::imshow(TCHAR_TO_UTF8(*GetName()), bRenderFrameAnnotated ? AnnotatedRenderImage : RenderFrame.Image);
 	}
 }
 
 void FFeatureDetector::StopRendering()
 {
-	cv::destroyWindow(TCHAR_TO_UTF8(ThreadName));
+	// Executed on game thread.
+
+	UnsubscribeWindow();
+	cv::destroyWindow(TCHAR_TO_UTF8(*GetName()));
+}
+
+void FFeatureDetector::AttachAnnotations(FVideoFrame& Frame, FFrameAnnotations&& Annotations)
+{
+	if (Annotations.IsEnabled())
+		Frame.Annotations = MakeShared<const FFrameAnnotations>(MoveTemp(Annotations));
 }
 
 FFeatureDetector::~FFeatureDetector()
 {
-	Kill();
-	CurrentFrame.Reset();
+	StopThread();
 }
 
-void FFeatureDetector::Kill()
+bool FFeatureDetector::GetNextFrame(FVideoFrame& OutFrame)
 {
-	// Executed on game thread.
+	// Executed on worker thread.
 	
-	if (Thread)
+	// No pixels are copied; the frame is shared with the VideoReader and any other consumers.
+	if (!FrameMailbox->Consume(OUT OutFrame, LastFrameSequenceNumber))
+		return false;
+
+	// The frame is already too late to be useful, and there's a fresher one waiting that might not be. Replays are
+	// lossless: the VideoReader only reads the next frame once this one is taken, so it is always waiting by the time
+	// a slow detector gets here, and every frame must be processed regardless.
+	while (Settings.FrameDeadline > 0 && !VideoReader->IsReplaying()
+		&& FPlatformTime::Seconds() - OutFrame.CaptureTime > Settings.FrameDeadline
+		&& FrameMailbox->HasNewFrame(OutFrame.SequenceNumber))
 	{
-		Thread->Kill();
-		delete Thread;
-		Thread = nullptr;
+		FVideoFrame NewerFrame;
+		if (!FrameMailbox->Consume(OUT NewerFrame, OutFrame.SequenceNumber))
+			break;
+
+		FFrameStageStats::Increment(FrameStats.NumExpired);
+		INC_DWORD_STAT(STAT_BlinkOpenCV_FramesDropped);
+		CountSupersededFrames(OutFrame.SequenceNumber);
+		OutFrame = MoveTemp(NewerFrame);
 	}
+
+	CountSupersededFrames(OutFrame.SequenceNumber);
+	return true;
 }
 
-cv::Mat FFeatureDetector::GetNextFrame() const
+void FFeatureDetector::CountSupersededFrames(uint64 SequenceNumber)
 {
 	// Executed on worker thread.
-	
-	// Create a copy of the frame if it exists.
-	if (const TSharedPtr<cv::Mat> Frame = VideoReader->GetFrame(); Frame.IsValid())
-		return Frame->clone();
-	
-	return cv::Mat();
+
+	// Any frames between the last one taken and this one were overwritten in the mailbox before they could be taken.
+	// Nothing is known about the frames before the first one.
+	if (LastFrameSequenceNumber > 0 && SequenceNumber > LastFrameSequenceNumber + 1)
+	{
+		const uint64 NumSuperseded = SequenceNumber - LastFrameSequenceNumber - 1;
+		FFrameStageStats::Increment(FrameStats.NumSuperseded, NumSuperseded);
+		INC_DWORD_STAT_BY(STAT_BlinkOpenCV_FramesDropped, NumSuperseded);
+	}
+
+	LastFrameSequenceNumber = SequenceNumber;
+}
+
+void FFeatureDetector::PrepareFrame(cv::Mat& Frame, const cv::Size& Size, int32 Channels, int32 WorkerIndex)
+{
+	// Executed on worker thread.
+
+	FWorkerBuffers& Buffers = *WorkerBuffers[WorkerIndex];
+
+	const bool bResize = Frame.size() != Size;
+	const bool bConvert = Frame.channels() != Channels;
+	const int32 ConversionCode = Channels == 1 ? cv::COLOR_BGR2GRAY : cv::COLOR_GRAY2BGR;
+
+	// Detectors only read the frame (overlays are recorded as annotations), so there's no need to copy it.
+	if (!bResize && !bConvert)
+		return;
+
+	// The frame's pixels are shared with the VideoReader, so write into a pooled buffer instead of over them.
+	cv::Mat PreparedFrame = Buffers.FramePool.Acquire(Size, CV_MAKETYPE(Frame.depth(), Channels));
+
+	if (!bResize)
+	{
+		// The capture pipeline has already done the expensive part, so a GPU round trip would cost more than it saves.
+		cv::cvtColor(Frame, OUT PreparedFrame, ConversionCode);
+	}
+	else
+	{
+		Buffers.ImageBackend->Resize(Frame, Size, Channels, OUT PreparedFrame);
+	}
+
+	Frame = PreparedFrame;
 }
 
 uint32 FFeatureDetector::ProcessNextFrame(cv::Mat& Frame, const double& DeltaTime)
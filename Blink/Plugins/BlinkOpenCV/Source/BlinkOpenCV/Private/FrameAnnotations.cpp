@@ -0,0 +1,85 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#include "FrameAnnotations.h"
+#include "PreOpenCVHeaders.h"
+#include <opencv2/imgproc.hpp>
+#include "PostOpenCVHeaders.h"
+
+void FFrameAnnotations::AddRect(const cv::Rect& Rect, const cv::Scalar& Colour, int32 Thickness)
+{
+	if (!bEnabled)
+		return;
+
+	FShape& Shape = Shapes.AddDefaulted_GetRef();
+	Shape.Type = EShapeType::Rect;
+	Shape.Rect = Rect;
+	Shape.Colour = Colour;
+	Shape.Thickness = Thickness;
+}
+
+void FFrameAnnotations::AddCircle(const cv::Point& Centre, int32 Radius, const cv::Scalar& Colour, int32 Thickness)
+{
+	if (!bEnabled)
+		return;
+
+	FShape& Shape = Shapes.AddDefaulted_GetRef();
+	Shape.Type = EShapeType::Circle;
+	Shape.Point = Centre;
+	Shape.Radius = Radius;
+	Shape.Colour = Colour;
+	Shape.Thickness = Thickness;
+}
+
+void FFrameAnnotations::AddLabel(const cv::Point& Origin, const FString& Text, const cv::Scalar& Colour)
+{
+	if (!bEnabled)
+		return;
+
+	FShape& Shape = Shapes.AddDefaulted_GetRef();
+	Shape.Type = EShapeType::Label;
+	Shape.Point = Origin;
+	Shape.Colour = Colour;
+	Shape.Text = Text;
+}
+
+void FFrameAnnotations::AddStageTime(const TCHAR* StageName, double Seconds)
+{
+	if (!bEnabled)
+		return;
+
+	StageTimes.Emplace(StageName, Seconds);
+}
+
+void FFrameAnnotations::Draw(cv::Mat& Image) const
+{
+	// Executed on game thread.
+
+	for (const FShape& Shape : Shapes)
+	{
+		switch (Shape.Type)
+		{
+		case EShapeType::Rect:
+			cv::rectangle(Image, Shape.Rect, Shape.Colour, Shape.Thickness);
+			break;
+		case EShapeType::Circle:
+			cv::circle(Image, Shape.Point, Shape.Radius, Shape.Colour, Shape.Thickness);
+			break;
+		case EShapeType::Label:
+			cv::putText(Image, TCHAR_TO_UTF8(*Shape.Text), Shape.Point, cv::FONT_HERSHEY_SIMPLEX, .6,
+				Shape.Colour, 1);
+			break;
+		}
+	}
+
+	// Listed upwards from the bottom-left corner, so the first stage ends up at the top.
+	constexpr int32 LineHeight = 18;
+	int32 LineY = Image.rows - 8 - (StageTimes.Num() - 1) * LineHeight;
+	for (const TPair<const TCHAR*, double>& StageTime : StageTimes)
+	{
+		const FString Line = FString::Printf(TEXT("%s: %.2fms"), StageTime.Key, StageTime.Value * 1000.0);
+		cv::putText(Image, TCHAR_TO_UTF8(*Line), {8, LineY}, cv::FONT_HERSHEY_SIMPLEX, .5, {255, 255, 255}, 1);
+		LineY += LineHeight;
+	}
+}
@@ -0,0 +1,105 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#include "FrameMailbox.h"
+#include "Misc/ScopeLock.h"
+
+FFrameMailbox::FFrameMailbox()
+	: SharedSlotState(1)
+	, ProducerSlotIndex(0)
+	, ConsumerSlotIndex(2)
+	, LatestSequenceNumber(0)
+	, ConsumedSequenceNumber(0)
+{
+	NewFrameEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	ConsumedEvent = FPlatformProcess::GetSynchEventFromPool(false);
+}
+
+FFrameMailbox::~FFrameMailbox()
+{
+	FPlatformProcess::ReturnSynchEventToPool(NewFrameEvent);
+	NewFrameEvent = nullptr;
+	FPlatformProcess::ReturnSynchEventToPool(ConsumedEvent);
+	ConsumedEvent = nullptr;
+}
+
+void FFrameMailbox::Publish(const FVideoFrame& Frame)
+{
+	// Executed on producer thread.
+
+	// Only the header is copied; the previous frame in this slot is released if nobody else references it.
+	Slots[ProducerSlotIndex] = Frame;
+
+	// Hand the written slot to the middle and take back whichever slot was there.
+	const uint8 PreviousState = SharedSlotState.exchange(ProducerSlotIndex | NewFrameFlag, std::memory_order_acq_rel);
+	ProducerSlotIndex = PreviousState & SlotIndexMask;
+
+	LatestSequenceNumber.store(Frame.SequenceNumber, std::memory_order_release);
+	NewFrameEvent->Trigger();
+
+	FScopeLock Lock(&OnPublishedLock);
+	if (OnPublished)
+		OnPublished();
+}
+
+bool FFrameMailbox::Consume(FVideoFrame& OutFrame, uint64 LastSeenSequenceNumber)
+{
+	// Executed on consumer thread.
+
+	// Nothing new has been written since the last swap.
+	if ((SharedSlotState.load(std::memory_order_acquire) & NewFrameFlag) == 0)
+		return false;
+
+	const uint8 PreviousState = SharedSlotState.exchange(ConsumerSlotIndex, std::memory_order_acq_rel);
+	ConsumerSlotIndex = PreviousState & SlotIndexMask;
+
+	const FVideoFrame& Frame = Slots[ConsumerSlotIndex];
+	if (Frame.SequenceNumber <= LastSeenSequenceNumber || Frame.Image.empty())
+		return false;
+
+	OutFrame = Frame;
+
+	ConsumedSequenceNumber.store(Frame.SequenceNumber, std::memory_order_release);
+	ConsumedEvent->Trigger();
+	
+	return true;
+}
+
+bool FFrameMailbox::WaitForNewFrame(uint64 LastSeenSequenceNumber, double TimeoutSeconds)
+{
+	// Executed on consumer thread.
+
+	if (HasNewFrame(LastSeenSequenceNumber))
+		return true;
+
+	// The event stays triggered if a frame is published between the check above and the wait, so it can't be missed.
+	const uint32 WaitTimeMs = TimeoutSeconds < 0 ? MAX_uint32 : FMath::CeilToInt(TimeoutSeconds * 1000.0);
+	NewFrameEvent->Wait(WaitTimeMs);
+	
+	return HasNewFrame(LastSeenSequenceNumber);
+}
+
+bool FFrameMailbox::WaitUntilConsumed(uint64 SequenceNumber, double TimeoutSeconds)
+{
+	// Executed on producer thread.
+
+	if (GetConsumedSequenceNumber() >= SequenceNumber)
+		return true;
+
+	const uint32 WaitTimeMs = TimeoutSeconds < 0 ? MAX_uint32 : FMath::CeilToInt(TimeoutSeconds * 1000.0);
+	ConsumedEvent->Wait(WaitTimeMs);
+
+	return GetConsumedSequenceNumber() >= SequenceNumber;
+}
+
+void FFrameMailbox::Wake()
+{
+	NewFrameEvent->Trigger();
+}
+
+void FFrameMailbox::SetOnPublished(TFunction<void()> InOnPublished)
+{
+	FScopeLock Lock(&OnPublishedLock);
+	OnPublished = MoveTemp(InOnPublished);
+}
@@ -0,0 +1,160 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#include "FramePool.h"
+#include "BlinkOpenCV.h"
+
+FFramePool::FFramePool(int32 InCapacity, int32 InMaxCapacity)
+	: Capacity(InCapacity)
+	, MaxCapacity(FMath::Max(InCapacity, InMaxCapacity))
+	, FormatSize()
+	, FormatType(-1)
+	, BufferSize(0)
+	, NumBuffers(0)
+	, NumFallbackAllocations(0)
+{ }
+
+FFramePool::~FFramePool()
+{
+	while (FBuffer* Buffer = FreeBuffers.Pop())
+		DestroyBuffer(Buffer);
+
+	// Any buffer still in use would be returned to a destroyed pool.
+	ensureMsgf(GetNumBuffers() == 0, TEXT("FramePool: Destroyed while %d buffers are still in use"), GetNumBuffers());
+}
+
+cv::Mat FFramePool::Acquire(const cv::Size& Size, int32 Type)
+{
+	if (Size != FormatSize || Type != FormatType)
+		SetFormat(Size, Type);
+
+	// Mat::create asks the Mat's allocator for the buffer, which is this pool.
+	cv::Mat Mat;
+	Mat.allocator = this;
+	Mat.create(Size, Type);
+	return Mat;
+}
+
+cv::UMatData* FFramePool::allocate(int Dims, const int* Sizes, int Type, void* Data, size_t* Step,
+                                   cv::AccessFlag Flags, cv::UMatUsageFlags UsageFlags) const
+{
+	// Same step calculation as OpenCV's default allocator.
+	size_t Total = CV_ELEM_SIZE(Type);
+	for (int32 i = Dims - 1; i >= 0; i--)
+	{
+		if (Step)
+		{
+			if (Data && Step[i] != CV_AUTOSTEP)
+			{
+				CV_Assert(Total <= Step[i]);
+				Total = Step[i];
+			}
+			else
+			{
+				Step[i] = Total;
+			}
+		}
+		Total *= Sizes[i];
+	}
+
+	// User-provided memory isn't ours to manage.
+	if (Data)
+		return cv::Mat::getStdAllocator()->allocate(Dims, Sizes, Type, Data, Step, Flags, UsageFlags);
+
+	FBuffer* Buffer = nullptr;
+	if (Total == BufferSize.load(std::memory_order_acquire))
+	{
+		// Buffers of a previous format can still be in the free list if they were returned during a reformat.
+		while ((Buffer = FreeBuffers.Pop()) != nullptr && Buffer->Size != Total)
+			DestroyBuffer(Buffer);
+
+		if (!Buffer && GetNumBuffers() < MaxCapacity)
+			Buffer = CreateBuffer(Total);
+	}
+
+	if (!Buffer)
+	{
+		NumFallbackAllocations.fetch_add(1, std::memory_order_relaxed);
+		return cv::Mat::getStdAllocator()->allocate(Dims, Sizes, Type, Data, Step, Flags, UsageFlags);
+	}
+
+	// Reset the buffer's header so it looks freshly allocated to OpenCV.
+	Buffer->MatData->~UMatData();
+	new (Buffer->MatData) cv::UMatData(this);
+	Buffer->MatData->data = Buffer->MatData->origdata = Buffer->Data;
+	Buffer->MatData->size = Buffer->Size;
+	Buffer->MatData->userdata = Buffer;
+
+	return Buffer->MatData;
+}
+
+bool FFramePool::allocate(cv::UMatData* Data, cv::AccessFlag AccessFlags, cv::UMatUsageFlags UsageFlags) const
+{
+	return Data != nullptr;
+}
+
+void FFramePool::deallocate(cv::UMatData* Data) const
+{
+	// Executed on whichever thread released the last reference.
+
+	if (!Data)
+		return;
+
+	CV_Assert(Data->urefcount == 0 && Data->refcount == 0);
+
+	FBuffer* Buffer = static_cast<FBuffer*>(Data->userdata);
+	check(Buffer && Buffer->MatData == Data);
+
+	// The pool has been reformatted since this buffer was handed out.
+	if (Buffer->Size != BufferSize.load(std::memory_order_acquire))
+	{
+		DestroyBuffer(Buffer);
+		return;
+	}
+
+	FreeBuffers.Push(Buffer);
+}
+
+FFramePool::FBuffer* FFramePool::CreateBuffer(size_t Size) const
+{
+	FBuffer* Buffer = new FBuffer();
+	Buffer->Data = static_cast<uchar*>(cv::fastMalloc(Size));
+	Buffer->Size = Size;
+	Buffer->MatData = new cv::UMatData(this);
+	NumBuffers.fetch_add(1, std::memory_order_relaxed);
+	return Buffer;
+}
+
+void FFramePool::DestroyBuffer(FBuffer* Buffer) const
+{
+	delete Buffer->MatData;
+	cv::fastFree(Buffer->Data);
+	delete Buffer;
+	NumBuffers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void FFramePool::SetFormat(const cv::Size& Size, int32 Type)
+{
+	// Executed on acquiring thread.
+
+	FormatSize = Size;
+	FormatType = Type;
+	const size_t NewBufferSize = (size_t)Size.width * Size.height * CV_ELEM_SIZE(Type);
+	BufferSize.store(NewBufferSize, std::memory_order_release);
+
+	// Free any unused buffers of the old format. Buffers still in use are freed when they're returned.
+	while (FBuffer* Buffer = FreeBuffers.Pop())
+		DestroyBuffer(Buffer);
+
+	// The format isn't known yet (i.e. the stream hasn't reported its resolution).
+	if (NewBufferSize == 0)
+		return;
+
+	// Allocate everything up-front so the stream doesn't have to.
+	for (int32 i = GetNumBuffers(); i < Capacity; i++)
+		FreeBuffers.Push(CreateBuffer(NewBufferSize));
+
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("FramePool: Formatted for %dx%d (type %d), %d buffers"),
+		Size.width, Size.height, Type, GetNumBuffers());
+}
@@ -0,0 +1,530 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#include "HaarCascadeEvaluator.h"
+#include "PreOpenCVHeaders.h"
+#include <opencv2/core/simd_intrinsics.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/objdetect.hpp>
+#include "PostOpenCVHeaders.h"
+#include "HaarCascadeEye.gen.h"
+#include "HaarCascadeFrontalFaceDefault.gen.h"
+
+namespace
+{
+#if CV_SIMD && CV_SIMD_64F
+	// Windows tested at once, one per lane.
+	constexpr int32 NumLanes = cv::v_float32::nlanes;
+#else
+	constexpr int32 NumLanes = 1;
+#endif
+
+	// cv::CascadeClassifier lowers every stage's threshold by this when it loads a cascade.
+	constexpr float StageThresholdEpsilon = 1e-5f;
+
+	// How similar candidates must be for cv::groupRectangles to group them, as used by cv::CascadeClassifier.
+	constexpr double GroupEpsilon = .2;
+}
+
+/**
+ * @brief Evaluates the cascade in the given generated tables. Its size, stages and features are all known at compile
+ * time, so only the offsets of the features into the integral images, which depend on their step, are worked out at
+ * run time.
+ */
+template <typename FCascade>
+class THaarCascadeEvaluator final : public FHaarCascadeEvaluator
+{
+public:
+	virtual const TCHAR* GetName() const override { return FCascade::Name; }
+	virtual cv::Size GetWindowSize() const override { return {FCascade::WindowWidth, FCascade::WindowHeight}; }
+
+protected:
+	virtual void DetectInLevel(const cv::Mat& Sum, const cv::Mat& SqSum, float Scale, int32 Step, int32 EndY,
+	                           const cv::Point& Offset, std::vector<cv::Rect>& Objects) override
+	{
+		// Executed on worker thread.
+
+		check(Sum.step == SqSum.step);
+		UpdateOffsets(static_cast<int32>(Sum.step / sizeof(int32)));
+
+		if (Step == 1)
+			ScanLevel<1>(Sum, SqSum, Scale, EndY, Offset, Objects);
+		else
+			ScanLevel<2>(Sum, SqSum, Scale, EndY, Offset, Objects);
+	}
+
+private:
+	// The corners of each rect of a feature, as offsets from the top-left corner of the window in the integral image.
+	struct FFeatureOffsets
+	{
+		int32 Corners[3][4];
+	};
+
+	template <int32 Step>
+	void ScanLevel(const cv::Mat& Sum, const cv::Mat& SqSum, float Scale, int32 EndY, const cv::Point& Offset,
+	               std::vector<cv::Rect>& Objects);
+
+	void UpdateOffsets(int32 Stride);
+
+	/**
+	 * @brief Works out how much the window's pixels vary, which every feature is divided by so the cascade doesn't
+	 * depend on the lighting, the same way cv::CascadeClassifier does.
+	 * @return Whether the window varies enough to be tested at all.
+	 */
+	bool GetVarianceNormFactor(const int32* SumWindow, const int32* SqSumWindow, float& OutFactor) const;
+
+	/**
+	 * @brief Adds up the stumps of a stage for NumLanes windows Step apart.
+	 * @param VarianceNormFactors One per window.
+	 * @param OutSums One per window.
+	 */
+	template <int32 Step>
+	void EvaluateStage(const FHaarStage& Stage, const int32* SumWindow, const float* VarianceNormFactors,
+	                   double* OutSums) const;
+
+	static const FHaarStage& GetStage(int32 StageIndex) { return FCascade::Stages[StageIndex]; }
+
+	FFeatureOffsets FeatureOffsets[FCascade::NumFeatures];
+	int32 NormCorners[4];
+	int32 OffsetsStride = -1;
+};
+
+template <typename FCascade>
+template <int32 Step>
+void THaarCascadeEvaluator<FCascade>::ScanLevel(const cv::Mat& Sum, const cv::Mat& SqSum, float Scale, int32 EndY,
+                                                const cv::Point& Offset, std::vector<cv::Rect>& Objects)
+{
+	const cv::Size WorkingSize(FMath::Max(Sum.cols - FCascade::WindowWidth, 0), EndY);
+	const cv::Size ObjectSize(cvRound(FCascade::WindowWidth * Scale), cvRound(FCascade::WindowHeight * Scale));
+
+	alignas(64) float VarianceNormFactors[NumLanes];
+	alignas(64) double Sums[NumLanes];
+	bool bWindowsAlive[NumLanes];
+
+	for (int32 Y = 0; Y < WorkingSize.height; Y += Step)
+	{
+		const int32* SumRow = Sum.ptr<int32>(Y);
+		const int32* SqSumRow = SqSum.ptr<int32>(Y);
+
+		// cv::CascadeClassifier skips the next window whenever one fails the first stage, since neighbouring windows
+		// usually fail together. Carried between blocks so exactly the same windows are tested.
+		bool bSkipNextWindow = false;
+
+		for (int32 X = 0; X < WorkingSize.width; X += Step * NumLanes)
+		{
+			bool bVariesEnough[NumLanes];
+			for (int32 i = 0; i < NumLanes; i++)
+			{
+				const int32 WindowX = X + i * Step;
+				bVariesEnough[i] = WindowX < WorkingSize.width
+					&& GetVarianceNormFactor(SumRow + WindowX, SqSumRow + WindowX, OUT VarianceNormFactors[i]);
+				if (!bVariesEnough[i])
+					VarianceNormFactors[i] = 1.f;
+			}
+
+			// Every window in the block is tested against the first stage, then which of them would have been skipped
+			// is worked out in order.
+			EvaluateStage<Step>(GetStage(0), SumRow + X, VarianceNormFactors, OUT Sums);
+			const float FirstThreshold = GetStage(0).Threshold - StageThresholdEpsilon;
+
+			bool bAnyAlive = false;
+			for (int32 i = 0; i < NumLanes; i++)
+				bWindowsAlive[i] = false;
+
+			for (int32 i = 0; i < NumLanes && X + i * Step < WorkingSize.width; i++)
+			{
+				if (bSkipNextWindow)
+				{
+					bSkipNextWindow = false;
+				}
+				else if (bVariesEnough[i])
+				{
+					bWindowsAlive[i] = Sums[i] >= FirstThreshold;
+					bSkipNextWindow = !bWindowsAlive[i];
+					bAnyAlive |= bWindowsAlive[i];
+				}
+			}
+
+			if (!bAnyAlive)
+				continue;
+
+			// The rest of the stages, until every window in the block has been rejected.
+			for (int32 StageIndex = 1; StageIndex < FCascade::NumStages && bAnyAlive; StageIndex++)
+			{
+				const FHaarStage& Stage = GetStage(StageIndex);
+				EvaluateStage<Step>(Stage, SumRow + X, VarianceNormFactors, OUT Sums);
+				const float Threshold = Stage.Threshold - StageThresholdEpsilon;
+
+				bAnyAlive = false;
+				for (int32 i = 0; i < NumLanes; i++)
+				{
+					bWindowsAlive[i] &= Sums[i] >= Threshold;
+					bAnyAlive |= bWindowsAlive[i];
+				}
+			}
+
+			for (int32 i = 0; i < NumLanes && bAnyAlive; i++)
+			{
+				if (bWindowsAlive[i])
+					Objects.emplace_back(cvRound((Offset.x + X + i * Step) * Scale), cvRound((Offset.y + Y) * Scale),
+					                     ObjectSize.width, ObjectSize.height);
+			}
+		}
+	}
+}
+
+template <typename FCascade>
+void THaarCascadeEvaluator<FCascade>::UpdateOffsets(int32 Stride)
+{
+	if (Stride == OffsetsStride)
+		return;
+
+	auto GetCorners = [Stride](const FHaarRect& Rect, int32* OutCorners)
+	{
+		OutCorners[0] = Rect.Y * Stride + Rect.X;
+		OutCorners[1] = Rect.Y * Stride + Rect.X + Rect.Width;
+		OutCorners[2] = (Rect.Y + Rect.Height) * Stride + Rect.X;
+		OutCorners[3] = (Rect.Y + Rect.Height) * Stride + Rect.X + Rect.Width;
+	};
+
+	for (int32 i = 0; i < FCascade::NumFeatures; i++)
+	{
+		for (int32 RectIndex = 0; RectIndex < 3; RectIndex++)
+			GetCorners(FCascade::Features[i].Rects[RectIndex], OUT FeatureOffsets[i].Corners[RectIndex]);
+	}
+
+	// The variance is measured inside a 1 pixel border.
+	GetCorners({1, 1, FCascade::WindowWidth - 2, FCascade::WindowHeight - 2, 0.f}, OUT NormCorners);
+	OffsetsStride = Stride;
+}
+
+template <typename FCascade>
+bool THaarCascadeEvaluator<FCascade>::GetVarianceNormFactor(const int32* SumWindow, const int32* SqSumWindow,
+                                                            float& OutFactor) const
+{
+	const int32 ValueSum = SumWindow[NormCorners[0]] - SumWindow[NormCorners[1]] - SumWindow[NormCorners[2]]
+		+ SumWindow[NormCorners[3]];
+
+	// The squared sums wrap around, but the differences between them don't within a window.
+	const uint32 SquaredSum = static_cast<uint32>(SqSumWindow[NormCorners[0]])
+		- static_cast<uint32>(SqSumWindow[NormCorners[1]]) - static_cast<uint32>(SqSumWindow[NormCorners[2]])
+		+ static_cast<uint32>(SqSumWindow[NormCorners[3]]);
+
+	constexpr double Area = (FCascade::WindowWidth - 2) * (FCascade::WindowHeight - 2);
+	const double NormFactor = Area * SquaredSum - static_cast<double>(ValueSum) * ValueSum;
+	if (NormFactor <= 0.)
+		return false;
+
+	OutFactor = static_cast<float>(1. / std::sqrt(NormFactor));
+	return Area * OutFactor < .1;
+}
+
+template <typename FCascade>
+template <int32 Step>
+void THaarCascadeEvaluator<FCascade>::EvaluateStage(const FHaarStage& Stage, const int32* SumWindow,
+                                                    const float* VarianceNormFactors, double* OutSums) const
+{
+	// The feature values are worked out in the same order and precision as cv::CascadeClassifier does, and the stumps
+	// are added up in double precision like it does, so each window is accepted or rejected exactly like it would be.
+
+#if CV_SIMD && CV_SIMD_64F
+	// Loads the value at Offset for each window. Windows Step apart are every Step-th value of the row.
+	auto LoadWindows = [SumWindow](int32 Offset)
+	{
+		if constexpr (Step == 1)
+		{
+			return cv::vx_load(SumWindow + Offset);
+		}
+		else
+		{
+			static_assert(Step == 2, "Windows can only be 1 or 2 pixels apart");
+			cv::v_int32 Even, Odd;
+			cv::v_load_deinterleave(SumWindow + Offset, Even, Odd);
+			return Even;
+		}
+	};
+
+	auto GetRectSums = [&LoadWindows](const int32* Corners)
+	{
+		return cv::v_cvt_f32(LoadWindows(Corners[0]) - LoadWindows(Corners[1]) - LoadWindows(Corners[2])
+			+ LoadWindows(Corners[3]));
+	};
+
+	const cv::v_float32 VarianceNormFactor = cv::vx_load_aligned(VarianceNormFactors);
+	cv::v_float64 SumsLow = cv::vx_setzero_f64();
+	cv::v_float64 SumsHigh = cv::vx_setzero_f64();
+
+	for (int32 i = Stage.FirstStump; i < Stage.FirstStump + Stage.NumStumps; i++)
+	{
+		const FHaarStump& Stump = FCascade::Stumps[i];
+		const FHaarFeature& Feature = FCascade::Features[Stump.FeatureIndex];
+		const FFeatureOffsets& Offsets = FeatureOffsets[Stump.FeatureIndex];
+
+		cv::v_float32 Value = GetRectSums(Offsets.Corners[0]) * cv::vx_setall_f32(Feature.Rects[0].Weight)
+			+ GetRectSums(Offsets.Corners[1]) * cv::vx_setall_f32(Feature.Rects[1].Weight);
+		if (Feature.Rects[2].Weight != 0.f)
+			Value += GetRectSums(Offsets.Corners[2]) * cv::vx_setall_f32(Feature.Rects[2].Weight);
+		Value *= VarianceNormFactor;
+
+		const cv::v_float32 Leaf = cv::v_select(Value < cv::vx_setall_f32(Stump.Threshold),
+			cv::vx_setall_f32(Stump.Left), cv::vx_setall_f32(Stump.Right));
+		SumsLow += cv::v_cvt_f64(Leaf);
+		SumsHigh += cv::v_cvt_f64_high(Leaf);
+	}
+
+	cv::v_store_aligned(OutSums, SumsLow);
+	cv::v_store_aligned(OutSums + cv::v_float64::nlanes, SumsHigh);
+#else
+	auto GetRectSum = [SumWindow](const int32* Corners)
+	{
+		return static_cast<float>(SumWindow[Corners[0]] - SumWindow[Corners[1]] - SumWindow[Corners[2]]
+			+ SumWindow[Corners[3]]);
+	};
+
+	double Sum = 0;
+	for (int32 i = Stage.FirstStump; i < Stage.FirstStump + Stage.NumStumps; i++)
+	{
+		const FHaarStump& Stump = FCascade::Stumps[i];
+		const FHaarFeature& Feature = FCascade::Features[Stump.FeatureIndex];
+		const FFeatureOffsets& Offsets = FeatureOffsets[Stump.FeatureIndex];
+
+		float Value = Feature.Rects[0].Weight * GetRectSum(Offsets.Corners[0])
+			+ Feature.Rects[1].Weight * GetRectSum(Offsets.Corners[1]);
+		if (Feature.Rects[2].Weight != 0.f)
+			Value += Feature.Rects[2].Weight * GetRectSum(Offsets.Corners[2]);
+		Value *= VarianceNormFactors[0];
+
+		Sum += Value < Stump.Threshold ? Stump.Left : Stump.Right;
+	}
+
+	OutSums[0] = Sum;
+#endif
+}
+
+TUniquePtr<FHaarCascadeEvaluator> FHaarCascadeEvaluator::CreateFrontalFace()
+{
+	return MakeUnique<THaarCascadeEvaluator<FHaarCascadeFrontalFaceDefault>>();
+}
+
+TUniquePtr<FHaarCascadeEvaluator> FHaarCascadeEvaluator::CreateEye()
+{
+	return MakeUnique<THaarCascadeEvaluator<FHaarCascadeEye>>();
+}
+
+FString FHaarCascadeEvaluator::GetInstructionSet()
+{
+#if !(CV_SIMD && CV_SIMD_64F)
+	const TCHAR* InstructionSet = TEXT("scalar");
+#elif CV_AVX512_SKX
+	const TCHAR* InstructionSet = TEXT("AVX-512");
+#elif CV_AVX2
+	const TCHAR* InstructionSet = TEXT("AVX2");
+#elif CV_SSE4_1
+	const TCHAR* InstructionSet = TEXT("SSE4.1");
+#elif CV_SSE2
+	const TCHAR* InstructionSet = TEXT("SSE2");
+#elif CV_NEON
+	const TCHAR* InstructionSet = TEXT("NEON");
+#else
+	const TCHAR* InstructionSet = TEXT("SIMD");
+#endif
+	return FString::Printf(TEXT("%s, %d windows at a time"), InstructionSet, NumLanes);
+}
+
+void FHaarCascadeEvaluator::DetectMultiScale(const cv::Mat& Image, std::vector<cv::Rect>& Objects, double ScaleFactor,
+                                             int32 MinNeighbors, const cv::Size& MinSize, const cv::Size& MaxSize)
+{
+	// Executed on worker thread.
+
+	SearchLevels(nullptr, Image, cv::Rect(0, 0, Image.cols, Image.rows), OUT Objects, ScaleFactor, MinNeighbors, MinSize,
+		MaxSize);
+}
+
+void FHaarCascadeEvaluator::DetectMultiScale(const FHaarPyramid& Pyramid, const cv::Rect& Area,
+                                             std::vector<cv::Rect>& Objects, double ScaleFactor, int32 MinNeighbors,
+                                             const cv::Size& MinSize, const cv::Size& MaxSize)
+{
+	// Executed on worker thread.
+
+	SearchLevels(&Pyramid, Pyramid.GetImage(), Area, OUT Objects, ScaleFactor, MinNeighbors, MinSize, MaxSize);
+}
+
+void FHaarCascadeEvaluator::SearchLevels(const FHaarPyramid* Pyramid, const cv::Mat& Image, const cv::Rect& Area,
+                                         std::vector<cv::Rect>& Objects, double ScaleFactor, int32 MinNeighbors,
+                                         const cv::Size& MinSize, const cv::Size& MaxSize)
+{
+	// Executed on worker thread.
+
+	check(Image.type() == CV_8UC1 && ScaleFactor > 1);
+	check((Area & cv::Rect(0, 0, Image.cols, Image.rows)) == Area);
+	Objects.clear();
+
+	const cv::Size WindowSize = GetWindowSize();
+	if (Area.width < WindowSize.width || Area.height < WindowSize.height)
+		return;
+
+	const cv::Mat AreaImage = Image(Area);
+	const cv::Size MaxObjectSize = MaxSize.width == 0 || MaxSize.height == 0 ? Area.size() : MaxSize;
+
+	// cv::CascadeClassifier splits every level into the same number of stripes of rows to test in parallel, as many as
+	// the first level is 32 windows wide. The stripes can stop short of the last rows of a level, which it then never
+	// tests, so neither does this.
+	int32 NumStripes = 0;
+
+	// The integral images of every level fit in those of the first, so they're only allocated once per image size.
+	const int32 BufferWidth = Area.width + 1 + GetRowPadding();
+	if (SumBuffer.rows < Area.height + 1 || SumBuffer.cols < BufferWidth)
+	{
+		// The lanes past the last window in each row read the columns after it, which hold whatever a wider level left
+		// there. Their windows are masked out, so what they read never matters. Zeroed so it's never uninitialised.
+		SumBuffer = cv::Mat::zeros(Area.height + 1, BufferWidth, CV_32SC1);
+		SqSumBuffer = cv::Mat::zeros(Area.height + 1, BufferWidth, CV_32SC1);
+	}
+
+	// The same scales as cv::CascadeClassifier, in the same precision: each ScaleFactor times the last, from the
+	// cascade's window size up to the image's, that are within MinSize and MaxSize.
+	for (double Factor = 1; ; Factor *= ScaleFactor)
+	{
+		if (cvRound(WindowSize.width * Factor) > Area.width || cvRound(WindowSize.height * Factor) > Area.height)
+			break;
+
+		const float Scale = static_cast<float>(Factor);
+		const cv::Size ObjectSize(cvRound(WindowSize.width * Scale), cvRound(WindowSize.height * Scale));
+		if (ObjectSize.width > MaxObjectSize.width || ObjectSize.height > MaxObjectSize.height)
+			break;
+		if (ObjectSize.width < MinSize.width || ObjectSize.height < MinSize.height)
+			continue;
+
+		const cv::Size LevelSize(FMath::Max(cvRound(Area.width / Scale), 0), FMath::Max(cvRound(Area.height / Scale), 0));
+		const FHaarPyramid::FLevel* PyramidLevel = Pyramid ? Pyramid->FindLevel(Scale) : nullptr;
+		cv::Mat Sum, SqSum;
+		cv::Point Offset(0, 0);
+
+		if (PyramidLevel)
+		{
+			// The area's part of the level, which can be a pixel short at the edges of the image after rounding.
+			Offset = cv::Point(cvRound(Area.x / Scale), cvRound(Area.y / Scale));
+			const cv::Rect LevelArea = cv::Rect(Offset, LevelSize + cv::Size(1, 1))
+				& cv::Rect(0, 0, PyramidLevel->Sum.cols, PyramidLevel->Sum.rows);
+			Sum = PyramidLevel->Sum(LevelArea);
+			SqSum = PyramidLevel->SqSum(LevelArea);
+		}
+		else
+		{
+			const cv::Mat* Level = &AreaImage;
+			if (LevelSize != Area.size())
+			{
+				cv::resize(AreaImage, OUT LevelImage, LevelSize, 0, 0, cv::INTER_LINEAR_EXACT);
+				Level = &LevelImage;
+			}
+
+			// Written into the buffers in place, since their size and type already match.
+			Sum = SumBuffer(cv::Rect(0, 0, LevelSize.width + 1, LevelSize.height + 1));
+			SqSum = SqSumBuffer(cv::Rect(0, 0, LevelSize.width + 1, LevelSize.height + 1));
+			cv::integral(*Level, OUT Sum, OUT SqSum, CV_32S, CV_32S);
+		}
+
+		// Only every other window is tested in the finer levels.
+		const int32 Step = Scale >= 2 ? 1 : 2;
+		const cv::Size WorkingSize(FMath::Max(Sum.cols - WindowSize.width, 0),
+		                           FMath::Max(Sum.rows - WindowSize.height, 0));
+		if (NumStripes == 0)
+			NumStripes = cvCeil(WorkingSize.width / 32.);
+		const int32 StripeHeight = FMath::Max((WorkingSize.height / Step + NumStripes - 1) / NumStripes, 1) * Step;
+		const int32 EndY = FMath::Min(NumStripes * StripeHeight, WorkingSize.height);
+
+		const size_t NumObjects = Objects.size();
+		DetectInLevel(Sum, SqSum, Scale, Step, EndY, Offset, OUT Objects);
+
+		// Objects found in the pyramid are relative to the whole image.
+		if (PyramidLevel)
+		{
+			for (size_t i = NumObjects; i < Objects.size(); i++)
+				Objects[i] -= Area.tl();
+		}
+	}
+
+	cv::groupRectangles(IN OUT Objects, MinNeighbors, GroupEpsilon);
+}
+
+void FHaarPyramid::Build(const cv::Mat& InImage, double ScaleFactor, double MinScale, const cv::Size& WindowSize,
+                         FFramePool* Pool)
+{
+	// Executed on worker thread.
+
+	check(InImage.type() == CV_8UC1 && ScaleFactor > 1);
+	Image = InImage;
+	Levels.Reset();
+
+	// The same scales, in the same precision, as FHaarCascadeEvaluator::DetectMultiScale, so it can find them.
+	TArray<cv::Size, TInlineAllocator<16>> LevelSizes;
+	int32 AtlasRows = 0;
+	for (double Factor = 1; ; Factor *= ScaleFactor)
+	{
+		if (cvRound(WindowSize.width * Factor) > Image.cols || cvRound(WindowSize.height * Factor) > Image.rows)
+			break;
+		if (Factor < MinScale)
+			continue;
+
+		const float Scale = static_cast<float>(Factor);
+		const cv::Size LevelSize(FMath::Max(cvRound(Image.cols / Scale), 0), FMath::Max(cvRound(Image.rows / Scale), 0));
+		Levels.Add({Scale, cv::Mat(), cv::Mat()});
+		LevelSizes.Add(LevelSize);
+		AtlasRows += LevelSize.height + 1;
+	}
+
+	if (Levels.Num() == 0)
+		return;
+
+	// The first level is the widest.
+	const cv::Size AtlasSize(LevelSizes[0].width + 1 + FHaarCascadeEvaluator::GetRowPadding(), AtlasRows);
+	if (SumAtlas.size() != AtlasSize)
+	{
+		SumAtlas = Pool ? Pool->Acquire(AtlasSize, CV_32SC1) : cv::Mat(AtlasSize, CV_32SC1);
+		SqSumAtlas = Pool ? Pool->Acquire(AtlasSize, CV_32SC1) : cv::Mat(AtlasSize, CV_32SC1);
+	}
+
+	// Every level fits in the first, so they're all scaled into the same buffer. It is taken from the pool too, in its
+	// format, since an integral image is always bigger than the level it's made from.
+	const cv::Mat LevelStorage = Pool ? Pool->Acquire(AtlasSize, CV_32SC1) : cv::Mat(AtlasSize, CV_32SC1);
+	const cv::Mat LevelBuffer(LevelSizes[0], CV_8UC1, LevelStorage.data);
+	int32 Row = 0;
+	for (int32 i = 0; i < Levels.Num(); i++)
+	{
+		FLevel& Level = Levels[i];
+		const cv::Size& LevelSize = LevelSizes[i];
+
+		cv::Mat LevelImage = Image;
+		if (LevelSize != Image.size())
+		{
+			LevelImage = LevelBuffer(cv::Rect(0, 0, LevelSize.width, LevelSize.height));
+			cv::resize(Image, OUT LevelImage, LevelSize, 0, 0, cv::INTER_LINEAR_EXACT);
+		}
+
+		// Written into the atlases in place, since their size and type already match.
+		const cv::Rect LevelRect(0, Row, LevelSize.width + 1, LevelSize.height + 1);
+		Level.Sum = SumAtlas(LevelRect);
+		Level.SqSum = SqSumAtlas(LevelRect);
+		cv::integral(LevelImage, OUT Level.Sum, OUT Level.SqSum, CV_32S, CV_32S);
+
+		// Only lanes that are masked out read the padding after each row, but the atlases can come fresh from the pool,
+		// so it's cleared rather than left uninitialised.
+		const cv::Rect PaddingRect(LevelRect.br().x, Row, FHaarCascadeEvaluator::GetRowPadding(), LevelRect.height);
+		SumAtlas(PaddingRect).setTo(0);
+		SqSumAtlas(PaddingRect).setTo(0);
+
+		Row += LevelRect.height;
+	}
+}
+
+const FHaarPyramid::FLevel* FHaarPyramid::FindLevel(float Scale) const
+{
+	return Levels.FindByPredicate([Scale](const FLevel& Level) { return Level.Scale == Scale; });
+}
+
+int32 FHaarCascadeEvaluator::GetRowPadding()
+{
+	// Windows 2 pixels apart are loaded 2 blocks of lanes at a time, and the odd ones thrown away.
+	return 2 * NumLanes;
+}
@@ -0,0 +1,117 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#include "ImageBackend.h"
+#include "BlinkOpenCV.h"
+#include "PreOpenCVHeaders.h"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/cudaimgproc.hpp>
+#include <opencv2/cudawarping.hpp>
+#include <opencv2/dnn/dnn.hpp>
+#include "PostOpenCVHeaders.h"
+
+TUniquePtr<FImageBackend> FImageBackend::Create(EImageBackend Type)
+{
+	checkf(Type != EImageBackend::Auto, TEXT("ImageBackend: Resolve the backend before creating it"));
+
+	if (Type == EImageBackend::Cuda)
+		return MakeUnique<FCudaImageBackend>();
+	return MakeUnique<FCpuImageBackend>();
+}
+
+EImageBackend FImageBackend::Resolve(EImageBackend Type)
+{
+	if (Type == EImageBackend::Cpu)
+		return EImageBackend::Cpu;
+
+	if (IsCudaAvailable())
+		return EImageBackend::Cuda;
+
+	if (Type == EImageBackend::Cuda)
+		UE_LOG(LogBlinkOpenCV, Warning, TEXT("ImageBackend: CUDA was requested but no device is available, using the CPU"));
+	return EImageBackend::Cpu;
+}
+
+bool FImageBackend::IsCudaAvailable()
+{
+	// 0 if OpenCV was built without CUDA, -1 if the driver is too old.
+	static const bool bCudaAvailable = cv::cuda::getCudaEnabledDeviceCount() > 0;
+	return bCudaAvailable;
+}
+
+const TCHAR* FImageBackend::GetName(EImageBackend Type)
+{
+	switch (Type)
+	{
+	case EImageBackend::Auto:
+		return TEXT("Auto");
+	case EImageBackend::Cuda:
+		return TEXT("CUDA");
+	case EImageBackend::Cpu:
+		return TEXT("CPU");
+	}
+	return TEXT("Unknown");
+}
+
+int32 FImageBackend::GetDnnBackend(EImageBackend Type)
+{
+	return Type == EImageBackend::Cuda ? cv::dnn::DNN_BACKEND_CUDA : cv::dnn::DNN_BACKEND_OPENCV;
+}
+
+int32 FImageBackend::GetDnnTarget(EImageBackend Type)
+{
+	return Type == EImageBackend::Cuda ? cv::dnn::DNN_TARGET_CUDA : cv::dnn::DNN_TARGET_CPU;
+}
+
+void FCudaImageBackend::Resize(const cv::Mat& Source, const cv::Size& Size, int32 Channels, cv::Mat& Destination)
+{
+	// Executed on worker thread.
+
+	const bool bConvert = Source.channels() != Channels;
+	const int32 ConversionCode = Channels == 1 ? cv::COLOR_BGR2GRAY : cv::COLOR_GRAY2BGR;
+
+	GpuFrame.upload(Source);
+	const cv::cuda::GpuMat* Current = &GpuFrame;
+
+	// Drop channels before resizing and add them after, so the resize always works on the fewest channels.
+	if (bConvert && Channels == 1)
+	{
+		cv::cuda::cvtColor(*Current, OUT GpuConvertedFrame, ConversionCode);
+		Current = &GpuConvertedFrame;
+	}
+
+	cv::cuda::resize(*Current, OUT GpuResizedFrame, Size, 0, 0, cv::INTER_LINEAR);
+	Current = &GpuResizedFrame;
+
+	if (bConvert && Channels != 1)
+	{
+		cv::cuda::cvtColor(*Current, OUT GpuConvertedFrame, ConversionCode);
+		Current = &GpuConvertedFrame;
+	}
+
+	Current->download(OUT Destination);
+}
+
+void FCpuImageBackend::Resize(const cv::Mat& Source, const cv::Size& Size, int32 Channels, cv::Mat& Destination)
+{
+	// Executed on worker thread.
+
+	const int32 ConversionCode = Channels == 1 ? cv::COLOR_BGR2GRAY : cv::COLOR_GRAY2BGR;
+
+	// Same order and interpolation as the CUDA backend, so both find the same faces and eyes.
+	if (Source.channels() == Channels)
+	{
+		cv::resize(Source, OUT Destination, Size, 0, 0, cv::INTER_LINEAR);
+	}
+	else if (Channels == 1)
+	{
+		cv::cvtColor(Source, OUT IntermediateFrame, ConversionCode);
+		cv::resize(IntermediateFrame, OUT Destination, Size, 0, 0, cv::INTER_LINEAR);
+	}
+	else
+	{
+		cv::resize(Source, OUT IntermediateFrame, Size, 0, 0, cv::INTER_LINEAR);
+		cv::cvtColor(IntermediateFrame, OUT Destination, ConversionCode);
+	}
+}
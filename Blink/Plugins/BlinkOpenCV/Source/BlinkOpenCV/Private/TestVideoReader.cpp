@@ -7,27 +7,39 @@
 #include "CascadeEyeDetector.h"
 #include "DnnCascadeEyeDetector.h"
 
-FTestVideoReader::FTestVideoReader(int32 InCameraIndex, float InRefreshRate, FVector2D InResizeDimensions)
+FTestVideoReader::FTestVideoReader(int32 InCameraIndex, float InRefreshRate, FVector2D InResizeDimensions,
+                                   const FFeatureDetectorSettings& InDetectorSettings)
 	: FVideoReader(InCameraIndex, InRefreshRate, InResizeDimensions)
+	, DetectorSettings(InDetectorSettings)
 { }
 
-FTestVideoReader::FTestVideoReader(const FString& InVideoSource, float InRefreshRate, FVector2D InResizeDimensions)
+FTestVideoReader::FTestVideoReader(const FString& InVideoSource, float InRefreshRate, FVector2D InResizeDimensions,
+                                   const FFeatureDetectorSettings& InDetectorSettings)
 	: FVideoReader(InVideoSource, InRefreshRate, InResizeDimensions)
+	, DetectorSettings(InDetectorSettings)
 { }
 
-void FTestVideoReader::Exit()
+FTestVideoReader::FTestVideoReader(const FCaptureSettings& InCaptureSettings, float InRefreshRate,
+                                   FVector2D InResizeDimensions, const FFeatureDetectorSettings& InDetectorSettings)
+	: FVideoReader(InCaptureSettings, InRefreshRate, InResizeDimensions)
+	, DetectorSettings(InDetectorSettings)
+{ }
+
+FTestVideoReader::~FTestVideoReader()
 {
-	FVideoReader::Exit();
+	StopThread();
 }
 
-void FTestVideoReader::Stop()
+void FTestVideoReader::OnDestroy()
 {
-	FVideoReader::Stop();
-	
+	FVideoReader::OnDestroy();
+
+	// The EyeDetector has already been stopped as a child thread, but may be holding frames from this VideoReader's
+	// pool, so it must be released before this is destroyed.
 	if (EyeDetector.IsValid())
 	{
 		RemoveChildRenderer(EyeDetector);
-		EyeDetector->Kill();
+		RemoveChildThread(EyeDetector);
 		EyeDetector.Reset();
 	}
 }
@@ -37,7 +49,8 @@ void FTestVideoReader::Start()
 	FVideoReader::Start();
 	
 	if (!EyeDetector.IsValid())
-		EyeDetector = MakeShared<FCascadeEyeDetector>(this);
+		EyeDetector = MakeShared<FCascadeEyeDetector>(this, DetectorSettings);
 
 	AddChildRenderer(EyeDetector);
+	AddChildThread(EyeDetector);
 }
@@ -0,0 +1,188 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#include "Misc/AutomationTest.h"
+#include "FeatureDetector.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "VideoReader.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace
+{
+	/**
+	 * @brief Records the sequence number of every frame it is handed, then processes it as slowly as FFeatureDetector
+	 * does by default, which is well over the default frame deadline.
+	 */
+	class FReplayTestDetector : public FFeatureDetector
+	{
+	public:
+		FReplayTestDetector(FVideoReader* InVideoReader, const FFeatureDetectorSettings& InSettings)
+			: FFeatureDetector(InVideoReader, InSettings)
+		{
+			SetName(TEXT("ReplayTestDetectorThread"));
+			StartThread();
+		}
+
+		virtual ~FReplayTestDetector() override
+		{
+			StopThread();
+		}
+
+		TArray<uint64> GetProcessedSequenceNumbers() const
+		{
+			FScopeLock Lock(&ProcessedLock);
+			return ProcessedSequenceNumbers;
+		}
+
+	protected:
+		virtual void DispatchFrame(FVideoFrame& Frame, double DeltaTime) override
+		{
+			// Executed on worker thread.
+
+			{
+				FScopeLock Lock(&ProcessedLock);
+				ProcessedSequenceNumbers.Add(Frame.SequenceNumber);
+			}
+
+			FFeatureDetector::DispatchFrame(Frame, DeltaTime);
+		}
+
+	private:
+		mutable FCriticalSection ProcessedLock;
+		TArray<uint64> ProcessedSequenceNumbers;
+	};
+
+	class FReplayTestVideoReader : public FVideoReader
+	{
+	public:
+		FReplayTestVideoReader(const FString& InFilePath, const FFeatureDetectorSettings& InDetectorSettings)
+			: FVideoReader(FCaptureSettings::Replay(InFilePath))
+			, DetectorSettings(InDetectorSettings)
+		{ }
+
+		virtual ~FReplayTestVideoReader() override
+		{
+			StopThread();
+		}
+
+		/**
+		 * @brief The detector, once the VideoReader has connected. Can be called from any thread.
+		 */
+		TSharedPtr<FReplayTestDetector> GetDetector() const
+		{
+			FScopeLock Lock(&DetectorLock);
+			return Detector;
+		}
+
+	protected:
+		virtual void Start() override
+		{
+			FVideoReader::Start();
+
+			// Mailboxes can only be created from this thread.
+			FScopeLock Lock(&DetectorLock);
+			if (!Detector.IsValid())
+				Detector = MakeShared<FReplayTestDetector>(this, DetectorSettings);
+
+			AddChildThread(Detector);
+		}
+
+		virtual void OnDestroy() override
+		{
+			FVideoReader::OnDestroy();
+
+			// Holds frames from this VideoReader's pool, so it must be released before this is destroyed.
+			FScopeLock Lock(&DetectorLock);
+			if (Detector.IsValid())
+			{
+				RemoveChildThread(Detector);
+				Detector.Reset();
+			}
+		}
+
+	private:
+		FFeatureDetectorSettings DetectorSettings;
+		mutable FCriticalSection DetectorLock;
+		TSharedPtr<FReplayTestDetector> Detector;
+	};
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FFeatureDetectorReplayTest, "BlinkOpenCV.FeatureDetector.ReplayProcessesEveryFrame",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FFeatureDetectorReplayTest::RunTest(const FString& Parameters)
+{
+	constexpr int32 NumFrames = 20;
+
+	// A short clip of blank frames, written with OpenCV's own MJPEG encoder so it doesn't depend on GStreamer's.
+	const FString FilePath = FPaths::ConvertRelativePathToFull(
+		FPaths::Combine(FPaths::AutomationTransientDir(), TEXT("ReplayTest.avi")));
+	{
+		cv::VideoWriter Writer(TCHAR_TO_UTF8(*FilePath), cv::CAP_OPENCV_MJPEG, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
+			30, cv::Size(64, 48));
+		if (!TestTrue(TEXT("The test clip can be written"), Writer.isOpened()))
+			return false;
+
+		for (int32 i = 0; i < NumFrames; i++)
+			Writer.write(cv::Mat(48, 64, CV_8UC3, cv::Scalar::all(i * 10)));
+	}
+
+	// The default deadline, which the detector misses on every frame.
+	FFeatureDetectorSettings DetectorSettings;
+	DetectorSettings.FrameDeadline = .033f;
+
+	TArray<uint64> Processed;
+	uint64 NumPublished = 0;
+	uint64 NumExpired = 0;
+	uint64 NumSuperseded = 0;
+	{
+		FReplayTestVideoReader VideoReader(FilePath, DetectorSettings);
+
+		// The first frame can be taken by the VideoStream's negotiation, so the replay may publish one fewer.
+		const double Timeout = FPlatformTime::Seconds() + 30;
+		while (FPlatformTime::Seconds() < Timeout)
+		{
+			const TSharedPtr<FReplayTestDetector> Detector = VideoReader.GetDetector();
+			if (Detector.IsValid() && Detector->GetProcessedSequenceNumbers().Num() >= NumFrames - 1)
+				break;
+
+			FPlatformProcess::Sleep(.05f);
+		}
+
+		// Keeps the detector alive once the VideoReader releases it, so its stats can be read after it stops.
+		const TSharedPtr<FReplayTestDetector> Detector = VideoReader.GetDetector();
+		VideoReader.StopThread();
+		NumPublished = VideoReader.GetFrameSequenceNumber();
+
+		if (!TestTrue(TEXT("The replay started"), Detector.IsValid()))
+			return false;
+
+		Processed = Detector->GetProcessedSequenceNumbers();
+		NumExpired = Detector->GetFrameStats().NumExpired.load();
+		NumSuperseded = Detector->GetFrameStats().NumSuperseded.load();
+	}
+
+	TestTrue(TEXT("The replay reached the end of the clip"), Processed.Num() >= NumFrames - 1);
+	TestEqual(TEXT("Frames skipped for missing the deadline"), NumExpired, 0ull);
+	TestEqual(TEXT("Frames overwritten before the detector took them"), NumSuperseded, 0ull);
+
+	// The VideoReader can have published the next frame while the detector was still processing the last one.
+	TestTrue(TEXT("Every published frame but the one in flight was processed"),
+		NumPublished >= (uint64)Processed.Num() && NumPublished <= (uint64)Processed.Num() + 1);
+
+	// Every frame, in order, from the first one published.
+	int32 NumInOrder = 0;
+	while (NumInOrder < Processed.Num() && Processed[NumInOrder] == (uint64)NumInOrder + 1)
+		NumInOrder++;
+	TestEqual(TEXT("Frames processed in sequence before the first gap"), NumInOrder, Processed.Num());
+
+	IFileManager::Get().Delete(*FilePath);
+	return true;
+}
+
+#endif
@@ -0,0 +1,53 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#include "ThreadScheduling.h"
+
+FThreadSchedulingSettings FThreadSchedulingSettings::AutomaticCapture()
+{
+	FThreadSchedulingSettings Settings;
+	const int32 NumCores = FPlatformMisc::NumberOfCores();
+	if (NumCores < MinCoresToPin)
+	{
+		Settings.Priority = TPri_Normal;
+		return Settings;
+	}
+
+	Settings.Priority = TPri_Highest;
+	Settings.AffinityMask = GetCoreRangeMask(NumCores - 1, NumCores - 1);
+	return Settings;
+}
+
+FThreadSchedulingSettings FThreadSchedulingSettings::AutomaticDetector()
+{
+	FThreadSchedulingSettings Settings;
+	const int32 NumCores = FPlatformMisc::NumberOfCores();
+	if (NumCores < MinCoresToPin)
+	{
+		Settings.Priority = TPri_SlightlyBelowNormal;
+		return Settings;
+	}
+
+	Settings.Priority = TPri_Normal;
+	Settings.AffinityMask = GetCoreRangeMask(ReservedCores, NumCores - 2);
+	return Settings;
+}
+
+uint64 FThreadSchedulingSettings::GetCoreRangeMask(int32 FirstCore, int32 LastCore)
+{
+	const int32 NumCores = FMath::Max(FPlatformMisc::NumberOfCores(), 1);
+	const int32 LogicalPerCore = FMath::Max(FPlatformMisc::NumberOfCoresIncludingHyperthreads() / NumCores, 1);
+
+	uint64 Mask = 0;
+	for (int32 Core = FirstCore; Core <= LastCore; Core++)
+	{
+		for (int32 i = 0; i < LogicalPerCore; i++)
+		{
+			// Masks can't describe processors past the 64th.
+			if (const int32 Processor = Core * LogicalPerCore + i; Processor < 64)
+				Mask |= 1ull << Processor;
+		}
+	}
+	return Mask;
+}
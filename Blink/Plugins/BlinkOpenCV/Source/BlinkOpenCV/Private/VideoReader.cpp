@@ -3,140 +3,200 @@
 // NHE2422 Advanced Computer Games Development Assignment 2.
 
 #include "VideoReader.h"
+#include "Async/Async.h"
 #include "BlinkOpenCV.h"
+#include "BlinkOpenCVStats.h"
 
 FVideoReader::FVideoReader(int32 InCameraIndex, float InRefreshRate, FVector2D InResizeDimensions, const FString InWindowName)
+	: FVideoReader(FCaptureSettings::Camera(InCameraIndex), InRefreshRate, InResizeDimensions, InWindowName)
+{ }
+
+FVideoReader::FVideoReader(const FString& InVideoSource, float InRefreshRate, FVector2D InResizeDimensions, const FString InWindowName)
+	: FVideoReader(FCaptureSettings::File(InVideoSource), InRefreshRate, InResizeDimensions, InWindowName)
+{ }
+
+FVideoReader::FVideoReader(const FCaptureSettings& InCaptureSettings, float InRefreshRate, FVector2D InResizeDimensions,
+                           const FString InWindowName)
+	: FEulerThread(TEXT("VideoReader"), InRefreshRate, TPri_AboveNormal)
 {
 	// Executed on game thread.
 	
-	checkf(InCameraIndex >= 0, TEXT("VideoReader: Provided an invalid camera index. Index: %d"), InCameraIndex);
+	checkf(InCaptureSettings.Source != ECaptureSource::Camera || InCaptureSettings.CameraIndex >= 0,
+		TEXT("VideoReader: Provided an invalid camera index. Index: %d"), InCaptureSettings.CameraIndex);
 	
-	CameraIndex = InCameraIndex;
+	CaptureSettings = InCaptureSettings;
 	RefreshRate = InRefreshRate;
-	ResizeDimensions = cv::Point(InResizeDimensions.X, InResizeDimensions.Y);
+	
+	// Resize once inside the pipeline, rather than in every consumer.
+	if (InResizeDimensions.X > 2 && InResizeDimensions.Y > 2)
+	{
+		CaptureSettings.OutputWidth = InResizeDimensions.X;
+		CaptureSettings.OutputHeight = InResizeDimensions.Y;
+	}
+	
 	bVideoActive = false;
-	CurrentFrame = MakeShared<cv::Mat>();
-	PreviousTime = 0;
+	ConnectionState = EConnectionState::Disconnected;
+	FailedConnectionAttempts = 0;
+	NextConnectionTime = 0;
+	OutputFormat = ECaptureOutputFormat::BGR;
+	FrameType = CV_8UC3;
+	StreamFrameRate = 0;
+	FrameSequenceNumber = 0;
+	bReplayFinished = false;
+	ReplayStartTime = 0;
+	AdaptedRefreshRate = RefreshRate;
 	WindowName = TCHAR_TO_UTF8(*InWindowName);
 
-	Thread = FRunnableThread::Create(this, TEXT("VideoReader"), 0, TPri_AboveNormal);
-	checkf(Thread, TEXT("Could not create Thread '%s'"), TEXT("VideoReader"));
+	// Live streams are read once per RefreshRate (slowed down further while consumers fall behind, see
+	// bAdaptRefreshRate), since reading any faster only produces frames nobody takes. Replays have no tick rate, since
+	// they are paced by their consumers instead.
+	SetTickRate(IsReplaying() ? 0 : RefreshRate);
+	SetScheduling(CaptureSettings.Scheduling);
+	StartThread();
 }
 
-FVideoReader::FVideoReader(const FString& InVideoSource, float InRefreshRate, FVector2D InResizeDimensions, const FString InWindowName)
+void FVideoReader::OnPreStart()
 {
-	// Executed on game thread.
-	
-	VideoSource = TCHAR_TO_UTF8(*InVideoSource);
-	RefreshRate = InRefreshRate;
-	ResizeDimensions = cv::Point(InResizeDimensions.X, InResizeDimensions.Y);
-	bVideoActive = false;
-	CurrentFrame = MakeShared<cv::Mat>();
-	PreviousTime = 0;
-	WindowName = TCHAR_TO_UTF8(*InWindowName);
+	// Executed on owning thread.
 
-	Thread = FRunnableThread::Create(this, TEXT("VideoReader"), 0, TPri_AboveNormal);
-	checkf(Thread, TEXT("Could not create Thread '%s'"), TEXT("VideoReader"));
+	// Only count this run's frames if the thread is restarted.
+	FrameStats.Reset();
 }
 
-bool FVideoReader::Init()
+void FVideoReader::OnStart()
 {
-	// Executed on game thread.
+	// Executed on worker thread.
 	
-	UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Initialised"));
-	return true;
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Running"));
 }
 
-uint32 FVideoReader::Run()
+void FVideoReader::OnTick(const double& DeltaTime)
 {
 	// Executed on worker thread.
 	
-	UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Running"));
-
-	bThreadActive = true;
-	
-	while (IsActive())
+	// VideoStream not active, attempt to (re)connect to it. A finished replay isn't restarted.
+	if (!bVideoActive)
+	{
+		if (!bReplayFinished)
+			UpdateConnection();
+	}
+	else
 	{
-		const double DeltaTime = UpdateAndGetDeltaTime();
-		#if UE_BUILD_DEBUG || UE_EDITOR
-		UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Ticking"));
-		#endif
+		// Lossless backpressure: don't read the next frame until the slowest consumer has taken the last one.
+		if (IsReplaying())
+			WaitForConsumers();
+		else if (CaptureSettings.bAdaptRefreshRate)
+		{
+			AdaptRefreshRate();
+			SetTickRate(AdaptedRefreshRate);
+		}
 		
-		// VideoStream not active, attempt to initialise it.
-		if (!bVideoActive)
+		// Attempt to read the current frame in the VideoStream.
+		// Note: It takes a few seconds for the Video Stream to return an empty frame.
+		// Reading into a pooled frame of the right format means the VideoStream copies into it instead of
+		// allocating a new one.
+		cv::Mat TmpFrame = FramePool.Acquire(FrameSize, FrameType);
+		bool bFrameRead;
 		{
-			InitialiseVideoStream();
+			BLINKOPENCV_SCOPE(Read);
+			bFrameRead = VideoStream.read(OUT TmpFrame);
 		}
-		else
+
+		if (bFrameRead)
 		{
-			// Attempt to read the current frame in the VideoStream.
-			// Note: It takes a few seconds for the Video Stream to return an empty frame.
-			cv::Mat TmpFrame;
-			if (VideoStream.read(OUT TmpFrame))
-			{
-				#if UE_BUILD_DEBUG || UE_EDITOR
-				const double CurrentTime = FPlatformTime::Seconds();
-				UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Processing a frame"));
-				#endif
-				
-				// Frame retrieved, process it.
-				ProcessNextFrame(TmpFrame);
-
-				#if UE_BUILD_DEBUG || UE_EDITOR
-				const double SecondsTook = FPlatformTime::Seconds() - CurrentTime;
-				UE_LOG(LogBlinkOpenCV, Display,
-					TEXT("VideoReader: Processed a frame in %fms"), SecondsTook * 1000.f);
-				#endif
-
-				// Setting after ensures any thread that wants access to the video frame, only gets FULLY processed frames
-				// from the CameraReader. Otherwise, it is possible for other threads to get partially processed frames.
-				CurrentFrame = MakeShared<cv::Mat>(TmpFrame);
-			}
-			else
+			BLINKOPENCV_SCOPE(Publish);
+
+			const double CaptureTime = FPlatformTime::Seconds();
+			const double PositionMs = VideoStream.get(cv::CAP_PROP_POS_MSEC);
+			double StreamPosition = PositionMs >= 0 ? PositionMs / 1000.0 : -1;
+
+			// The position reported during file playback can run ahead of the delivered buffer, so when replaying,
+			// derive it from the frame index instead. Assumes the file has a constant framerate.
+			if (IsReplaying() && StreamFrameRate > 0)
+				StreamPosition = FrameSequenceNumber / StreamFrameRate;
+
+			// The stream negotiated a different format than it reported, pool that one instead from now on.
+			if (TmpFrame.size() != FrameSize || TmpFrame.type() != FrameType)
 			{
-				UE_LOG(LogBlinkOpenCV, Error, TEXT("VideoReader: VideoStream could not be read"));
-				bVideoActive = false;
-				CurrentFrame.Reset();
+				FrameSize = TmpFrame.size();
+				FrameType = TmpFrame.type();
 			}
+
+			// Frame retrieved, process it.
+			ProcessNextFrame(TmpFrame);
+
+			// Publishing after ensures any thread that wants access to the video frame, only gets FULLY processed
+			// frames from the CameraReader. Otherwise, it is possible for other threads to get partially processed
+			// frames.
+			PublishFrame(TmpFrame, CaptureTime, StreamPosition);
 		}
+		else if (IsReplaying())
+		{
+			const double ReplayDuration = FPlatformTime::Seconds() - ReplayStartTime;
+			const double StreamDuration = StreamFrameRate > 0 ? FrameSequenceNumber / StreamFrameRate : 0;
+			UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Replay finished, %llu frames in %fs (%.1fx real-time)"),
+				FrameSequenceNumber.load(), ReplayDuration, ReplayDuration > 0 ? StreamDuration / ReplayDuration : 0);
+			bReplayFinished = true;
+			bVideoActive = false;
+			ConnectionState = EConnectionState::Disconnected;
 
-		// Sleep until next refresh. Ensure minimum sleep time so it doesn't waste the OS resources.
-		const float SleepTime = FMath::Max(0.01f, RefreshRate - (FPlatformTime::Seconds() - PreviousTime));
-		FPlatformProcess::Sleep(SleepTime);
+			// Nothing paces the thread any more.
+			SetTickRate(RefreshRate);
+		}
+		else
+		{
+			UE_LOG(LogBlinkOpenCV, Error, TEXT("VideoReader: VideoStream could not be read"));
+			bVideoActive = false;
+			VideoStream.release();
+			ScheduleReconnect();
+		}
 	}
-
-	return true;
 }
 
-void FVideoReader::Exit()
+void FVideoReader::OnStop()
 {
 	// Executed on worker thread.
 	
-	UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Exiting"));
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Frame pool used %d buffers, %d fallback allocations"),
+		FramePool.GetNumBuffers(), FramePool.GetNumFallbackAllocations());
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Frames: %s, ended at a refresh rate of %fs"),
+		*FrameStats.ToString(), AdaptedRefreshRate);
+	
 	if (bVideoActive)
 	{
 		bVideoActive = false;
 		VideoStream.release();
 	}
-	
-	CurrentFrame.Reset();
+
+	// Doesn't wait for a VideoStream that is still being opened; it is released once its thread finishes.
+	PendingVideoStream.Reset();
+	ConnectionState = EConnectionState::Disconnected;
 }
 
-void FVideoReader::Stop()
+void FVideoReader::OnPreStop()
 {
 	// Executed on game thread.
 	
 	UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Requested to stop."));
-	bThreadActive = false;
 }
 
 void FVideoReader::Render()
 {
+	// Executed on game thread.
+
+	SubscribeWindow();
 	if (IsActive())
 	{
-		const auto Frame = GetFrame();
-		if (Frame.IsValid() && Frame->data != nullptr)
-			cv::imshow(WindowName, *Frame);
+		{
+			BLINKOPENCV_SCOPE(Render);
+
+			// Keep showing the last frame if a new one hasn't arrived yet. The colour frame is only produced here, so
+			// luma-only capture costs nothing extra unless the window is shown.
+			if (RenderMailbox.Consume(OUT RenderFrame, RenderFrame.SequenceNumber))
+				RenderColourImage = RenderFrame.GetColourImage();
+			if (!RenderColourImage.empty())
+				cv::imshow(WindowName, RenderColourImage);
+		}
 
 		// Render any child renderers.
 		for (const auto ChildRenderer : ChildRenderers)
@@ -147,6 +207,9 @@ void FVideoReader::Render()
 
 void FVideoReader::StopRendering()
 {
+	// Executed on game thread.
+
+	UnsubscribeWindow();
 	cv::destroyWindow(WindowName);
 	for (const auto ChildRenderer : ChildRenderers)
 		if (const auto LockedChildRenderer = ChildRenderer.Pin())
@@ -157,26 +220,100 @@ FVideoReader::~FVideoReader()
 {
 	// Executed on game thread.
 	
-	if (Thread)
+	// The hooks can't be called once this has been destroyed.
+	StopThread();
+}
+
+void FVideoReader::ProcessNextFrame(cv::Mat& Frame)
+{
+	// Executed on worker thread.
+
+	// Resizing is done by the capture pipeline (see FCaptureSettings::OutputWidth).
+}
+
+void FVideoReader::PublishFrame(const cv::Mat& Frame, double CaptureTime, double StreamPosition)
+{
+	// Executed on worker thread.
+
+	FVideoFrame PublishedFrame;
+	if (IsPlanarYuv())
+	{
+		// Only a header over the luma plane, no pixels are copied. The full frame is kept for colour conversion.
+		PublishedFrame.Image = Frame.rowRange(0, Frame.rows * 2 / 3);
+		PublishedFrame.SourceImage = Frame;
+		PublishedFrame.SourceConversionCode =
+			OutputFormat == ECaptureOutputFormat::NV12 ? cv::COLOR_YUV2BGR_NV12
+			: OutputFormat == ECaptureOutputFormat::I420 ? cv::COLOR_YUV2BGR_I420
+			: cv::COLOR_YUV2BGR_YV12;
+	}
+	else
 	{
-		Thread->Kill();
-		delete Thread;
-		Thread = nullptr;
+		PublishedFrame.Image = Frame;
 	}
+	PublishedFrame.SequenceNumber = ++FrameSequenceNumber;
+	PublishedFrame.CaptureTime = CaptureTime;
+	PublishedFrame.StreamPosition = StreamPosition;
+	PublishedFrame.PublishTime = FPlatformTime::Seconds();
+	FFrameStageStats::Increment(FrameStats.NumProcessed);
+	INC_DWORD_STAT(STAT_BlinkOpenCV_FramesCaptured);
+
+	for (const TSharedPtr<FFrameMailbox>& FrameMailbox : FrameMailboxes)
+		FrameMailbox->Publish(PublishedFrame);
+
+	// Holding onto the frame would keep its buffer out of the pool for nothing.
+	if (HasFrameSubscribers())
+		RenderMailbox.Publish(PublishedFrame);
 }
 
-void FVideoReader::ProcessNextFrame(cv::Mat& Frame)
+void FVideoReader::WaitForConsumers()
 {
 	// Executed on worker thread.
-	
-	/*if (bResize && ResizeDimensions.X > 2 && ResizeDimensions.Y > 2)
+
+	for (const TSharedPtr<FFrameMailbox>& FrameMailbox : FrameMailboxes)
 	{
-		const auto Resolution = cv::Size(ResizeDimensions.X, ResizeDimensions.Y);
-		cv::cuda::GpuMat CMat;
-		CMat.upload(Frame);
-		cv::cuda::resize(CMat, CMat, Resolution);
-		CMat.download(Frame);
-	}*/
+		// Stop waiting once asked to stop, or if the consumer has gone away since nothing will ever take the frame.
+		while (IsActive() && FrameMailbox.GetSharedReferenceCount() > 1
+			&& !FrameMailbox->WaitUntilConsumed(FrameSequenceNumber, .1))
+		{ }
+	}
+}
+
+void FVideoReader::AdaptRefreshRate()
+{
+	// Executed on worker thread.
+
+	bool bConsumersSaturated = false;
+	for (const TSharedPtr<FFrameMailbox>& FrameMailbox : FrameMailboxes)
+	{
+		// A consumer that has gone away can't be saturated.
+		if (FrameMailbox.GetSharedReferenceCount() > 1 && FrameMailbox->GetConsumedSequenceNumber() < FrameSequenceNumber)
+		{
+			bConsumersSaturated = true;
+			break;
+		}
+	}
+
+	// Back off quickly and recover slowly, so it settles just above the slowest consumer's rate rather than
+	// oscillating around it.
+	if (bConsumersSaturated)
+	{
+		AdaptedRefreshRate = FMath::Min(AdaptedRefreshRate * 1.25f,
+			RefreshRate * FMath::Max(CaptureSettings.MaxRefreshRateScale, 1.f));
+		FFrameStageStats::Increment(FrameStats.NumThrottled);
+	}
+	else
+	{
+		AdaptedRefreshRate = FMath::Max(AdaptedRefreshRate * .9f, RefreshRate);
+	}
+}
+
+TSharedPtr<FFrameMailbox> FVideoReader::CreateFrameMailbox()
+{
+	// Executed on worker thread.
+	
+	TSharedPtr<FFrameMailbox> FrameMailbox = MakeShared<FFrameMailbox>();
+	FrameMailboxes.Add(FrameMailbox);
+	return FrameMailbox;
 }
 
 void FVideoReader::Start()
@@ -202,44 +339,101 @@ bool FVideoReader::HasChildRenderer(TWeakPtr<FRenderable> ChildRenderer) const
 	return ChildRenderers.Contains(ChildRenderer);
 }
 
-void FVideoReader::InitialiseVideoStream()
+TSharedPtr<cv::VideoCapture> FVideoReader::OpenVideoStream(const FString& Pipeline)
+{
+	// Executed on a connection thread.
+
+	TSharedPtr<cv::VideoCapture> OpenedVideoStream = MakeShared<cv::VideoCapture>();
+	if (!OpenedVideoStream->open(TCHAR_TO_UTF8(*Pipeline), cv::CAP_GSTREAMER))
+		return nullptr;
+	
+	// Negotiation is only complete once the first frame arrives, which can take a while.
+	if (!OpenedVideoStream->grab())
+	{
+		UE_LOG(LogBlinkOpenCV, Error, TEXT("VideoReader: VideoStream could not be grabbed"));
+	}
+
+	return OpenedVideoStream;
+}
+
+void FVideoReader::UpdateConnection()
+{
+	// Executed on worker thread.
+
+	switch (ConnectionState)
+	{
+	case EConnectionState::Disconnected:
+		BeginConnecting();
+		break;
+	case EConnectionState::Connecting:
+		if (PendingVideoStream.IsReady())
+		{
+			const TSharedPtr<cv::VideoCapture> OpenedVideoStream = PendingVideoStream.Get();
+			PendingVideoStream.Reset();
+			FinishConnecting(OpenedVideoStream);
+		}
+		break;
+	case EConnectionState::WaitingToReconnect:
+		if (FPlatformTime::Seconds() >= NextConnectionTime)
+			BeginConnecting();
+		break;
+	default:
+		break;
+	}
+}
+
+void FVideoReader::BeginConnecting()
 {
 	// Executed on worker thread.
 	
 	UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Initialising VideoStream"));
 	
 	// Attempts to open the VideoStream with the desired video input device/file.
-	bool bOpened;
-	if (VideoSource.empty())
+	// The appsink only keeps the newest frame, so a slow tick never reads a stale frame from a queue.
+	const FCapturePipelineBuilder PipelineBuilder(CaptureSettings);
+	const FString GPipeline = PipelineBuilder.Build();
+	OutputFormat = PipelineBuilder.GetOutputFormat();
+	ConnectionState = EConnectionState::Connecting;
+
+	// The same pipeline may have already been opened and warmed up when the module started.
+	if (FBlinkOpenCVModule* Module = FBlinkOpenCVModule::GetPtr())
 	{
-		// Works but very low frame rate and long start-up times.
-		// Doesn't use any hardware acceleration.
-		// Performance could be increased by using hardware acceleration (ksvideosrc and NVENC).
-		std::string GPipeline = 
-		std::basic_string("ksvideosrc")
-		+ " ! decodebin"
-		+ " ! videoconvert"
-		+ " ! appsink";
-		bOpened = VideoStream.open(GPipeline, cv::CAP_GSTREAMER);
+		PendingVideoStream = Module->ClaimWarmVideoStream(GPipeline);
+		if (PendingVideoStream.IsValid())
+		{
+			UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Using pre-opened pipeline '%s'"), *GPipeline);
+			return;
+		}
 	}
-	else
+
+	// Opening can take seconds, or hang while a camera is being unplugged, so it's done on its own thread to keep this
+	// one responsive.
+	UE_LOG(LogBlinkOpenCV, Display, TEXT("VideoReader: Opening pipeline '%s'"), *GPipeline);
+	PendingVideoStream = Async(EAsyncExecution::Thread, [GPipeline]()
 	{
-		// Works well and is automatically using some type of hardware acceleration.
-		std::string GPipeline = 
-		"filesrc location=" + std::basic_string(VideoSource)
-		+ " ! decodebin"
-		+ " ! videoconvert"
-		+ " ! appsink";
-		
-		bOpened = VideoStream.open(GPipeline, cv::CAP_GSTREAMER);
-	}
+		return OpenVideoStream(GPipeline);
+	});
+}
+
+void FVideoReader::FinishConnecting(const TSharedPtr<cv::VideoCapture>& OpenedVideoStream)
+{
+	// Executed on worker thread.
 	
-	if (bOpened)
+	if (OpenedVideoStream.IsValid() && OpenedVideoStream->isOpened())
 	{
-		if (!VideoStream.grab())
-		{
-			UE_LOG(LogBlinkOpenCV, Error, TEXT("VideoReader: VideoStream could not be grabbed"));
-		}
+		// Only copies the handle, both refer to the same stream.
+		VideoStream = *OpenedVideoStream;
+		ConnectionState = EConnectionState::Connected;
+		FailedConnectionAttempts = 0;
+		
+		FrameSize = cv::Size(VideoStream.get(cv::CAP_PROP_FRAME_WIDTH), VideoStream.get(cv::CAP_PROP_FRAME_HEIGHT));
+		FrameType = OutputFormat == ECaptureOutputFormat::BGR ? CV_8UC3 : CV_8UC1;
+		StreamFrameRate = VideoStream.get(cv::CAP_PROP_FPS);
+		ReplayStartTime = FPlatformTime::Seconds();
+
+		// Planar YUV frames are delivered with the chroma planes stacked below the luma plane.
+		if (IsPlanarYuv())
+			FrameSize.height = FrameSize.height * 3 / 2;
 
 		PrintVideoStreamProperties();
 		Start();
@@ -249,11 +443,26 @@ void FVideoReader::InitialiseVideoStream()
 		UE_LOG(LogBlinkOpenCV, Error,
 			TEXT("VideoReader: VideoStream could not be initialised. Does it exist or is it being used by another program?"));
 
-		// Prevent constantly trying to initialise the camera as it can cause a lot of stutter.
-		FPlatformProcess::Sleep(1.f);
+		ScheduleReconnect();
 	}
 }
 
+void FVideoReader::ScheduleReconnect()
+{
+	// Executed on worker thread.
+
+	// Prevent constantly trying to initialise the camera as it can cause a lot of stutter, without making a camera
+	// that comes back quickly wait long.
+	const float Delay = FMath::Min(CaptureSettings.ReconnectMinDelay * FMath::Pow(2.f, FMath::Min(FailedConnectionAttempts, 16)),
+		CaptureSettings.ReconnectMaxDelay);
+	FailedConnectionAttempts++;
+	NextConnectionTime = FPlatformTime::Seconds() + Delay;
+	ConnectionState = EConnectionState::WaitingToReconnect;
+	
+	UE_LOG(LogBlinkOpenCV, Warning, TEXT("VideoReader: Reconnecting in %.1fs (attempt %d)"), Delay,
+		FailedConnectionAttempts);
+}
+
 void FVideoReader::PrintVideoStreamProperties() const
 {
 	// Executed on worker thread.
@@ -269,14 +478,4 @@ void FVideoReader::PrintVideoStreamProperties() const
 	int32 Codec = VideoStream.get(cv::CAP_PROP_FOURCC);
 	Output.Appendf(TEXT("\nCodec: %c %c %c %c"), Codec & 255, (Codec >> 8) & 255, (Codec >> 16) & 255, (Codec >> 24) & 255);
 	UE_LOG(LogBlinkOpenCV, Display, TEXT("%s"), *Output);
-}
-
-double FVideoReader::UpdateAndGetDeltaTime()
-{
-	// Executed on worker thread.
-	
-	const double CurrentTime = FPlatformTime::Seconds();
-	const double DeltaTime = CurrentTime - PreviousTime;
-	PreviousTime = CurrentTime;
-	return DeltaTime;
 }
\ No newline at end of file
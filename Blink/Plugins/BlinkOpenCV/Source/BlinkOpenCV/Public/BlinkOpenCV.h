@@ -3,14 +3,47 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Async/Future.h"
 #include "Modules/ModuleManager.h"
 
 DECLARE_LOG_CATEGORY_EXTERN(LogBlinkOpenCV, Log, All);
 
+namespace cv
+{
+	class VideoCapture;
+}
+
 class FBlinkOpenCVModule : public IModuleInterface
 {
 public:
 	/** IModuleInterface implementation */
 	virtual void StartupModule() override;
 	virtual void ShutdownModule() override;
+
+	/**
+	 * @brief Gets the loaded module, or null if it isn't loaded (i.e. during shutdown). Safe to call from any thread.
+	 */
+	static FBlinkOpenCVModule* GetPtr();
+
+	/**
+	 * @brief Takes ownership of the VideoStream opened at startup, if it was opened with the same pipeline.
+	 * The VideoStream may still be opening, hence being returned as a future.
+	 * @return An invalid future if there is no matching VideoStream.
+	 */
+	TFuture<TSharedPtr<cv::VideoCapture>> ClaimWarmVideoStream(const FString& Pipeline);
+
+private:
+	/**
+	 * @brief Starts opening the camera configured in the [BlinkOpenCV] section of the game config, so its slow
+	 * pipeline negotiation is already done when gameplay begins.
+	 */
+	void WarmStartVideoStream();
+
+private:
+	// How long shutdown waits for the pre-opened VideoStream to finish opening before leaving it to its thread (seconds).
+	static constexpr double WarmVideoStreamShutdownTimeout = 1.0;
+
+	FCriticalSection WarmVideoStreamLock;
+	FString WarmPipeline;
+	TFuture<TSharedPtr<cv::VideoCapture>> WarmVideoStream;
 };
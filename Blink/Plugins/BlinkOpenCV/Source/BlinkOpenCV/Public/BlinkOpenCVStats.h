@@ -0,0 +1,68 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+#include <atomic>
+#include "BlinkOpenCV.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Stats/Stats.h"
+#include "Trace/Trace.h"
+
+/**
+ * Instrumentation for the capture and detection pipeline.
+ *
+ * Every stage a frame goes through is both a CPU profiler event on the BlinkOpenCV trace channel and a cycle stat, so
+ * a trace (-trace=cpu,blinkopencv) shows where each frame's time goes on the thread that spent it, while "stat
+ * BlinkOpenCV" shows the per-stage averages and how many frames were captured, dropped and processed.
+ */
+UE_TRACE_CHANNEL_EXTERN(BlinkOpenCVChannel, BLINKOPENCV_API);
+
+DECLARE_STATS_GROUP(TEXT("BlinkOpenCV"), STATGROUP_BlinkOpenCV, STATCAT_Advanced);
+
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Frames Captured"), STAT_BlinkOpenCV_FramesCaptured, STATGROUP_BlinkOpenCV,
+	BLINKOPENCV_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Frames Dropped"), STAT_BlinkOpenCV_FramesDropped, STATGROUP_BlinkOpenCV,
+	BLINKOPENCV_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Frames Processed"), STAT_BlinkOpenCV_FramesProcessed,
+	STATGROUP_BlinkOpenCV, BLINKOPENCV_API);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Read"), STAT_BlinkOpenCV_Read, STATGROUP_BlinkOpenCV, BLINKOPENCV_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Publish"), STAT_BlinkOpenCV_Publish, STATGROUP_BlinkOpenCV, BLINKOPENCV_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Detect"), STAT_BlinkOpenCV_Detect, STATGROUP_BlinkOpenCV, BLINKOPENCV_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Preprocess"), STAT_BlinkOpenCV_Preprocess, STATGROUP_BlinkOpenCV, BLINKOPENCV_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Face"), STAT_BlinkOpenCV_Face, STATGROUP_BlinkOpenCV, BLINKOPENCV_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Eyes"), STAT_BlinkOpenCV_Eyes, STATGROUP_BlinkOpenCV, BLINKOPENCV_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Temporal Filter"), STAT_BlinkOpenCV_TemporalFilter, STATGROUP_BlinkOpenCV,
+	BLINKOPENCV_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Render"), STAT_BlinkOpenCV_Render, STATGROUP_BlinkOpenCV, BLINKOPENCV_API);
+
+/**
+ * @brief Times the rest of the enclosing scope as the given stage, i.e. BLINKOPENCV_SCOPE(Face) for STAT_BlinkOpenCV_Face.
+ */
+#define BLINKOPENCV_SCOPE(StageName) \
+	TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(BlinkOpenCV_##StageName, BlinkOpenCVChannel); \
+	SCOPE_CYCLE_COUNTER(STAT_BlinkOpenCV_##StageName)
+
+/**
+ * @brief Logs to LogBlinkOpenCV at most once a second from this call site, for code that runs every frame.
+ * Costs nothing more than a branch unless the verbosity is enabled. Safe to call from any thread.
+ */
+#define BLINKOPENCV_LOG_RATE_LIMITED(Verbosity, Format, ...) \
+	do \
+	{ \
+		if (UE_LOG_ACTIVE(LogBlinkOpenCV, Verbosity)) \
+		{ \
+			static std::atomic<double> BlinkOpenCVLastLogTime = -1.0; \
+			const double BlinkOpenCVLogTime = FPlatformTime::Seconds(); \
+			double BlinkOpenCVPreviousLogTime = BlinkOpenCVLastLogTime.load(std::memory_order_relaxed); \
+			if ((BlinkOpenCVPreviousLogTime < 0 || BlinkOpenCVLogTime - BlinkOpenCVPreviousLogTime >= 1.0) \
+				&& BlinkOpenCVLastLogTime.compare_exchange_strong(BlinkOpenCVPreviousLogTime, BlinkOpenCVLogTime, \
+					std::memory_order_relaxed)) \
+			{ \
+				UE_LOG(LogBlinkOpenCV, Verbosity, Format, ##__VA_ARGS__); \
+			} \
+		} \
+	} \
+	while (false)
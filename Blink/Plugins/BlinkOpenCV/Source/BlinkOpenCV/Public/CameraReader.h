@@ -4,9 +4,68 @@
 
 #pragma once
 
+#include "FrameStageStats.h"
+#include "LatencyStats.h"
+#include "ThreadScheduling.h"
 #include "CameraReader.generated.h"
 
+class FEyeDetector;
 class FVideoReader;
+struct FEyeEvent;
+enum class EImageBackend : uint8;
+
+/**
+ * @brief EThreadPriority, for Blueprints.
+ */
+UENUM(BlueprintType)
+enum class EBlinkThreadPriority : uint8
+{
+	Lowest,
+	BelowNormal,
+	SlightlyBelowNormal,
+	Normal,
+	AboveNormal,
+	Highest,
+	TimeCritical
+};
+
+/**
+ * @brief EImageBackend, for Blueprints.
+ */
+UENUM(BlueprintType)
+enum class EBlinkImageBackend : uint8
+{
+	Auto,
+	Cuda,
+	Cpu
+};
+
+/**
+ * @brief A snapshot of FFrameStageStats for Blueprints.
+ */
+USTRUCT(BlueprintType)
+struct BLINKOPENCV_API FBlinkFrameStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category="Stats")
+	int64 NumProcessed = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category="Stats")
+	int64 NumSuperseded = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category="Stats")
+	int64 NumExpired = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category="Stats")
+	int64 NumOverBudget = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category="Stats")
+	int64 NumThrottled = 0;
+
+	static FBlinkFrameStats FromStageStats(const FFrameStageStats& Stats);
+};
+
 /**
  * @brief Use Activate() to establish the connection to a VideoStream.
  * 
@@ -46,13 +105,61 @@ public:
 	 */
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Camera", meta = (EditCondition="bUseCamera", EditConditionHides))
 	int32 CameraIndex;
+
+	/**
+	 * @brief The resolution to request from the camera. Should be one of the camera's native modes. (0, 0) lets the
+	 * camera pick.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Camera", meta = (EditCondition="bUseCamera", EditConditionHides))
+	FIntPoint CaptureResolution;
+
+	/**
+	 * @brief The framerate to request from the camera. 0 lets the camera pick.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Camera", meta = (EditCondition="bUseCamera", EditConditionHides, ClampMin=0))
+	int32 CaptureFrameRate;
+
+	/**
+	 * @brief The pixel format to request from the camera, i.e. YUY2, NV12 or MJPG. Empty lets the camera pick.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Camera", meta = (EditCondition="bUseCamera", EditConditionHides))
+	FString CapturePixelFormat;
+
+	/**
+	 * @brief If enabled, only the luminance of each frame is captured since the eye detector works in greyscale.
+	 * Requesting NV12, I420 or YV12 as the CapturePixelFormat avoids any conversion. The colour frame is only produced
+	 * when shown in a separate window.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Camera")
+	bool bCaptureLumaOnly;
+
+	/**
+	 * @brief If enabled, the VideoStream will use a generated test pattern instead of a video file. Useful for running
+	 * the pipeline without a camera.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Camera", meta = (EditCondition="!bUseCamera", EditConditionHides))
+	bool bUseTestPattern;
 	
 	/**
 	 * @brief The location of the video file to use.
 	 */
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Camera", meta = (EditCondition="!bUseCamera", EditConditionHides))
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Camera", meta = (EditCondition="!bUseCamera && !bUseTestPattern", EditConditionHides))
 	FString VideoFileLocation;
 
+	/**
+	 * @brief If enabled, the video file is played back as fast as the eye detector can process it without dropping
+	 * frames, rather than in real-time. Useful for evaluating accuracy and throughput over test videos.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Camera", meta = (EditCondition="!bUseCamera && !bUseTestPattern", EditConditionHides))
+	bool bReplayUnthrottled;
+
+	/**
+	 * @brief If enabled, the VideoReader reads less often while the eye detector can't keep up, rather than producing
+	 * frames that are never processed.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Camera")
+	bool bAdaptCaptureRate;
+
 	/**
 	 * @brief Should the frame from the VideoStream be resized? Usually used to forcefully lower the resolution to make
 	 * processing cheaper.
@@ -62,6 +169,7 @@ public:
 	
 	/**
 	 * @brief The dimensions to resize the frame to. Will only resize if bResize is enabled.
+	 * The resize is done inside the capture pipeline, so detectors expecting this size don't have to resize again.
 	 */
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Camera", meta = (EditCondition="bResize", EditConditionHides))
 	FVector2D ResizeDimensions;
@@ -79,12 +187,6 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Camera", meta = (EditCondition="bShowInSeparateWindow", EditConditionHides))
 	FString WindowName;
 
-	/**
-	 * @brief The tick rate of the VideoReader thread.
-	 */
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes", meta = (ClampMin=0.f, ClampMax=1.f))
-	float EyeSampleRate;
-	
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes", meta = (ClampMin=0.f, ClampMax=1.f))
 	double BlinkResetTime;
 
@@ -94,22 +196,184 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes", meta = (ClampMin=0.f, ClampMax=1.f))
 	double ConsiderAsOpenTime;
 
+	/**
+	 * @brief If enabled, the eye detector thread is woken as soon as the VideoReader publishes a new frame. Otherwise,
+	 * it polls for new frames at its own refresh rate. Only disable to compare latency.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes")
+	bool bWakeDetectorOnNewFrame;
+
+	/**
+	 * @brief The longest the eye detector thread will wait for a new frame before ticking anyway.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes", meta = (EditCondition="bWakeDetectorOnNewFrame", EditConditionHides, ClampMin=0.f, ClampMax=1.f))
+	float DetectorFrameWaitTimeout;
+
+	/**
+	 * @brief The eye detector's latency budget, from a frame being captured to it being processed (seconds). Late
+	 * frames are skipped in favour of newer ones where possible, except when replaying. 0 disables the deadline.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes", meta = (ClampMin=0.f, ClampMax=1.f))
+	float DetectorFrameDeadline;
+
+	/**
+	 * @brief If enabled, the eye detector's preprocessing, face detection, eye detection and temporal filtering each run
+	 * on their own thread, so consecutive frames are processed in parallel. Disable to process each frame on one thread.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes")
+	bool bSplitDetectorIntoStages;
+
+	/**
+	 * @brief How many frames the eye detector processes at the same time, each on its own worker thread with its own
+	 * classifiers. Results are still applied in capture order. More than 1 is used instead of splitting into stages.
+	 * Applied on activation.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes", meta = (ClampMin=1, ClampMax=16))
+	int32 DetectorWorkers;
 
+	/**
+	 * @brief If enabled, the eye detector has no threads of its own and each frame is processed by a chain of tasks on
+	 * the engine's worker threads, so it costs nothing while there are no frames. Otherwise, it uses dedicated threads.
+	 * Compare the two with CompareDetectorExecutionModes. Applied on activation.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes")
+	bool bRunDetectorOnTasks;
+
+	/**
+	 * @brief If enabled, the eye detector only searches the whole frame for the face every FaceRedetectInterval frames,
+	 * and follows it in between, which is much cheaper. Compare face detection and tracking times in the log, and the
+	 * blink and wink counts after replaying the same clip with it enabled and disabled. Applied on activation.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes")
+	bool bTrackFace;
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes", meta = (EditCondition="bTrackFace", EditConditionHides, ClampMin=1, ClampMax=120))
+	int32 FaceRedetectInterval;
+
+	/**
+	 * @brief Where the eye detector preprocesses frames and runs its networks. Auto uses CUDA if there's a CUDA device
+	 * and the CPU otherwise; the log says which was picked. Applied on activation.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes")
+	EBlinkImageBackend ImageBackend;
+
+	/**
+	 * @brief If enabled, the eye detector evaluates its face and eye cascades from tables compiled into the plugin, which
+	 * finds the same faces and eyes as cv::CascadeClassifier in less time. Applied on activation.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes")
+	bool bUseCompiledCascades;
+
+	/**
+	 * @brief If enabled, the eye detector also runs cv::CascadeClassifier on every search, and logs how long each took
+	 * and how often they disagreed when it stops. Applied on activation.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes", meta = (EditCondition="bUseCompiledCascades"))
+	bool bBenchmarkCompiledCascades;
+
+	/**
+	 * @brief If enabled, the eye detector scales each frame down for its face cascade before the face stage, rather than
+	 * in it. Only pays off with bTrackFace off and bSplitDetectorIntoStages on, since the frame is scaled down even
+	 * when the face is tracked rather than searched for. Applied on activation.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes", meta = (EditCondition="bUseCompiledCascades"))
+	bool bShareCascadePyramid;
+
+	/**
+	 * @brief If enabled, OnBlink, OnLeftEyeWink, OnRightEyeWink and OnBothOpen are dispatched on the game thread as soon
+	 * as the eye detector commits a change, rather than on the next tick. Changes arriving within one frame are
+	 * dispatched together. Compare the two with GetDispatchLatencyPercentile.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Eyes")
+	bool bDispatchEyeEventsImmediately;
+
+	/**
+	 * @brief If enabled, the VideoReader and eye detector threads are given priorities and cores based on the number of
+	 * cores, leaving the first two to the game and render threads. Otherwise, the priorities and affinities below are
+	 * used. Check each thread's scheduling delay in the log to verify the effect. Applied on activation.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Threads")
+	bool bAutoThreadScheduling;
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Threads", meta = (EditCondition="!bAutoThreadScheduling", EditConditionHides))
+	EBlinkThreadPriority CaptureThreadPriority;
+
+	/**
+	 * @brief A bit per logical processor the VideoReader thread may run on. 0 lets it run on any of them.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Threads", meta = (EditCondition="!bAutoThreadScheduling", EditConditionHides))
+	int64 CaptureThreadAffinity;
+
+	/**
+	 * @brief The priority of the eye detector thread, and of any stage or worker threads it creates.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Threads", meta = (EditCondition="!bAutoThreadScheduling", EditConditionHides))
+	EBlinkThreadPriority DetectorThreadPriority;
+
+	/**
+	 * @brief A bit per logical processor the eye detector's threads may run on. 0 lets them run on any of them.
+	 * Ignored when running on tasks.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category="Threads", meta = (EditCondition="!bAutoThreadScheduling", EditConditionHides))
+	int64 DetectorThreadAffinity;
+
+
+	// Onset times of the last blink and wink events that fired.
 	double PreviousBlinkTime;
 	double PreviousLeftWinkTime;
 	double PreviousRightWinkTime;
 	bool bWasOpenLast = false;
 
+	// Whether the last eye event consumed was both eyes opening, and its onset time.
+	bool bEyesOpen = true;
+	double EyesOpenTime = 0;
+
 	int32 BlinkCount;
 	int32 LeftWinkCount;
 	int32 RightWinkCount;
 
 	bool bVideoActive;
 
+	/**
+	 * @brief How old the source frame was when the last blink or wink event fired (seconds), measured from the moment
+	 * the frame was captured.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Eyes")
+	double LastEventLatency;
+
+	/**
+	 * @brief How strongly the eye detector agreed with the last blink or wink event that fired, from 0 to 1.
+	 */
+	UPROPERTY(BlueprintReadOnly, Category="Eyes")
+	float LastEventConfidence;
+
 protected:
 	FVideoReader* VideoReader;
 
-	FTimerHandle EyeSampleTimer;
+	// Capture-to-event latency of every blink and wink event since activation.
+	FLatencyStats EventLatency;
+
+	// Time from the eye detector committing an event to it firing, for every blink and wink event since activation.
+	FLatencyStats DispatchLatency;
+
+	// The eye detector events are dispatched for as soon as they are committed. Only used when dispatching immediately.
+	TWeakPtr<FEyeDetector> DispatchingEyeDetector;
+
+	// Fires OnBothOpen once the eyes have been open for ConsiderAsOpenTime. Only used when dispatching immediately.
+	FTimerHandle BothOpenTimer;
+
+	// The game thread's time of every frame since activation, to compare the detector's execution modes.
+	FLatencyStats GameThreadTime;
+	FDelegateHandle EndFrameHandle;
+
+	// Only used by CompareDetectorExecutionModes. Fires once each mode has been measured for long enough, which starts
+	// once the mode has processed its first frame, the game thread time measured with dedicated threads, and the mode
+	// to go back to afterwards.
+	FTimerHandle ExecutionModeTimer;
+	float SecondsPerExecutionMode = 0.f;
+	bool bAwaitingExecutionModeStart = false;
+	FString DedicatedThreadsGameThreadTime;
+	bool bRunDetectorOnTasksBeforeComparison = false;
 
 public:
 	// Overriden so the VideoStream can be stopped and released upon Destroy. 
@@ -123,11 +387,95 @@ public:
 	 */
 	static void PrintOpenCVBuildInfo();
 
+	/**
+	 * @brief Gets the capture-to-event latency that the given percentage of recent blink and wink events were at or
+	 * below (seconds).
+	 * @param Percentile Between 0 and 100, i.e. 95 for the 95th percentile.
+	 */
+	UFUNCTION(BlueprintPure, Category="Eyes")
+	double GetEventLatencyPercentile(float Percentile) const { return EventLatency.GetPercentileSeconds(Percentile); }
+
+	/**
+	 * @brief Gets the time from the eye detector committing an event to it firing that the given percentage of recent
+	 * blink and wink events were at or below (seconds). Shows what bDispatchEyeEventsImmediately saves.
+	 * @param Percentile Between 0 and 100, i.e. 95 for the 95th percentile.
+	 */
+	UFUNCTION(BlueprintPure, Category="Eyes")
+	double GetDispatchLatencyPercentile(float Percentile) const { return DispatchLatency.GetPercentileSeconds(Percentile); }
+
+	/**
+	 * @brief Gets the game thread time that the given percentage of recent frames were at or below (seconds), as shown
+	 * by "stat unit". Used to measure how much the VideoReader and eye detector slow the game down.
+	 * @param Percentile Between 0 and 100, i.e. 95 for the 95th percentile.
+	 */
+	UFUNCTION(BlueprintPure, Category="Eyes")
+	double GetGameThreadTimePercentile(float Percentile) const { return GameThreadTime.GetPercentileSeconds(Percentile); }
+
+	/**
+	 * @brief Runs the eye detector on dedicated threads and then on tasks, restarting the VideoReader for each, and logs
+	 * the game thread time under both side by side. Each mode is measured from its first processed frame, so
+	 * reconnecting and warming up aren't counted. Play a video file in real time (not bReplayUnthrottled) so both modes
+	 * see the same scene. bRunDetectorOnTasks is put back afterwards.
+	 * @param SecondsPerMode How long to measure each mode for.
+	 */
+	UFUNCTION(BlueprintCallable, Category="Eyes")
+	void CompareDetectorExecutionModes(float SecondsPerMode = 30.f);
+
+	/**
+	 * @brief What happened to the frames at the capture stage since activation.
+	 */
+	UFUNCTION(BlueprintPure, Category="Camera")
+	FBlinkFrameStats GetCaptureFrameStats() const;
+
+	/**
+	 * @brief What happened to the frames at the eye detector since activation. A growing number of superseded,
+	 * expired or over budget frames means the detector isn't keeping up.
+	 */
+	UFUNCTION(BlueprintPure, Category="Eyes")
+	FBlinkFrameStats GetDetectorFrameStats() const;
+
 protected:
 	void Stop();
 
-	UFUNCTION()
-	void OnEyeSampleTick();
+	/**
+	 * @brief Records how old the source frame of an event is, and how long ago it was committed, just before the event
+	 * fires.
+	 */
+	void RecordEventLatency(const FEyeEvent& Event);
+
+	/**
+	 * @brief Has the eye detector queue a dispatch of its events on the game thread whenever it commits one, if it
+	 * isn't already.
+	 */
+	void BindEyeEventDispatch(const TSharedPtr<FEyeDetector>& EyeDetector);
+
+	/**
+	 * @brief Stops the eye detector bound by BindEyeEventDispatch from queueing dispatches, if it still exists.
+	 */
+	void UnbindEyeEventDispatch();
+
+	/**
+	 * @brief Records the game thread time of the frame that just ended. While comparing execution modes, waits for the
+	 * mode to process its first frame, then starts timing how long it's been measured for.
+	 */
+	void RecordGameThreadTime();
+
+	/**
+	 * @brief Called by CompareDetectorExecutionModes once the current mode has been measured for long enough. Moves on
+	 * to tasks after dedicated threads, and logs both after tasks.
+	 */
+	void OnExecutionModeMeasured();
+
+	FThreadSchedulingSettings GetCaptureScheduling() const;
+	FThreadSchedulingSettings GetDetectorScheduling() const;
+	static EThreadPriority ToThreadPriority(EBlinkThreadPriority Priority);
+	static EImageBackend ToImageBackend(EBlinkImageBackend Backend);
+
+	/**
+	 * @brief Takes every eye event the eye detector pushed since the last tick, in order, and fires the matching
+	 * Blueprint events.
+	 */
+	void ConsumeEyeEvents();
 
 	UFUNCTION(BlueprintNativeEvent)
 	void OnBlink();
@@ -0,0 +1,173 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+#include "ThreadScheduling.h"
+
+enum class ECaptureSource : uint8
+{
+	Camera,
+	File,
+	TestPattern
+};
+
+enum class ECaptureOutputFormat : uint8
+{
+	BGR,
+	Gray,
+	// Planar YUV 4:2:0 formats, delivered as a single-channel image with the luma plane in the top two thirds.
+	NV12,
+	I420,
+	YV12
+};
+
+/**
+ * @brief Describes where a VideoReader gets its frames from and how the capture pipeline is configured.
+ */
+struct BLINKOPENCV_API FCaptureSettings
+{
+	ECaptureSource Source = ECaptureSource::Camera;
+
+	/**
+	 * @brief The index of the camera device. Only used by ECaptureSource::Camera.
+	 */
+	int32 CameraIndex = 0;
+
+	/**
+	 * @brief The location of the video file. Only used by ECaptureSource::File.
+	 */
+	FString FilePath;
+
+	/**
+	 * @brief The resolution and framerate to request from the source. 0 lets the source pick.
+	 * Ideally one of the camera's native modes, otherwise the camera may scale or fail to negotiate.
+	 */
+	int32 Width = 0;
+	int32 Height = 0;
+	int32 FrameRate = 0;
+
+	/**
+	 * @brief The GStreamer name of the pixel format to request from the camera (i.e. YUY2, NV12 or MJPG).
+	 * Empty lets the camera pick.
+	 */
+	FString PixelFormat;
+
+	/**
+	 * @brief If enabled, only the luminance of each frame is captured, for detectors that work in greyscale.
+	 * If the camera already delivers NV12, I420 or YV12, the frame is passed through unconverted and its luma plane is
+	 * used directly. Otherwise, it is converted to GRAY8.
+	 */
+	bool bLumaOnly = false;
+
+	/**
+	 * @brief The resolution to scale frames to inside the pipeline, before they are converted or copied out.
+	 * 0 keeps the source's resolution.
+	 */
+	int32 OutputWidth = 0;
+	int32 OutputHeight = 0;
+
+	/**
+	 * @brief If enabled, the appsink discards old frames instead of queuing them once MaxBufferedFrames is reached.
+	 */
+	bool bDropFrames = true;
+
+	/**
+	 * @brief The most frames the appsink will hold before dropping or blocking.
+	 */
+	int32 MaxBufferedFrames = 1;
+
+	/**
+	 * @brief If enabled, frames are released at their presentation time rather than as soon as they are ready.
+	 * Live sources are already paced so should leave this disabled.
+	 */
+	bool bSyncToClock = false;
+
+	/**
+	 * @brief If enabled, the VideoReader isn't paced by its refresh rate and instead waits for every consumer to take
+	 * each frame before reading the next. Only makes sense for files.
+	 */
+	bool bReplay = false;
+
+	/**
+	 * @brief If enabled, the VideoReader reads less often while a consumer is saturated (i.e. still busy with an older
+	 * frame when the next one is due), down to MaxRefreshRateScale times its refresh rate, and speeds back up once the
+	 * consumer catches up. Not used when replaying, which waits for every consumer instead.
+	 */
+	bool bAdaptRefreshRate = true;
+	float MaxRefreshRateScale = 4.f;
+
+	/**
+	 * @brief How long to wait before trying to reopen the source after it failed to open or was lost (seconds).
+	 * The delay doubles after every failed attempt, up to ReconnectMaxDelay.
+	 */
+	float ReconnectMinDelay = .5f;
+	float ReconnectMaxDelay = 8.f;
+
+	/**
+	 * @brief The priority and affinity of the VideoReader thread.
+	 */
+	FThreadSchedulingSettings Scheduling;
+
+	static FCaptureSettings Camera(int32 InCameraIndex);
+
+	/**
+	 * @brief Plays back a video file at its own framerate, as if it were a camera.
+	 */
+	static FCaptureSettings File(const FString& InFilePath);
+
+	/**
+	 * @brief Plays back a video file as fast as the consumers can keep up, without dropping any frames.
+	 * Used for offline evaluation.
+	 */
+	static FCaptureSettings Replay(const FString& InFilePath);
+
+	/**
+	 * @brief A generated live source, useful to exercise and benchmark the pipeline without a camera.
+	 */
+	static FCaptureSettings TestPattern(int32 InWidth = 1280, int32 InHeight = 720, int32 InFrameRate = 30);
+};
+
+/**
+ * @brief Builds the GStreamer pipeline description used to open a cv::VideoCapture for the given FCaptureSettings.
+ *
+ * Pipelines are of the form: source ! [source caps] ! [decode] ! [videoscale ! scale caps] ! videoconvert ! output caps
+ * ! appsink.
+ */
+class BLINKOPENCV_API FCapturePipelineBuilder
+{
+public:
+	explicit FCapturePipelineBuilder(const FCaptureSettings& InSettings);
+
+	/**
+	 * @brief Creates the pipeline description, to be opened with cv::CAP_GSTREAMER.
+	 */
+	FString Build() const;
+
+	/**
+	 * @brief The format of the frames the appsink will deliver.
+	 */
+	ECaptureOutputFormat GetOutputFormat() const;
+
+private:
+	FString GetSourceElement() const;
+	FString GetSourceCaps() const;
+	FString GetDecodeElements() const;
+	FString GetScaleElements() const;
+	FString GetOutputCaps() const;
+	FString GetSinkElement() const;
+
+	/**
+	 * @brief Is the source requesting compressed JPEG frames rather than raw video?
+	 */
+	bool IsJpegFormat() const;
+
+	/**
+	 * @brief Appends any requested width, height and framerate fields to Caps.
+	 */
+	void AppendDimensionCaps(FString& Caps) const;
+
+private:
+	FCaptureSettings Settings;
+};
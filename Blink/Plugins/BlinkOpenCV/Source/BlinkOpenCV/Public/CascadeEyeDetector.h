@@ -4,6 +4,7 @@
 
 #pragma once
 #include "EyeDetector.h"
+#include "HaarCascadeEvaluator.h"
 
 /**
  * @brief My first implementation of an eye detector using Haar cascades.
@@ -15,34 +16,182 @@
 class BLINKOPENCV_API FCascadeEyeDetector : public FEyeDetector
 {
 public:
-	FCascadeEyeDetector(FVideoReader* InVideoReader);
+	FCascadeEyeDetector(FVideoReader* InVideoReader, const FFeatureDetectorSettings& InSettings = FFeatureDetectorSettings());
 	virtual ~FCascadeEyeDetector() override;
+
+	virtual void OnStop() override;
 	
 protected:
-	virtual uint32 ProcessNextFrame(cv::Mat& Frame, const double& DeltaTime) override;
+	/**
+	 * @brief A face followed from frame to frame between full detections, and how well following it went.
+	 * Only used by one worker.
+	 */
+	struct FFaceTrack
+	{
+		// Where the face was in the last frame, and what it looked like when the cascade last found it, scaled down to
+		// FaceTemplateWidth. No template means there's no face to follow.
+		cv::Rect Face;
+		cv::Mat Template;
+		float TemplateScale = 1.f;
+
+		// Frames the face has been followed for since the cascade last found it.
+		int32 NumTrackedFrames = 0;
+
+		// Reused every frame so they aren't reallocated.
+		cv::Mat SearchImage;
+		cv::Mat MatchScores;
+
+		// Time spent finding the face with each method.
+		FLatencyStats DetectTime;
+		FLatencyStats TrackTime;
+
+		int32 NumDetected = 0;
+		int32 NumMissed = 0;
+		int32 NumLost = 0;
+
+		// Overlap (intersection over union) between where the face was followed to and where the cascade found it next,
+		// to see how far tracking drifts.
+		double TotalDriftOverlap = 0;
+		int32 NumDriftSamples = 0;
+	};
+
+	/**
+	 * @brief Where an eye was last found, so the next frame only has to search closely around it.
+	 * Only used by one worker.
+	 */
+	struct FEyePrior
+	{
+		// Relative to the face, so it moves with it. Empty if the eye hasn't been found yet.
+		cv::Rect Eye;
+
+		// Frames in a row the eye hasn't been found in since.
+		int32 NumMissedFrames = 0;
+
+		// How many times the eye was searched for around where it was, or in the whole area where eyes usually are.
+		int32 NumPriorSearches = 0;
+		int32 NumAreaSearches = 0;
+	};
+
+	enum class ECascade : uint8
+	{
+		Face,
+		Eye
+	};
+
+	/**
+	 * @brief How long the compiled cascade and cv::CascadeClassifier took to search the same images, and how many times
+	 * they found different objects. Only used by one worker. See FFeatureDetectorSettings::bBenchmarkCompiledCascades.
+	 */
+	struct FCascadeBenchmark
+	{
+		FLatencyStats CompiledTime;
+		FLatencyStats ClassifierTime;
+		int32 NumMismatches = 0;
+	};
+
+	virtual void PreprocessFrame(FEyeDetectionWork& Work) override;
+	virtual void DetectFace(FEyeDetectionWork& Work) const override;
+	virtual void DetectEyes(FEyeDetectionWork& Work) const override;
+	virtual void FilterEyeStatus(FEyeDetectionWork& Work) override;
+
+	/**
+	 * @brief Finds the face, by following the face found in earlier frames if possible and with the face cascade
+	 * otherwise. See FFeatureDetectorSettings::bTrackFace.
+	 * @param Pyramid The frame's, if the preprocess stage built one.
+	 */
+	virtual cv::Rect GetFace(const cv::Mat& Frame, const FHaarPyramid& Pyramid, int32 WorkerIndex,
+	                         FFrameAnnotations& Annotations) const;
+
+	/**
+	 * @brief Searches the whole frame for a face with the face cascade.
+	 */
+	virtual cv::Rect DetectFaceWithCascade(const cv::Mat& Frame, const FHaarPyramid& Pyramid, int32 WorkerIndex,
+	                                       FFrameAnnotations& Annotations) const;
+
+	/**
+	 * @brief Follows the track's face to where it best matches its template, within an area around where it was.
+	 * @param OutScore How well the match correlates with the template, from -1 to 1.
+	 * @return The face at its new position, the same size as before, or an empty rect if it couldn't be searched for.
+	 */
+	cv::Rect TrackFace(const cv::Mat& Frame, FFaceTrack& Track, float& OutScore) const;
+
+	/**
+	 * @brief Starts following Face from this frame onwards.
+	 */
+	void ResetFaceTrack(const cv::Mat& Frame, const cv::Rect& Face, FFaceTrack& Track) const;
 
-	virtual cv::Rect GetFace(const cv::Mat& Frame) const;
 	virtual void FilterFaces(const cv::Mat& Frame, std::vector<cv::Rect>& Faces) const;
-	virtual void GetEyes(const cv::Mat& Frame, const cv::Rect& Face, cv::Rect& LeftEye, cv::Rect& RightEye) const;
+
+	/**
+	 * @brief Searches Area of the frame with the face or eye cascade, compiled into the plugin if bUseCompiledCascades is
+	 * enabled and with cv::CascadeClassifier otherwise. Otherwise takes the same parameters as
+	 * cv::CascadeClassifier::detectMultiScale.
+	 * @param Pyramid The frame's, read by the compiled cascades instead of scaling the area down themselves. Ignored if
+	 * null or empty, which it always is while benchmarking.
+	 * @param Objects Relative to Area.
+	 */
+	void DetectMultiScale(ECascade Cascade, const cv::Mat& Frame, const FHaarPyramid* Pyramid, const cv::Rect& Area,
+	                      std::vector<cv::Rect>& Objects, double ScaleFactor, int32 MinNeighbors, const cv::Size& MinSize,
+	                      const cv::Size& MaxSize, int32 WorkerIndex) const;
+
+	/**
+	 * @brief Scales the frame down to every size the face search can look at it, ahead of the face stage.
+	 * See FFeatureDetectorSettings::bShareCascadePyramid.
+	 */
+	void BuildPyramid(const cv::Mat& Frame, FHaarPyramid& Pyramid, int32 WorkerIndex);
+
+	/**
+	 * @brief Finds each eye within the face, around where it was last found if possible (see FEyePrior), and in the
+	 * area where eyes usually are otherwise.
+	 * @param LeftEyeArea, RightEyeArea Set to where each eye was searched for. The eyes are relative to them.
+	 */
+	virtual void GetEyes(const cv::Mat& Frame, const cv::Rect& Face, cv::Rect& LeftEyeArea, cv::Rect& RightEyeArea,
+	                     cv::Rect& LeftEye, cv::Rect& RightEye, int32 WorkerIndex, FFrameAnnotations& Annotations) const;
 	virtual void FilterEyes(std::vector<cv::Rect>& LeftEyes, std::vector<cv::Rect>& RightEyes, const cv::Rect& Face) const;
 
 	static void TrimFaceToEyes(const cv::Rect& Face, cv::Rect& LeftEyeArea, cv::Rect& RightEyeArea);
+
+	/**
+	 * @brief Narrows the search for an eye down to a window around where it was last found, and to the sizes one step
+	 * of the scale pyramid either side of its last size. Leaves the search as it is if the eye has been missing for
+	 * more than MaxMissedEyeFrames, or was never found.
+	 */
+	void NarrowEyeSearch(const cv::Rect& Face, FEyePrior& Prior, cv::Rect& EyeArea, cv::Size& MinSize,
+	                     cv::Size& MaxSize) const;
+
+	/**
+	 * @brief Remembers where the eye was found this frame, or that it wasn't.
+	 * @param Eye Relative to EyeArea. Empty if it wasn't found.
+	 */
+	static void UpdateEyePrior(FEyePrior& Prior, const cv::Rect& Face, const cv::Rect& EyeArea, const cv::Rect& Eye);
+
+	/**
+	 * @brief Picks out the detections from one pass over the band covering both eye areas that the eye's own search
+	 * could have made, i.e. those entirely within EyeArea and between MinSize and MaxSize, and groups them on their
+	 * own. The windows in the band are laid out from its corner rather than the area's, so they can land a pixel or
+	 * two away from those the eye's own search would test.
+	 * @param BandEyes Relative to EyeBand, and not grouped.
+	 * @param OutEyes Relative to EyeArea.
+	 */
+	static void GetEyesInArea(const std::vector<cv::Rect>& BandEyes, const cv::Rect& EyeBand, const cv::Rect& EyeArea,
+	                          const cv::Size& MinSize, const cv::Size& MaxSize, int32 MinNeighbors,
+	                          std::vector<cv::Rect>& OutEyes);
+
 	static bool IsEyeTooLarge(const cv::Rect& Eye, const cv::Rect& Face);
 
-	void DrawPreFilteredFaces(const cv::Mat& Frame, const std::vector<cv::Rect>& Faces) const;
-	void DrawFace(const cv::Mat& Frame, const cv::Rect& Face) const;
-	void DrawEyeArea(const cv::Mat& Frame, const cv::Rect& EyeArea) const;
-	void DrawPreFilteredEyes(const cv::Mat& Frame, const cv::Rect& EyeArea, const std::vector<cv::Rect>& Eyes) const;
-	void DrawEye(const cv::Mat& Frame, const cv::Rect& EyeArea, const cv::Rect& Eye) const;
+	static void AnnotatePreFilteredFaces(FFrameAnnotations& Annotations, const std::vector<cv::Rect>& Faces);
+	static void AnnotateFace(FFrameAnnotations& Annotations, const cv::Rect& Face);
+	static void AnnotateTrackedFace(FFrameAnnotations& Annotations, const cv::Rect& Face, float Score);
+	static void AnnotateEyeArea(FFrameAnnotations& Annotations, const cv::Rect& EyeArea);
+	static void AnnotatePreFilteredEyes(FFrameAnnotations& Annotations, const cv::Rect& EyeArea,
+	                                    const std::vector<cv::Rect>& Eyes);
+	static void AnnotateEye(FFrameAnnotations& Annotations, const cv::Rect& EyeArea, const cv::Rect& Eye);
 
-	virtual EEyeStatus GetEyeStatusFromFrame(const cv::Mat& Frame) const override;
 	void UpdateEyeState(EEyeStatus FrameEyeStatus, const double& DeltaTime);
 	EEyeStatus GetEyeStatusWithError(EEyeStatus FrameEyeStatus) const;
 
-	TWeakPtr<cv::CascadeClassifier> GetFaceClassifier() const { return FaceClassifier; }
-	TWeakPtr<cv::CascadeClassifier> GetEyeClassifier() const { return EyeClassifier; }
-	TWeakPtr<cv::Ptr<cv::cuda::Filter>> GetBlurFilter() const { return BlurFilter; }
-	TWeakPtr<cv::Ptr<cv::cuda::CannyEdgeDetector>> GetEdgeFilter() const { return EdgeFilter; }
+	TWeakPtr<cv::CascadeClassifier> GetFaceClassifier(int32 WorkerIndex = 0) const { return FaceClassifiers[WorkerIndex]; }
+	TWeakPtr<cv::CascadeClassifier> GetEyeClassifier(int32 WorkerIndex = 0) const { return EyeClassifiers[WorkerIndex]; }
 	
 protected:
 	int MinFaceSize = 200;
@@ -53,11 +202,40 @@ protected:
 	float WinkEyeTimeMultiplier = 1.f; // Should be weak enough to prevent outliers but strong enough to allow blinks mistaken as left and right winks.
 	float BlinkEyeTimeMultiplier = 3.5f; // Should be strong enough for two blinks to be registered.
 	float ErrorTimeMultiplier = 2.5f;
+	float MinFaceTrackScore = .6f; // Below this, the face is considered lost and searched for with the cascade.
+	float FaceSearchMargin = .25f; // How far the face can move between frames, in proportion to its size.
+	int32 FaceTemplateWidth = 48; // Faces are matched at this width, since the whole face doesn't need much detail.
+	float FaceScaleFactor = 1.3f; // How much bigger each level of the face cascade's scale pyramid is than the last.
+	float EyeScaleFactor = 1.3f; // How much bigger each level of the eye cascade's scale pyramid is than the last.
+	float EyeSearchMargin = .5f; // How far an eye can move between frames, in proportion to its size.
+	int32 MaxMissedEyeFrames = 3; // After this, the eye is searched for in the whole area where eyes usually are.
+	int32 EyeMinNeighbors = 2; // How many overlapping detections it takes to make an eye.
+	float MaxEyeBandOverhead = 1.25f; // Both eyes are searched for in one pass while it covers at most this much more.
 	
-	TSharedPtr<cv::CascadeClassifier> FaceClassifier;
-	TSharedPtr<cv::CascadeClassifier> EyeClassifier;
-	TSharedPtr<cv::Ptr<cv::cuda::Filter>> BlurFilter;
-	TSharedPtr<cv::Ptr<cv::cuda::CannyEdgeDetector>> EdgeFilter;
+	// One of each per worker, since a classifier can't be used by two threads at once.
+	TArray<TSharedPtr<cv::CascadeClassifier>> FaceClassifiers;
+	TArray<TSharedPtr<cv::CascadeClassifier>> EyeClassifiers;
+
+	// One of each per worker, like the classifiers. Only created with bUseCompiledCascades.
+	TArray<TUniquePtr<FHaarCascadeEvaluator>> FaceEvaluators;
+	TArray<TUniquePtr<FHaarCascadeEvaluator>> EyeEvaluators;
+
+	// One of each per worker, for the frame pyramids the preprocess stage builds and how long building them took. Only
+	// created with bShareCascadePyramid, and not while benchmarking. Every pyramid is released once the stages stop.
+	TArray<TUniquePtr<FFramePool>> PyramidPools;
+	TArray<FLatencyStats> PyramidBuildTimes;
+
+	// One of each per worker. Only touched by the face and eye stages respectively.
+	mutable TArray<FCascadeBenchmark> FaceCascadeBenchmarks;
+	mutable TArray<FCascadeBenchmark> EyeCascadeBenchmarks;
+
+	// One per worker, since each worker follows the face through the frames it is given. Only touched by the face stage.
+	mutable TArray<FFaceTrack> FaceTracks;
+
+	// One of each per worker, like the face tracks. Only touched by the eye stage.
+	mutable TArray<FEyePrior> LeftEyePriors;
+	mutable TArray<FEyePrior> RightEyePriors;
+	mutable TArray<int32> NumEyeBandSearches;
 
 	// State vars to take error into consideration.
 	float TimeLeftEyeClosed = 0;
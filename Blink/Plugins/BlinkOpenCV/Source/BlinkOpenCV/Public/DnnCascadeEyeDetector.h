@@ -16,15 +16,18 @@
 class FDnnCascadeEyeDetector : public FEyeDetector
 {
 public:
-	FDnnCascadeEyeDetector(FVideoReader* InVideoReader);
+	FDnnCascadeEyeDetector(FVideoReader* InVideoReader, const FFeatureDetectorSettings& InSettings = FFeatureDetectorSettings());
 	
-	virtual bool Init() override;
+	virtual void OnStart() override;
 	virtual ~FDnnCascadeEyeDetector() override;
 
 protected:
-	virtual uint32 ProcessNextFrame(cv::Mat& Frame, const double& DeltaTime) override;
+	virtual void PreprocessFrame(FEyeDetectionWork& Work) override;
+	virtual void DetectFace(FEyeDetectionWork& Work) const override;
+	virtual void DetectEyes(FEyeDetectionWork& Work) const override;
+	virtual void FilterEyeStatus(FEyeDetectionWork& Work) override;
 
-	cv::Rect GetFace(const cv::Mat& Frame, cv::Mat& FoundFaces, OUT int32& BestFaceIndex) const;
+	cv::Rect GetFace(const cv::Mat& Frame, cv::Mat& FoundFaces, OUT int32& BestFaceIndex, int32 WorkerIndex) const;
 	int32 CalculateBestFace(const cv::Mat& FoundFaces) const;
 	
 	cv::Rect GetFaceRect(const cv::Mat& Faces, int32 FaceIndex) const;
@@ -32,8 +35,10 @@ protected:
 	cv::Point GetLeftEyeApproxLocation(const cv::Mat& Faces, int32 FaceIndex) const;
 	cv::Rect GetEyeApproxLocationArea(const cv::Rect& Face, cv::Point EyeApproxLocation) const;
 	cv::Size GetMinEyeSize(const cv::Rect& EyeApproxLocationArea) const;
-	std::vector<cv::Rect> GetRightEyesByCascade(const cv::Mat& Frame, const cv::Rect& RightEyeApproxArea) const;
-	std::vector<cv::Rect> GetLeftEyesByCascade(const cv::Mat& Frame, const cv::Rect& LeftEyeApproxArea) const;
+	std::vector<cv::Rect> GetRightEyesByCascade(const cv::Mat& Frame, const cv::Rect& RightEyeApproxArea,
+	                                            int32 WorkerIndex) const;
+	std::vector<cv::Rect> GetLeftEyesByCascade(const cv::Mat& Frame, const cv::Rect& LeftEyeApproxArea,
+	                                           int32 WorkerIndex) const;
 
 	bool IsEyeTooLarge(const cv::Rect& EyeApproxArea, const cv::Rect& Eye) const;
 	bool IsEyeTooSmall(const cv::Rect& EyeApproxArea, const cv::Rect& Eye) const;
@@ -41,18 +46,29 @@ protected:
 	void FilterEyes(std::vector<cv::Rect>& LeftEyes, std::vector<cv::Rect>& RightEyes, const cv::Rect& Face,
 	                const cv::Rect& RightEyeApproxArea, const cv::Rect& LeftEyeApproxArea) const;
 	void GetEyes(const cv::Mat& Frame, const cv::Rect& Face, const cv::Rect& RightEyeApproxArea,
-	             const cv::Rect& LeftEyeApproxArea, cv::Rect& RightEye, cv::Rect& LeftEye) const;
+	             const cv::Rect& LeftEyeApproxArea, cv::Rect& RightEye, cv::Rect& LeftEye, int32 WorkerIndex,
+	             FFrameAnnotations& Annotations) const;
 	
-	void DrawFace(const cv::Mat& Frame, const cv::Mat& Faces, int32 FaceIndex, bool bIncludeApproxEyes) const;
-	void DrawEyeApproxArea(const cv::Mat& Frame, const cv::Rect& EyeApproxArea) const;
-	void DrawPrefilteredEye(const cv::Mat& Frame, const cv::Rect& EyeApproxArea, const cv::Rect& Eye) const;
-	void DrawEye(const cv::Mat& Frame, const cv::Rect& EyeApproxArea, const cv::Rect& Eye) const;
+	void AnnotateFace(FFrameAnnotations& Annotations, const cv::Mat& Faces, int32 FaceIndex,
+	                  bool bIncludeApproxEyes) const;
+	static void AnnotateEyeApproxArea(FFrameAnnotations& Annotations, const cv::Rect& EyeApproxArea);
+	static void AnnotatePrefilteredEye(FFrameAnnotations& Annotations, const cv::Rect& EyeApproxArea,
+	                                   const cv::Rect& Eye);
+	static void AnnotateEye(FFrameAnnotations& Annotations, const cv::Rect& EyeApproxArea, const cv::Rect& Eye);
 
-	TWeakPtr<cv::Ptr<cv::FaceDetectorYN>> GetFaceDetector() const { return LoadedFaceDetector; }
-	TWeakPtr<cv::CascadeClassifier> GetRightEyeClassifier() const { return LoadedRightEyeClassifier; }
-	TWeakPtr<cv::CascadeClassifier> GetLeftEyeClassifier() const { return LoadedLeftEyeClassifier; }
+	TWeakPtr<cv::Ptr<cv::FaceDetectorYN>> GetFaceDetector(int32 WorkerIndex = 0) const
+	{
+		return LoadedFaceDetectors.IsValidIndex(WorkerIndex) ? LoadedFaceDetectors[WorkerIndex] : nullptr;
+	}
+	TWeakPtr<cv::CascadeClassifier> GetRightEyeClassifier(int32 WorkerIndex = 0) const
+	{
+		return LoadedRightEyeClassifiers.IsValidIndex(WorkerIndex) ? LoadedRightEyeClassifiers[WorkerIndex] : nullptr;
+	}
+	TWeakPtr<cv::CascadeClassifier> GetLeftEyeClassifier(int32 WorkerIndex = 0) const
+	{
+		return LoadedLeftEyeClassifiers.IsValidIndex(WorkerIndex) ? LoadedLeftEyeClassifiers[WorkerIndex] : nullptr;
+	}
 
-	virtual EEyeStatus GetEyeStatusFromFrame(const cv::Mat& Frame) const override;
 	void UpdateEyeState(EEyeStatus FrameEyeStatus, const double& DeltaTime);
 	EEyeStatus GetEyeStatusWithError(EEyeStatus FrameEyeStatus) const;
 
@@ -70,9 +86,14 @@ protected:
 	float BlinkEyeTimeMultiplier = 5.f; // Should be strong enough for two blinks to be registered.
 	float ErrorTimeMultiplier = 2.5f;
 	
-	TSharedPtr<cv::Ptr<cv::FaceDetectorYN>> LoadedFaceDetector;
-	TSharedPtr<cv::CascadeClassifier> LoadedRightEyeClassifier;
-	TSharedPtr<cv::CascadeClassifier> LoadedLeftEyeClassifier;
+	// One of each per worker, since neither the face detector nor a classifier can be used by two threads at once.
+	TArray<TSharedPtr<cv::Ptr<cv::FaceDetectorYN>>> LoadedFaceDetectors;
+	TArray<TSharedPtr<cv::CascadeClassifier>> LoadedRightEyeClassifiers;
+	TArray<TSharedPtr<cv::CascadeClassifier>> LoadedLeftEyeClassifiers;
+
+	// One per worker for downscaling frames for the face detector. The face stage runs at the same time as the
+	// preprocess stage, so it can't share the backend PrepareFrame uses.
+	TArray<TUniquePtr<FImageBackend>> FaceImageBackends;
 
 	// State vars to take error into consideration.
 	float TimeLeftEyeClosed = 0;
@@ -17,17 +17,17 @@
 class FDnnEyeDetector : public FEyeDetector
 {
 public:
-	FDnnEyeDetector(FVideoReader* VideoReader);
+	FDnnEyeDetector(FVideoReader* VideoReader, const FFeatureDetectorSettings& InSettings = FFeatureDetectorSettings());
 
-	virtual bool Init() override;
-	virtual void Exit() override;
+	virtual void OnStart() override;
+	virtual void OnStop() override;
 
 protected:
 	virtual uint32 ProcessNextFrame(cv::Mat& Frame, const double& DeltaTime) override;
 
 	void GetFace(const cv::Mat& Frame, cv::Mat& FoundFaces, OUT int32& BestFaceIndex);
 	int32 CalculateBestFace(cv::Mat& FoundFaces);
-	void DrawFace(const cv::Mat& Frame, const cv::Mat& Faces, int32 FaceIndex) const;
+	static void AnnotateFace(FFrameAnnotations& Annotations, const cv::Mat& Faces, int32 FaceIndex);
 
 	static cv::Rect GetFaceRect(const cv::Mat& Faces, int32 FaceIndex);
 	static cv::Size GetRightEye(const cv::Mat& Faces, int32 FaceIndex);
@@ -4,6 +4,24 @@
 
 #pragma once
 
+#include <atomic>
+#include "HAL/CriticalSection.h"
+#include "HAL/Event.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "LatencyStats.h"
+#include "Tasks/Task.h"
+#include "ThreadScheduling.h"
+
+enum class EEulerThreadMode : uint8
+{
+	// Ticks on its own OS thread, at its tick rate.
+	DedicatedThread,
+	// Has no thread of its own. Each tick runs as a UE::Tasks task on the engine's worker threads, and only when
+	// TriggerTick is called, so it costs nothing while idle. The tick rate is ignored.
+	Tasks
+};
+
 /**
  * @brief Acts like a functional thread, but is also thread-safe when used with TSharedPtr.
  *
@@ -17,9 +35,18 @@
  * other threads which are currently accessing this thread to do so without issue.
  *
  * If the thread isn't going to be accessed by more than one thread, then you can use raw C++ pointers with delete
- * instead (no need to call StopThread).
+ * instead (no need to call StopThread). Subclasses that override any of the hooks must call StopThread in their own
+ * destructor though, since the hooks can't be called from this class' destructor.
+ *
+ * Ticks are scheduled against an absolute deadline that advances by exactly the tick rate, so time spent ticking or
+ * oversleeping never accumulates into drift. The thread sleeps until just before the deadline, then spins for the
+ * rest, since waking from a sleep is only accurate to the OS scheduler's granularity.
+ *
+ * Alternatively, in EEulerThreadMode::Tasks, it is ticked on demand by UE::Tasks rather than owning a thread. The
+ * hooks are called in the same order and never concurrently, but OnStart and every OnTick may run on a different
+ * worker thread, and OnStop runs on the owning thread once the last tick has finished.
  */
-class FEulerThread : public FRunnable
+class BLINKOPENCV_API FEulerThread : public FRunnable
 {
 public:
 	FEulerThread(FString InThreadName, double InTickRate = 1.f/60.f, EThreadPriority InThreadPriority = TPri_Normal);
@@ -27,33 +54,55 @@ public:
 	// Overriden from FRunnable
 	
 	// Do not call or inherit!
-	virtual bool Init() override;
+	virtual bool Init() override final;
 	// Do not call or inherit!
-	virtual uint32 Run() override;
+	virtual uint32 Run() override final;
 	// Do not call or inherit!
-	virtual void Exit() override;
+	virtual void Exit() override final;
 	// Do not call or inherit!
-	virtual void Stop() override;
+	virtual void Stop() override final;
 	
 
 	// Only call from one thread.
 	void SetPriority(EThreadPriority InThreadPriority);
 
-	// Only call from one thread.
+	/**
+	 * @brief Sets the priority and the logical processors the thread may run on. Affinity is ignored in
+	 * EEulerThreadMode::Tasks. Only call before the thread is started.
+	 */
+	void SetScheduling(const FThreadSchedulingSettings& InScheduling);
+
+	// Only call before the thread is started.
+	void SetThreadMode(EEulerThreadMode InThreadMode) { ThreadMode = InThreadMode; }
+
+	/**
+	 * @brief Ticks as soon as possible. Only used in EEulerThreadMode::Tasks. Requests made while a tick is queued or
+	 * running are coalesced into one more tick after it. Can be called from any thread, including from OnTick.
+	 */
+	void TriggerTick();
+
+	/**
+	 * @brief The time between the start of each tick (seconds). 0 ticks again as soon as OnTick returns, for threads
+	 * that pace themselves (i.e. by waiting for work). Can be called from any thread, including from OnTick, and takes
+	 * effect from the next tick.
+	 */
 	void SetTickRate(double InTickRate);
 
-	// Only call from one thread.
+	// Can be called from any thread.
 	void SetTickEnabled(bool bInTickEnabled);
 
 	
 	// Only call from owning thread.
 	void StartThread();
 
-	// Only call from owning thread.
+	/**
+	 * @brief Asks the thread to stop, wakes it if it is waiting for its next tick, and blocks until it has. Then stops
+	 * every child thread. Only call from owning thread.
+	 */
 	void StopThread();
 
 	
-	// Called by owning thread just after construction.
+	// Called by owning thread the first time the thread is started, once this object has been fully constructed.
 	virtual void OnConstruction();
 	
 	// Called by owning thread just before the thread is started.
@@ -62,10 +111,16 @@ public:
 	// Called by this worker thread just after it starts.
 	virtual void OnStart();
 	
-	// Called by this worker thread once every tick.
+	/**
+	 * @brief Called by this worker thread once every tick.
+	 * @param DeltaTime The time since the start of the previous tick (seconds).
+	 */
 	virtual void OnTick(const double& DeltaTime);
 	
-	// Called by owning thread after this thread has been requested to stop. 
+	/**
+	 * @brief Called by owning thread after this thread has been requested to stop, but before waiting for it to stop.
+	 * Use this to wake the thread if it can block for a while in OnTick.
+	 */
 	virtual void OnPreStop();
 	
 	/**
@@ -77,33 +132,103 @@ public:
 	virtual void OnStop();
 
 	/**
-	 * @brief Called by whichever thread deconstructed this object.
+	 * @brief Called by owning thread once this thread and its children have stopped.
 	 *
 	 * This method should contain the remaining clean-up that couldn't be done in OnStop due to thread-safety.
 	 */
 	virtual void OnDestroy();
 
 	
-	bool IsActive() const { return bThreadActive; }
+	bool IsActive() const { return bThreadActive.load(std::memory_order_acquire); }
 	const FString& GetName() const { return ThreadName; }
-	double GetTickRate() const { return ThreadTickRate; }
+	double GetTickRate() const { return ThreadTickRate.load(std::memory_order_relaxed); }
+	bool IsTickEnabled() const { return bTickEnabled.load(std::memory_order_relaxed); }
+	bool IsUsingTasks() const { return ThreadMode == EEulerThreadMode::Tasks; }
+
+	/**
+	 * @brief How long the thread took to start running once it was due to: how late each tick started compared to its
+	 * deadline (only ticks with a tick rate are measured), how long each tick task waited for a worker thread after
+	 * TriggerTick in EEulerThreadMode::Tasks, plus any wake-ups reported with AddSchedulingDelay.
+	 * Only written to by this thread, so only read once it has stopped.
+	 */
+	const FLatencyStats& GetSchedulingDelay() const { return SchedulingDelay; }
+
+	/**
+	 * @brief How many ticks were skipped because a tick overran by more than a whole tick.
+	 */
+	uint64 GetNumMissedTicks() const { return NumMissedTicks.load(std::memory_order_relaxed); }
 
 	
-	// Only call from one thread.
-	void AddChildThread(FEulerThread* Runnable);
+	/**
+	 * @brief Takes ownership of a thread that depends on this one, so it is stopped along with it.
+	 * Can be called from any thread, including this one.
+	 */
+	void AddChildThread(const TSharedPtr<FEulerThread>& Runnable);
 	
-	// Only call from one thread.
-	void RemoveChildThread(FEulerThread* Runnable);
+	// Can be called from any thread.
+	void RemoveChildThread(const TSharedPtr<FEulerThread>& Runnable);
 	
-	void ContainsChildThread(FEulerThread* Runnable);
+	bool ContainsChildThread(const TSharedPtr<FEulerThread>& Runnable) const;
 	
 	
 	virtual ~FEulerThread() override;
 
+protected:
+	// Only call before the thread is started.
+	void SetName(const FString& InThreadName) { ThreadName = InThreadName; }
+
+	/**
+	 * @brief The UE::Tasks priority matching the thread's priority, for any tasks it launches.
+	 */
+	UE::Tasks::ETaskPriority GetTaskPriority() const;
+
+	/**
+	 * @brief Records how long the thread took to run after something it was waiting on happened, for threads that
+	 * pace themselves by waiting in OnTick. Only call from this thread.
+	 */
+	void AddSchedulingDelay(double DelaySeconds) { SchedulingDelay.Add(DelaySeconds); }
+
+private:
+	/**
+	 * @brief Ticks until there are no more tick requests. Executed as a task in EEulerThreadMode::Tasks.
+	 */
+	void RunTickTask();
+
+	/**
+	 * @brief Blocks until Deadline, or until the thread is asked to stop.
+	 */
+	void WaitUntil(double Deadline) const;
+
+	// How long before a deadline to stop sleeping and start spinning (seconds). Covers the usual oversleep of a
+	// 1ms-resolution timer without spinning for long.
+	static constexpr double SpinWaitSeconds = .002;
+	
 private:
 	FString ThreadName;
-	double ThreadTickRate;
-	bool bThreadActive;
+	std::atomic<double> ThreadTickRate;
+	EThreadPriority ThreadPriority;
+	uint64 ThreadAffinityMask;
+	EEulerThreadMode ThreadMode;
+	std::atomic<bool> bThreadActive;
+	std::atomic<bool> bTickEnabled;
+	bool bConstructed;
+	bool bStarted;
 	FRunnableThread* Thread;
+
+	// Only used in EEulerThreadMode::Tasks. Held while launching a tick task, so StopThread can't miss one.
+	FCriticalSection TickTaskLock;
+	UE::Tasks::FTask TickTask;
+	std::atomic<int32> NumTickRequests;
+	std::atomic<double> TickRequestTime;
+	bool bTickTaskStarted;
+	double PreviousTickTaskTime;
+
+	// Triggered to cut the wait for the next tick short when the thread is asked to stop.
+	FEvent* WakeEvent;
+
+	FLatencyStats SchedulingDelay;
+	std::atomic<uint64> NumMissedTicks;
+
+	mutable FCriticalSection ChildRunnablesLock;
 	TArray<TSharedPtr<FEulerThread>> ChildRunnables;
 };
@@ -3,7 +3,11 @@
 // NHE2422 Advanced Computer Games Development Assignment 2.
 
 #pragma once
+#include "Containers/CircularQueue.h"
 #include "FeatureDetector.h"
+#include "HaarCascadeEvaluator.h"
+#include "OrderedWorkerPool.h"
+#include "StageGraph.h"
 
 UENUM()
 enum class EEyeStatus : uint8
@@ -15,26 +19,215 @@ enum class EEyeStatus : uint8
 	Error
 };
 
+/**
+ * @brief Everything an eye detector has worked out about one frame so far, handed from stage to stage.
+ * Eye rects are relative to their eye area.
+ */
+struct FEyeDetectionWork
+{
+	FVideoFrame Frame;
+	double DeltaTime = 0;
+
+	// The worker processing the frame, used to pick resources no other worker is using. 0 if there are no workers.
+	int32 WorkerIndex = 0;
+
+	// The frame scaled down for the face search, ahead of the face stage. Only built by cascade detectors that share one.
+	FHaarPyramid Pyramid;
+
+	cv::Rect Face;
+
+	// Face detector output, one face per row. Only used by detectors with a DNN face detector.
+	cv::Mat FoundFaces;
+	int32 FaceIndex = -1;
+
+	cv::Rect LeftEyeArea;
+	cv::Rect RightEyeArea;
+	cv::Rect LeftEye;
+	cv::Rect RightEye;
+
+	EEyeStatus FrameEyeStatus = EEyeStatus::Error;
+
+	// Everything the stages found, and how long each took, for the debug window. Disabled unless it is being rendered.
+	FFrameAnnotations Annotations;
+};
+
+/**
+ * @brief A change in the filtered eye status, pushed by the eye detector for the game thread to consume.
+ */
+struct FEyeEvent
+{
+	// The status the eyes changed to.
+	EEyeStatus Status = EEyeStatus::BothOpen;
+
+	// Capture time of the first frame in the new status, in FPlatformTime::Seconds().
+	double OnsetTime = 0;
+
+	// The status the eyes changed from, and how long they were in it (seconds).
+	EEyeStatus PreviousStatus = EEyeStatus::BothOpen;
+	double PreviousDuration = 0;
+
+	// How strongly the temporal filter agreed with the new status when it changed, from 0 to 1.
+	float Confidence = 0;
+
+	// When the event was pushed, in FPlatformTime::Seconds(). Used to measure how long it takes to be dispatched.
+	double CommitTime = 0;
+};
+
 class FEyeDetector : public FFeatureDetector
 {
 public:
-	FEyeDetector(FVideoReader* InVideoReader);
+	FEyeDetector(FVideoReader* InVideoReader, const FFeatureDetectorSettings& InSettings = FFeatureDetectorSettings());
 	
-	const TWeakPtr<double> GetLastBlinkTime() const { return LastBlinkTime; }
-	const TWeakPtr<double> GetLastLeftWinkTime() const { return LastLeftWinkTime; }
-	const TWeakPtr<double> GetLastRightWinkTime() const { return LastRightWinkTime; }
+	/**
+	 * @brief Takes the oldest eye event the game hasn't consumed yet. Only call from one thread (i.e. the game thread).
+	 * @return False if there are no events waiting.
+	 */
+	bool PopEyeEvent(FEyeEvent& OutEvent) { return EyeEvents.Dequeue(OutEvent); }
+
+	/**
+	 * @brief Sets a function to call on the detector's thread right after each eye event is pushed, or nullptr to
+	 * clear it. Used to consume events as soon as they happen instead of polling for them.
+	 * Safe to call from any thread, but not from the function itself.
+	 */
+	void SetOnEyeEvent(TFunction<void()> InOnEyeEvent);
+
+	virtual void OnPreStop() override;
+	virtual void OnStop() override;
 
 protected:
-	void SetLastBlinkTime(double NewBlinkTime) { *LastBlinkTime = NewBlinkTime; }
-	void SetLastLeftWinkTime(double NewLeftWinkTime) { *LastLeftWinkTime = NewLeftWinkTime; }
-	void SetLastRightWinkTime(double NewRightWinkTime) { *LastRightWinkTime = NewRightWinkTime; }
+	/**
+	 * @brief Records the filtered eye status of a frame, pushing an eye event if it differs from the last one.
+	 * Only call from FilterEyeStatus.
+	 * @param CaptureTime The capture time of the frame the status was worked out from.
+	 * @param Confidence See GetEyeStatusConfidence.
+	 */
+	void CommitEyeStatus(EEyeStatus Status, double CaptureTime, float Confidence);
+
+	/**
+	 * @brief How strongly a temporal filter agrees with Status, from 0 to 1, given how closed it considers each eye (0
+	 * to 1) and the amount above which an eye counts as closed. 0 means an eye is right on the threshold.
+	 */
+	static float GetEyeStatusConfidence(EEyeStatus Status, float LeftEyeClosedAmount, float RightEyeClosedAmount,
+	                                    float ClosedAmountThreshold);
 
 protected:
-	virtual EEyeStatus GetEyeStatusFromFrame(const cv::Mat& Frame) const = 0;
+	/**
+	 * @brief Runs every stage on the detector thread, one after the other.
+	 */
+	virtual uint32 ProcessNextFrame(cv::Mat& Frame, const double& DeltaTime) override;
+	virtual bool WaitUntilReadyForFrame(double TimeoutSeconds) override;
+	virtual void DispatchFrame(FVideoFrame& Frame, double DeltaTime) override;
+
+	/**
+	 * @brief Creates the threads the detector's stages run on, as set in the settings. Call at the end of the subclass'
+	 * constructor, once it is ready to process frames.
+	 *
+	 * With more than one worker, each worker runs preprocess -> face -> eyes on a different frame and the temporal
+	 * filter is applied to the results in capture order. Otherwise, with the stage graph enabled, each stage runs on
+	 * its own thread. Otherwise, every stage runs on the detector thread. When running on tasks, no threads are
+	 * created; each frame is instead processed by a detection task, then a temporal filter task that waits for the
+	 * previous frame's, with up to one frame per worker in flight.
+	 */
+	void CreateWorkers();
+
+	/**
+	 * @brief The number of frames that can be processed at the same time. Resources used by the preprocess, face and
+	 * eye stages must be duplicated this many times and picked with FEyeDetectionWork::WorkerIndex.
+	 */
+	int32 GetNumWorkers() const { return FMath::Max(GetSettings().NumWorkers, 1); }
+
+	// The detector's stages, in order. Consecutive stages, and the same stage on different workers, can work on
+	// different frames at the same time, so a stage must only touch the work it is given, its own state and resources
+	// belonging to the work's worker. The temporal filter is only ever called for one frame at a time.
+
+	/**
+	 * @brief Converts the frame to what the detector works on (i.e. greyscale or a certain size).
+	 */
+	virtual void PreprocessFrame(FEyeDetectionWork& Work) = 0;
+	virtual void DetectFace(FEyeDetectionWork& Work) const = 0;
+	virtual void DetectEyes(FEyeDetectionWork& Work) const = 0;
+
+	/**
+	 * @brief Takes the frame's eye status into account over time to filter out errors, and records any eye events.
+	 * Frames always arrive in capture order.
+	 */
+	virtual void FilterEyeStatus(FEyeDetectionWork& Work) = 0;
+
+	/**
+	 * @brief Runs the face and eye stages on an already preprocessed frame.
+	 */
+	EEyeStatus GetEyeStatusFromFrame(const cv::Mat& Frame) const;
+
+	/**
+	 * @brief Interprets which eyes were found, treating a missing eye as closed.
+	 */
+	static EEyeStatus GetEyeStatusFromEyes(const cv::Rect& Face, const cv::Rect& LeftEye, const cv::Rect& RightEye);
 
 private:
-	// Thread-safe pointers to last eye closed times.
-	TSharedPtr<double> LastBlinkTime;
-	TSharedPtr<double> LastLeftWinkTime;
-	TSharedPtr<double> LastRightWinkTime;
+	// The most eye events that can wait for the game to consume them. The game consumes them every tick, so this only
+	// fills up if the game stalls.
+	static constexpr uint32 EyeEventQueueSize = 64;
+
+	// Written to by the temporal filter and read by the game thread. The filter is never called concurrently, so there
+	// is only ever one producer.
+	TCircularQueue<FEyeEvent> EyeEvents;
+	std::atomic<uint64> NumDroppedEyeEvents;
+
+	// Only used by the temporal filter. The last status it committed, and the capture time of its first frame.
+	EEyeStatus CommittedEyeStatus = EEyeStatus::BothOpen;
+	double CommittedEyeStatusOnset = 0;
+
+	// Held while OnEyeEvent is called, so it can be cleared safely.
+	FCriticalSection OnEyeEventLock;
+	TFunction<void()> OnEyeEvent;
+
+	TUniquePtr<TStageGraph<FEyeDetectionWork>> StageGraph;
+	TUniquePtr<TOrderedWorkerPool<FEyeDetectionWork>> WorkerPool;
+
+	// Only used when running on tasks. The workers that don't have a frame in flight.
+	FCriticalSection FreeWorkerIndicesLock;
+	TArray<int32> FreeWorkerIndices;
+
+	// Only used when running on tasks. The temporal filter task of the last dispatched frame.
+	UE::Tasks::FTask LastFilterTask;
+
+	/**
+	 * @brief Launches the task chain that processes a frame when running on tasks.
+	 */
+	void LaunchFrameTasks(FEyeDetectionWork&& Work);
+
+	/**
+	 * @brief Runs the preprocess, face and eye stages one after the other.
+	 */
+	void DetectFrame(FEyeDetectionWork& Work);
+
+	/**
+	 * @brief Runs the temporal filter, then finishes the frame with its annotations.
+	 */
+	void FilterAndFinishFrame(FEyeDetectionWork& Work);
+
+	/**
+	 * @brief Runs a single stage, timed for the profiler and the work's annotations.
+	 */
+	void RunPreprocessStage(FEyeDetectionWork& Work);
+	void RunFaceStage(FEyeDetectionWork& Work);
+	void RunEyesStage(FEyeDetectionWork& Work);
+	void RunTemporalFilterStage(FEyeDetectionWork& Work);
+
+	/**
+	 * @brief Runs one of the detector's stages, recording how long it took in the work's annotations.
+	 */
+	template <typename StageFunctionType>
+	static void RunStage(FEyeDetectionWork& Work, const TCHAR* StageName, StageFunctionType&& Stage)
+	{
+		if (!Work.Annotations.IsEnabled())
+		{
+			Stage();
+			return;
+		}
+
+		const double StartTime = FPlatformTime::Seconds();
+		Stage();
+		Work.Annotations.AddStageTime(StageName, FPlatformTime::Seconds() - StartTime);
+	}
 };
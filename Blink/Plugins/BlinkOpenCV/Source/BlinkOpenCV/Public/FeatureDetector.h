@@ -19,50 +19,265 @@
 #include "opencv2/cudaimgproc.hpp"
 #include <opencv2/dnn/dnn.hpp>
 #include "PostOpenCVHeaders.h"
+#include "EulerRunnable.h"
+#include "FrameAnnotations.h"
+#include "FrameMailbox.h"
+#include "FramePool.h"
+#include "FrameStageStats.h"
+#include "ImageBackend.h"
+#include "LatencyStats.h"
 #include "Renderable.h"
 
 class FVideoReader;
 
-class BLINKOPENCV_API FFeatureDetector : public FRunnable, public FRenderable
+struct FFeatureDetectorSettings
+{
+	/**
+	 * @brief If enabled, the detector thread sleeps until the VideoReader publishes a new frame. Otherwise, it polls
+	 * for new frames at its own tick rate.
+	 */
+	bool bWaitForFrames = true;
+
+	/**
+	 * @brief The longest the detector thread will wait for a new frame before ticking anyway (seconds).
+	 * Negative waits forever.
+	 */
+	float FrameWaitTimeout = .1f;
+
+	/**
+	 * @brief The detector's latency budget, from the frame being read by the VideoReader to the detector finishing
+	 * processing it (seconds). A frame already older than this is skipped if a newer one is waiting, unless replaying,
+	 * and frames that finish later are counted as over budget. 0 disables the deadline.
+	 */
+	float FrameDeadline = .033f;
+
+	/**
+	 * @brief If enabled, detectors that support it split their work into stages (i.e. preprocess, face, eyes, temporal
+	 * filter) that each run on their own thread, so consecutive frames are processed in parallel. Otherwise, every
+	 * frame is processed start to finish on the detector thread.
+	 */
+	bool bUseStageGraph = true;
+
+	/**
+	 * @brief How many frames can wait in front of each stage. Only used with bUseStageGraph.
+	 */
+	int32 StageQueueCapacity = 1;
+
+	/**
+	 * @brief How many frames detectors that support it process at the same time, each on its own worker thread.
+	 * Results are still applied in capture order. More than 1 takes priority over bUseStageGraph.
+	 */
+	int32 NumWorkers = 1;
+
+	/**
+	 * @brief If enabled, detectors that support it only search the whole frame for a face every FaceRedetectInterval
+	 * frames. In between, they follow the face found last within a small area around it, which is much cheaper, and
+	 * search the whole frame again as soon as they lose it.
+	 */
+	bool bTrackFace = true;
+	int32 FaceRedetectInterval = 10;
+
+	/**
+	 * @brief If enabled, the detector has no threads of its own. Every published frame launches a UE::Tasks task to
+	 * process it on the engine's worker threads, so it costs nothing while there are no frames. Detectors that support
+	 * it process up to NumWorkers frames at once as a chain of tasks, instead of using a stage graph or worker pool.
+	 * Always woken by frames, so bWaitForFrames and FrameWaitTimeout are ignored.
+	 */
+	bool bUseTasks = false;
+
+	/**
+	 * @brief Where frames are preprocessed and networks are run. Auto picks CUDA if there's a CUDA device and the CPU
+	 * otherwise, once, when the detector is created.
+	 */
+	EImageBackend ImageBackend = EImageBackend::Auto;
+
+	/**
+	 * @brief If enabled, cascade detectors evaluate the bundled cascades from tables compiled into the plugin instead of
+	 * with cv::CascadeClassifier. They find the same faces and eyes, testing several windows at once.
+	 */
+	bool bUseCompiledCascades = true;
+
+	/**
+	 * @brief If enabled along with bUseCompiledCascades, every search is also run with cv::CascadeClassifier, and how long
+	 * each took and how often they disagreed is logged when the detector stops. Only for comparing the two.
+	 */
+	bool bBenchmarkCompiledCascades = false;
+
+	/**
+	 * @brief If enabled along with bUseCompiledCascades, cascade detectors scale each frame down to every size the face
+	 * search looks at it, and integrate each level, in the preprocess stage, so the face stage only has to search them.
+	 * The eye searches still scale down the small part of the frame they cover themselves. The levels are built for
+	 * every frame, even those whose face is tracked rather than searched for, so this only pays off with bTrackFace off
+	 * and the stage graph running the preprocess and face stages side by side.
+	 */
+	bool bShareCascadePyramid = false;
+
+	/**
+	 * @brief The priority and affinity of the detector thread, and of any stage or worker threads it creates.
+	 */
+	FThreadSchedulingSettings Scheduling;
+};
+
+class BLINKOPENCV_API FFeatureDetector : public FEulerThread, public FRenderable
 {
 public:
-	FFeatureDetector(FVideoReader* InVideoReader);
+	FFeatureDetector(FVideoReader* InVideoReader, const FFeatureDetectorSettings& InSettings = FFeatureDetectorSettings());
 	
 public:
-	// Overriden from FRunnable
-	virtual bool Init() override;
-	virtual uint32 Run() override;
-	virtual void Exit() override;
-	virtual void Stop() override;
+	// Overriden from FEulerThread
+	virtual void OnPreStart() override;
+	virtual void OnTick(const double& DeltaTime) override;
+	virtual void OnPreStop() override;
+	virtual void OnStop() override;
 
 	virtual void Render() override;
 	virtual void StopRendering() override;
 	virtual ~FFeatureDetector() override;
 
-	void Kill();
-
 protected:
-	const TCHAR* ThreadName = TEXT("UnnamedFeatureDetectorThread");
-	TSharedPtr<cv::Mat> CurrentFrame;
+	/**
+	 * @brief Buffers reused every frame by PrepareFrame, so they aren't reallocated. Workers prepare frames at the same
+	 * time, so each has its own set.
+	 *
+	 * Only the stage that calls PrepareFrame may use them. With a stage graph, every stage runs on its own thread with
+	 * the same worker index, so any other stage that needs an image backend must create its own.
+	 */
+	struct FWorkerBuffers
+	{
+		// For frames the detector produces itself (i.e. downloaded or resized frames). Must outlive every frame acquired
+		// from it.
+		FFramePool FramePool;
+
+		TUniquePtr<FImageBackend> ImageBackend;
+	};
 	
 private:
-	FRunnableThread* Thread = nullptr;
-	bool bActive = false;
 	float RefreshRate = .03f;
+	FFeatureDetectorSettings Settings;
+	EImageBackend ImageBackendType = EImageBackend::Cpu;
 
 	FVideoReader* VideoReader = nullptr;
+	TSharedPtr<FFrameMailbox> FrameMailbox;
+	uint64 LastFrameSequenceNumber = 0;
 	double PreviousTime = 0;
+	double PreviousStreamPosition = -1;
+
+	// Time from the frame being read by the VideoReader to this detector starting to process it.
+	FLatencyStats CaptureToDetectionLatency;
+
+	// Time from the frame being read by the VideoReader to this detector finishing processing it.
+	FLatencyStats CaptureToProcessedLatency;
+
+	FFrameStageStats FrameStats;
+
+	// Timestamps of the frame currently being processed.
+	double FrameCaptureTime = 0;
+	double FrameStreamPosition = -1;
+
+	// Annotations of the frame currently being processed by ProcessNextFrame.
+	FFrameAnnotations FrameAnnotations;
+
+	// One per worker, declared before anything that can hold onto a prepared frame.
+	TArray<TUniquePtr<FWorkerBuffers>> WorkerBuffers;
+
+	// Game thread's view of the processed frames, used for rendering. Only published to while there are frame
+	// subscribers.
+	FFrameMailbox RenderMailbox;
+	FVideoFrame RenderFrame;
+
+	// The RenderFrame with its annotations drawn over it, redrawn whenever a new frame is rendered. Only shown if the
+	// RenderFrame has any annotations.
+	cv::Mat AnnotatedRenderImage;
+	bool bRenderFrameAnnotated = false;
 
 public:
-	FORCEINLINE bool IsActive() const { return bActive; }
-	TSharedPtr<cv::Mat> GetCurrentFrame() const { return CurrentFrame; }
+	/**
+	 * @brief What happened to the frames the VideoReader published for this detector. Can be read from any thread.
+	 */
+	const FFrameStageStats& GetFrameStats() const { return FrameStats; }
 
 protected:
 	virtual uint32 ProcessNextFrame(cv::Mat& Frame, const double& DeltaTime);
-	void CreateThread();
+
+	const FFeatureDetectorSettings& GetSettings() const { return Settings; }
+
+	/**
+	 * @brief The backend picked for ImageBackend in the settings. Never Auto.
+	 */
+	EImageBackend GetImageBackendType() const { return ImageBackendType; }
+
+	/**
+	 * @brief The image backend PrepareFrame uses for a worker. Only use it from the stage that calls PrepareFrame, since
+	 * other stages can be working on another frame with the same worker index. See FWorkerBuffers.
+	 */
+	FImageBackend& GetImageBackend(int32 WorkerIndex = 0) const { return *WorkerBuffers[WorkerIndex]->ImageBackend; }
+
+	/**
+	 * @brief Blocks the detector thread until it can process a frame straight away, or the timeout expires, so the
+	 * frame it takes is still the newest one when processing starts. When running on tasks, the timeout is 0 and the
+	 * detector should call TriggerTick once it is ready again.
+	 * @return True if a frame can be processed.
+	 */
+	virtual bool WaitUntilReadyForFrame(double TimeoutSeconds) { return true; }
+
+	/**
+	 * @brief Processes a frame taken from the VideoReader. By default, runs ProcessNextFrame on the detector thread and
+	 * finishes the frame straight after. Detectors split into stages override this to hand the frame to their first
+	 * stage instead, and finish it from their last.
+	 */
+	virtual void DispatchFrame(FVideoFrame& Frame, double DeltaTime);
+
+	/**
+	 * @brief Records the frame's latency and stats and shows it in the debug window. Call exactly once per dispatched
+	 * frame, in capture order and never from two threads at once.
+	 */
+	void FinishFrame(const FVideoFrame& Frame);
+
+	/**
+	 * @brief FPlatformTime::Seconds() at the moment the frame being processed was read by the VideoReader.
+	 * Only valid during ProcessNextFrame. Use this to timestamp anything detected in the frame.
+	 */
+	double GetFrameCaptureTime() const { return FrameCaptureTime; }
+
+	/**
+	 * @brief Where the frame being processed is in the stream (seconds), negative if unknown.
+	 * Only valid during ProcessNextFrame.
+	 */
+	double GetFrameStreamPosition() const { return FrameStreamPosition; }
+
+	/**
+	 * @brief Where to record what was found in the frame being processed, to be drawn over it by the renderer.
+	 * Only valid during ProcessNextFrame.
+	 */
+	FFrameAnnotations& GetFrameAnnotations() { return FrameAnnotations; }
+
+	/**
+	 * @brief Hands the annotations to the frame, so they reach the renderer with it. Does nothing if they are disabled.
+	 */
+	static void AttachAnnotations(FVideoFrame& Frame, FFrameAnnotations&& Annotations);
+
+	/**
+	 * @brief Converts Frame to the given size and channel count (1 or 3), into a pooled buffer.
+	 * Only does the work the capture pipeline hasn't already done: if the frame is already the right size, it never
+	 * goes through the image backend, and if it is already in the right format, it is left as it is. Either way, detectors must
+	 * treat the frame as read-only, since it may still be shared with the VideoReader.
+	 * @param WorkerIndex The worker preparing the frame, so workers never share buffers. 0 if there are no workers.
+	 */
+	void PrepareFrame(cv::Mat& Frame, const cv::Size& Size, int32 Channels, int32 WorkerIndex = 0);
 
 private:
-	cv::Mat GetNextFrame() const;
+	/**
+	 * @brief Retrieves the newest frame from the VideoReader, if this detector has not processed it yet.
+	 * If the frame has already missed the deadline and a newer one has arrived since, skips straight to the newer one.
+	 * The frame's pixels are shared with the VideoReader and must not be written to.
+	 * @return True if OutFrame contains a new frame.
+	 */
+	bool GetNextFrame(FVideoFrame& OutFrame);
+
+	/**
+	 * @brief Counts the frames published since the last frame taken as superseded, then marks SequenceNumber as taken.
+	 */
+	void CountSupersededFrames(uint64 SequenceNumber);
 
 	/**
 	 * @brief Keeps track of delta-time in a thread-independent way.
@@ -0,0 +1,74 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+#include "OpenCVHelper.h"
+#include "PreOpenCVHeaders.h"
+#include <opencv2/core.hpp>
+#include "PostOpenCVHeaders.h"
+
+/**
+ * @brief What a detector found in a frame (i.e. faces, eye areas and eyes) and how long each of its stages took,
+ * recorded as a list of shapes instead of being drawn into the frame.
+ *
+ * Detectors annotate unconditionally; disabled annotations ignore everything added to them, so nothing is recorded
+ * unless something subscribes to the detector's frames. The shapes are only rasterised by the renderer, onto its own copy of the frame, so
+ * the pixels the detector's stages read are never written to.
+ *
+ * Coordinates are in the space of the frame the detector processed.
+ */
+class BLINKOPENCV_API FFrameAnnotations
+{
+public:
+	explicit FFrameAnnotations(bool bInEnabled = false)
+		: bEnabled(bInEnabled)
+	{ }
+
+	bool IsEnabled() const { return bEnabled; }
+	bool IsEmpty() const { return Shapes.Num() == 0 && StageTimes.Num() == 0; }
+
+	void AddRect(const cv::Rect& Rect, const cv::Scalar& Colour, int32 Thickness = 1);
+	void AddCircle(const cv::Point& Centre, int32 Radius, const cv::Scalar& Colour, int32 Thickness = 1);
+	void AddLabel(const cv::Point& Origin, const FString& Text, const cv::Scalar& Colour);
+
+	/**
+	 * @brief Records how long one of the detector's stages took to process the frame.
+	 * @param StageName Must outlive the annotations, i.e. a string literal.
+	 */
+	void AddStageTime(const TCHAR* StageName, double Seconds);
+
+	/**
+	 * @brief Rasterises every annotation onto Image, with the stage times listed in the bottom-left corner.
+	 */
+	void Draw(cv::Mat& Image) const;
+
+private:
+	enum class EShapeType : uint8
+	{
+		Rect,
+		Circle,
+		Label
+	};
+
+	struct FShape
+	{
+		EShapeType Type = EShapeType::Rect;
+
+		// Only used by rects.
+		cv::Rect Rect;
+
+		// The centre of a circle, or the bottom-left corner of a label.
+		cv::Point Point;
+		int32 Radius = 0;
+		FString Text;
+
+		cv::Scalar Colour;
+		int32 Thickness = 1;
+	};
+
+	bool bEnabled;
+	TArray<FShape> Shapes;
+	TArray<TPair<const TCHAR*, double>> StageTimes;
+};
@@ -0,0 +1,117 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+#include <atomic>
+#include "HAL/CriticalSection.h"
+#include "HAL/Event.h"
+#include "VideoFrame.h"
+
+/**
+ * @brief Lock-free, latest-value mailbox used to hand frames from a VideoReader to a single consumer.
+ *
+ * Internally a triple buffer: the producer always owns one slot, the consumer always owns another, and the third slot
+ * is swapped atomically between them. Publishing never waits for the consumer and consuming never waits for the
+ * producer. If the producer publishes several frames before the consumer looks, only the newest one is kept.
+ *
+ * Only the cv::Mat header is moved between slots, so the pixels are never copied.
+ *
+ * There must be exactly one producer thread and one consumer thread per mailbox.
+ */
+class BLINKOPENCV_API FFrameMailbox
+{
+public:
+	FFrameMailbox();
+	~FFrameMailbox();
+
+	/**
+	 * @brief Publishes a new frame, replacing any frame the consumer has not picked up yet.
+	 * Only call from the producer thread.
+	 */
+	void Publish(const FVideoFrame& Frame);
+
+	/**
+	 * @brief Retrieves the newest frame if it is newer than LastSeenSequenceNumber.
+	 * Only call from the consumer thread.
+	 * @return True if OutFrame was filled with a frame the consumer has not seen yet.
+	 */
+	bool Consume(FVideoFrame& OutFrame, uint64 LastSeenSequenceNumber);
+
+	/**
+	 * @brief The sequence number of the newest published frame. Safe to call from any thread.
+	 */
+	uint64 GetLatestSequenceNumber() const { return LatestSequenceNumber.load(std::memory_order_acquire); }
+
+	/**
+	 * @brief Is there a frame newer than LastSeenSequenceNumber waiting? Safe to call from any thread.
+	 */
+	bool HasNewFrame(uint64 LastSeenSequenceNumber) const { return GetLatestSequenceNumber() > LastSeenSequenceNumber; }
+
+	/**
+	 * @brief The sequence number of the newest frame the consumer has taken. Safe to call from any thread.
+	 */
+	uint64 GetConsumedSequenceNumber() const { return ConsumedSequenceNumber.load(std::memory_order_acquire); }
+
+	/**
+	 * @brief Blocks the producer thread until the consumer has taken the frame with the given sequence number (or a
+	 * newer one), or the timeout expires. Used for lossless backpressure.
+	 * Only call from the producer thread.
+	 * @param TimeoutSeconds The longest to wait for. Negative waits forever.
+	 * @return True if the frame has been consumed.
+	 */
+	bool WaitUntilConsumed(uint64 SequenceNumber, double TimeoutSeconds);
+
+	/**
+	 * @brief Blocks the consumer thread until a frame newer than LastSeenSequenceNumber is published, Wake is called
+	 * or the timeout expires.
+	 * Only call from the consumer thread.
+	 * @param TimeoutSeconds The longest to wait for. Negative waits forever.
+	 * @return True if a new frame is available.
+	 */
+	bool WaitForNewFrame(uint64 LastSeenSequenceNumber, double TimeoutSeconds);
+
+	/**
+	 * @brief Wakes the consumer thread if it is waiting, i.e. so it can notice it has been asked to stop.
+	 * Safe to call from any thread.
+	 */
+	void Wake();
+
+	/**
+	 * @brief Sets a function to call on the producer thread after every publish, i.e. to launch a task that consumes
+	 * the frame, for consumers that don't have a thread waiting on the mailbox. Replaces any previous function; pass
+	 * nullptr to clear it. Once this returns, the previous function is no longer running and won't be called again.
+	 * Safe to call from any thread, but not from the function itself.
+	 */
+	void SetOnPublished(TFunction<void()> InOnPublished);
+
+private:
+	static constexpr uint8 SlotIndexMask = 0b011;
+	static constexpr uint8 NewFrameFlag = 0b100;
+
+	FVideoFrame Slots[3];
+
+	// Index of the slot currently in the middle, plus NewFrameFlag if the producer has written to it since the
+	// consumer last swapped.
+	std::atomic<uint8> SharedSlotState;
+
+	// Owned by the producer thread.
+	uint8 ProducerSlotIndex;
+
+	// Owned by the consumer thread.
+	uint8 ConsumerSlotIndex;
+
+	std::atomic<uint64> LatestSequenceNumber;
+	std::atomic<uint64> ConsumedSequenceNumber;
+
+	// Auto-reset event triggered on every publish.
+	FEvent* NewFrameEvent;
+
+	// Auto-reset event triggered on every consume.
+	FEvent* ConsumedEvent;
+
+	// Held while OnPublished is called, so it can be cleared safely.
+	FCriticalSection OnPublishedLock;
+	TFunction<void()> OnPublished;
+};
@@ -0,0 +1,80 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+#include <atomic>
+#include "Containers/LockFreeList.h"
+#include "OpenCVHelper.h"
+#include "PreOpenCVHeaders.h"
+#include <opencv2/core.hpp>
+#include "PostOpenCVHeaders.h"
+
+/**
+ * @brief Pool of reusable image buffers for a single frame format.
+ *
+ * Mats acquired from the pool are ordinary reference-counted cv::Mats, so they can be shared between threads as usual.
+ * When the last cv::Mat referencing a buffer is released, the buffer goes back to the pool instead of being freed,
+ * meaning a steady-state stream makes no per-frame heap allocations.
+ *
+ * The pool starts with Capacity buffers and grows up to MaxCapacity if every buffer is in use. Requests that don't
+ * match the pool's format, or that arrive once MaxCapacity is reached, fall back to OpenCV's default allocator.
+ *
+ * Acquire must only be called from one thread, but acquired Mats can be released from any thread.
+ * The pool must outlive every Mat acquired from it.
+ */
+class BLINKOPENCV_API FFramePool : public cv::MatAllocator
+{
+public:
+	FFramePool(int32 InCapacity = 8, int32 InMaxCapacity = 32);
+	virtual ~FFramePool() override;
+
+	/**
+	 * @brief Gets an unused buffer of the given format. If the format differs from the previous call, the pool is
+	 * reformatted and buffers of the old format are freed once they are released.
+	 * Only call from one thread.
+	 */
+	cv::Mat Acquire(const cv::Size& Size, int32 Type);
+
+	/**
+	 * @brief The number of buffers currently owned by the pool, whether in use or not.
+	 */
+	int32 GetNumBuffers() const { return NumBuffers.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief The number of allocations that could not be served by the pool. Should stay at 0 in a steady-state stream.
+	 */
+	int32 GetNumFallbackAllocations() const { return NumFallbackAllocations.load(std::memory_order_relaxed); }
+
+	// Overriden from cv::MatAllocator
+	virtual cv::UMatData* allocate(int Dims, const int* Sizes, int Type, void* Data, size_t* Step,
+	                               cv::AccessFlag Flags, cv::UMatUsageFlags UsageFlags) const override;
+	virtual bool allocate(cv::UMatData* Data, cv::AccessFlag AccessFlags, cv::UMatUsageFlags UsageFlags) const override;
+	virtual void deallocate(cv::UMatData* Data) const override;
+
+private:
+	struct FBuffer
+	{
+		cv::UMatData* MatData;
+		uchar* Data;
+		size_t Size;
+	};
+
+	FBuffer* CreateBuffer(size_t Size) const;
+	void DestroyBuffer(FBuffer* Buffer) const;
+	void SetFormat(const cv::Size& Size, int32 Type);
+
+private:
+	int32 Capacity;
+	int32 MaxCapacity;
+
+	// Owned by the acquiring thread.
+	cv::Size FormatSize;
+	int32 FormatType;
+
+	std::atomic<size_t> BufferSize;
+	mutable TLockFreePointerListUnordered<FBuffer, PLATFORM_CACHE_LINE_SIZE> FreeBuffers;
+	mutable std::atomic<int32> NumBuffers;
+	mutable std::atomic<int32> NumFallbackAllocations;
+};
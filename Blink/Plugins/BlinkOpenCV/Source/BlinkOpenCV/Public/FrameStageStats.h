@@ -0,0 +1,55 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+#include <atomic>
+
+/**
+ * @brief Counts what happened to the frames that reached a stage of the pipeline (i.e. capture or a detector), so it
+ * can be seen at runtime whether the stage is keeping up.
+ * Should only be written to by the stage's thread, but can be read from any thread.
+ */
+struct FFrameStageStats
+{
+	// Frames the stage fully processed (or for the capture stage, published).
+	std::atomic<uint64> NumProcessed = 0;
+
+	// Frames that were replaced by a newer frame before the stage got to them.
+	std::atomic<uint64> NumSuperseded = 0;
+
+	// Frames skipped because they were already older than the stage's deadline and a newer frame was waiting.
+	std::atomic<uint64> NumExpired = 0;
+
+	// Processed frames that finished later than the stage's deadline.
+	std::atomic<uint64> NumOverBudget = 0;
+
+	// Ticks where the stage slowed itself down because its consumers were saturated.
+	std::atomic<uint64> NumThrottled = 0;
+
+	static void Increment(std::atomic<uint64>& Counter, uint64 Amount = 1)
+	{
+		Counter.fetch_add(Amount, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Only call while nothing is writing to the stats (i.e. before the stage's thread starts).
+	 */
+	void Reset()
+	{
+		NumProcessed = 0;
+		NumSuperseded = 0;
+		NumExpired = 0;
+		NumOverBudget = 0;
+		NumThrottled = 0;
+	}
+
+	FString ToString() const
+	{
+		return FString::Printf(TEXT("%llu processed, %llu superseded, %llu expired, %llu over budget, %llu throttled"),
+			NumProcessed.load(std::memory_order_relaxed), NumSuperseded.load(std::memory_order_relaxed),
+			NumExpired.load(std::memory_order_relaxed), NumOverBudget.load(std::memory_order_relaxed),
+			NumThrottled.load(std::memory_order_relaxed));
+	}
+};
@@ -0,0 +1,176 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+#include "FramePool.h"
+#include "OpenCVHelper.h"
+#include "PreOpenCVHeaders.h"
+#include <opencv2/core.hpp>
+#include "PostOpenCVHeaders.h"
+
+/**
+ * The tables a Haar cascade is compiled into. BlinkOpenCV.Build.cs generates one struct of them per cascade in the
+ * plugin's Content/Cascades (i.e. FHaarCascadeEye in HaarCascadeEye.gen.h), with the same values as the cascade file.
+ */
+struct FHaarRect
+{
+	int32 X;
+	int32 Y;
+	int32 Width;
+	int32 Height;
+	float Weight;
+};
+
+struct FHaarFeature
+{
+	// Features with two rects have a third with no weight.
+	FHaarRect Rects[3];
+};
+
+/**
+ * @brief A weak classifier that tests one feature against a threshold.
+ */
+struct FHaarStump
+{
+	int32 FeatureIndex;
+	float Threshold;
+	float Left; // Added to the stage's sum if the feature is below the threshold.
+	float Right; // Added otherwise.
+};
+
+struct FHaarStage
+{
+	int32 FirstStump;
+	int32 NumStumps;
+	float Threshold; // Windows whose sum is below this are rejected.
+};
+
+/**
+ * @brief An image scaled down to the sizes the evaluators search it at, and the integral images of each level, built
+ * ahead of the search, e.g. in an earlier stage than the one making it.
+ *
+ * Levels are made the same way an evaluator makes them when searching the whole image, so a search of the whole image
+ * finds exactly the same objects either way. A search of part of the image reads that part of each level, whose pixels
+ * can differ slightly from scaling the part down on its own.
+ */
+class BLINKOPENCV_API FHaarPyramid
+{
+public:
+	struct FLevel
+	{
+		// How much smaller the level is than the image.
+		float Scale;
+
+		// With FHaarCascadeEvaluator::GetRowPadding zeroed columns after each row.
+		cv::Mat Sum;
+		cv::Mat SqSum;
+	};
+
+	/**
+	 * @brief Scales Image down by ScaleFactor at a time, keeping the levels from MinScale up to the last one WindowSize
+	 * still fits in. Replaces whatever was built before.
+	 * @param Image Greyscale. Referenced, not copied.
+	 * @param Pool Where the integral images, and the buffer the levels are scaled into, are allocated from, or nullptr
+	 * to allocate them normally. Must outlive the pyramid.
+	 */
+	void Build(const cv::Mat& Image, double ScaleFactor, double MinScale, const cv::Size& WindowSize,
+	           FFramePool* Pool = nullptr);
+
+	bool IsEmpty() const { return Levels.Num() == 0; }
+	const cv::Mat& GetImage() const { return Image; }
+
+	/**
+	 * @return The level at Scale, or nullptr if it wasn't built.
+	 */
+	const FLevel* FindLevel(float Scale) const;
+
+private:
+	cv::Mat Image;
+	TArray<FLevel> Levels;
+
+	// Every level's integral images, one under the other, so they take two allocations in all.
+	cv::Mat SumAtlas;
+	cv::Mat SqSumAtlas;
+};
+
+/**
+ * @brief Evaluates one of the Haar cascades compiled into the plugin, testing several neighbouring windows with each
+ * instruction through OpenCV's universal intrinsics (SSE2 or AVX2 on x64, depending on what the module is built for).
+ *
+ * Finds the same objects as cv::CascadeClassifier::detectMultiScale with the same cascade file: the same scales,
+ * window positions, variance normalisation, thresholds and grouping. Reuses its buffers between calls, so each worker
+ * needs its own.
+ */
+class BLINKOPENCV_API FHaarCascadeEvaluator
+{
+public:
+	virtual ~FHaarCascadeEvaluator() = default;
+
+	/**
+	 * @brief Evaluators for haarcascade_frontalface_default.xml and haarcascade_eye.xml.
+	 */
+	static TUniquePtr<FHaarCascadeEvaluator> CreateFrontalFace();
+	static TUniquePtr<FHaarCascadeEvaluator> CreateEye();
+
+	/**
+	 * @brief The instruction set the evaluators were compiled for, and how many windows they test at once.
+	 */
+	static FString GetInstructionSet();
+
+	/**
+	 * @brief The name of the cascade file the evaluator was generated from.
+	 */
+	virtual const TCHAR* GetName() const = 0;
+	virtual cv::Size GetWindowSize() const = 0;
+
+	/**
+	 * @brief Same as cv::CascadeClassifier::detectMultiScale.
+	 * @param Image Greyscale.
+	 * @param MaxSize Unlimited if empty.
+	 */
+	void DetectMultiScale(const cv::Mat& Image, std::vector<cv::Rect>& Objects, double ScaleFactor, int32 MinNeighbors,
+	                      const cv::Size& MinSize = cv::Size(), const cv::Size& MaxSize = cv::Size());
+
+	/**
+	 * @brief Same, but searches Area of the pyramid's image, reading each level from the pyramid if it was built with
+	 * the same ScaleFactor and scaling the area down itself otherwise.
+	 * @param Objects Relative to Area.
+	 */
+	void DetectMultiScale(const FHaarPyramid& Pyramid, const cv::Rect& Area, std::vector<cv::Rect>& Objects,
+	                      double ScaleFactor, int32 MinNeighbors, const cv::Size& MinSize = cv::Size(),
+	                      const cv::Size& MaxSize = cv::Size());
+
+	/**
+	 * @brief How many columns past the end of each row of the integral images DetectInLevel reads from, for the lanes
+	 * of the last windows in each row.
+	 */
+	static int32 GetRowPadding();
+
+protected:
+	/**
+	 * @brief Tests the windows in one level of the scale pyramid, and adds those that pass every stage to Objects.
+	 * @param Sum, SqSum The level's integral images, with the same step and GetRowPadding columns after each row.
+	 * @param Scale How much smaller the level is than the image. Objects are scaled back up by it.
+	 * @param Step How far apart the windows are, 1 or 2 pixels.
+	 * @param EndY Windows are tested from the top of the level down to this row.
+	 * @param Offset Where Sum and SqSum start in the level. Objects are placed relative to the level's origin.
+	 */
+	virtual void DetectInLevel(const cv::Mat& Sum, const cv::Mat& SqSum, float Scale, int32 Step, int32 EndY,
+	                           const cv::Point& Offset, std::vector<cv::Rect>& Objects) = 0;
+
+private:
+	/**
+	 * @brief Searches Area of Image, reading the levels from Pyramid where it has them.
+	 * @param Pyramid Built from Image, or nullptr to scale every level down here.
+	 */
+	void SearchLevels(const FHaarPyramid* Pyramid, const cv::Mat& Image, const cv::Rect& Area,
+	                  std::vector<cv::Rect>& Objects, double ScaleFactor, int32 MinNeighbors, const cv::Size& MinSize,
+	                  const cv::Size& MaxSize);
+
+	// Reused by every level, so they're only reallocated when the image grows.
+	cv::Mat LevelImage;
+	cv::Mat SumBuffer;
+	cv::Mat SqSumBuffer;
+};
@@ -0,0 +1,97 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+#include "OpenCVHelper.h"
+#include "PreOpenCVHeaders.h"
+#include <opencv2/core.hpp>
+#include <opencv2/core/cuda.hpp>
+#include "PostOpenCVHeaders.h"
+
+enum class EImageBackend : uint8
+{
+	// CUDA if there's a CUDA device, otherwise the CPU.
+	Auto,
+	Cuda,
+	Cpu
+};
+
+/**
+ * @brief Runs the image operations detectors preprocess frames with, either on a CUDA device or on the CPU.
+ *
+ * Both backends run the same operations in the same order with the same interpolation, so they produce the same frames
+ * up to rounding. Reuses its buffers between calls, so each worker needs its own.
+ */
+class BLINKOPENCV_API FImageBackend
+{
+public:
+	virtual ~FImageBackend() = default;
+
+	/**
+	 * @brief Creates a backend of the given type, which must already be resolved (see Resolve).
+	 */
+	static TUniquePtr<FImageBackend> Create(EImageBackend Type);
+
+	/**
+	 * @brief Picks CUDA for Auto if there's a CUDA device, and the CPU otherwise. CUDA also falls back to the CPU if
+	 * there's no device, rather than failing on the first frame.
+	 */
+	static EImageBackend Resolve(EImageBackend Type);
+
+	/**
+	 * @brief Was OpenCV built with CUDA, and is there a device it can use? Only checked once.
+	 */
+	static bool IsCudaAvailable();
+
+	static const TCHAR* GetName(EImageBackend Type);
+
+	/**
+	 * @brief The cv::dnn::Backend and cv::dnn::Target that run networks on the same device as the given backend.
+	 */
+	static int32 GetDnnBackend(EImageBackend Type);
+	static int32 GetDnnTarget(EImageBackend Type);
+
+	virtual EImageBackend GetType() const = 0;
+
+	/**
+	 * @brief Resizes Source to Size into Destination, converting it between BGR and greyscale on the way if it doesn't
+	 * have the given number of channels (1 or 3). Destination is only reallocated if it isn't already the right size
+	 * and type, so a pooled frame is written to in place.
+	 */
+	virtual void Resize(const cv::Mat& Source, const cv::Size& Size, int32 Channels, cv::Mat& Destination) = 0;
+};
+
+/**
+ * @brief Uploads each frame to the CUDA device, processes it there and downloads the result.
+ */
+class BLINKOPENCV_API FCudaImageBackend : public FImageBackend
+{
+public:
+	virtual EImageBackend GetType() const override { return EImageBackend::Cuda; }
+	virtual void Resize(const cv::Mat& Source, const cv::Size& Size, int32 Channels, cv::Mat& Destination) override;
+
+private:
+	// Each step writes into its own GpuMat so none of them change size between frames.
+	cv::cuda::GpuMat GpuFrame;
+	cv::cuda::GpuMat GpuConvertedFrame;
+	cv::cuda::GpuMat GpuResizedFrame;
+};
+
+/**
+ * @brief Processes each frame on the calling thread and OpenCV's thread pool.
+ *
+ * cv::resize and cv::cvtColor already split frames into stripes with parallel_for_ and vectorise each stripe with IPP
+ * or universal intrinsics, so all that's left to tune is skipping passes and allocations.
+ */
+class BLINKOPENCV_API FCpuImageBackend : public FImageBackend
+{
+public:
+	virtual EImageBackend GetType() const override { return EImageBackend::Cpu; }
+	virtual void Resize(const cv::Mat& Source, const cv::Size& Size, int32 Channels, cv::Mat& Destination) override;
+
+private:
+	// The frame between the two steps, when it is both converted and resized.
+	cv::Mat IntermediateFrame;
+};
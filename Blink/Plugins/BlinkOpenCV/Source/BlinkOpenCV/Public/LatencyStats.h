@@ -0,0 +1,62 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+/**
+ * @brief Accumulates latency samples so they can be summarised, i.e. in logs.
+ * Percentiles are calculated over the most recent MaxSamples samples, the average and max over every sample.
+ * Not thread-safe; should only be written to and read from by one thread.
+ */
+struct FLatencyStats
+{
+	static constexpr int32 MaxSamples = 1024;
+
+	int32 Count = 0;
+	double TotalSeconds = 0;
+	double MaxSeconds = 0;
+
+	// Ring buffer of the most recent samples.
+	TArray<double> Samples;
+
+	void Add(double LatencySeconds)
+	{
+		if (Samples.Num() < MaxSamples)
+			Samples.Add(LatencySeconds);
+		else
+			Samples[Count % MaxSamples] = LatencySeconds;
+
+		Count++;
+		TotalSeconds += LatencySeconds;
+		MaxSeconds = FMath::Max(MaxSeconds, LatencySeconds);
+	}
+
+	void Reset() { *this = FLatencyStats(); }
+
+	double GetAverageSeconds() const { return Count > 0 ? TotalSeconds / Count : 0; }
+
+	/**
+	 * @brief Gets the latency that the given percentage of recent samples were at or below.
+	 * @param Percentile Between 0 and 100, i.e. 95 for the 95th percentile.
+	 */
+	double GetPercentileSeconds(double Percentile) const
+	{
+		if (Samples.Num() == 0)
+			return 0;
+
+		TArray<double> SortedSamples = Samples;
+		SortedSamples.Sort();
+
+		// Nearest-rank percentile.
+		const int32 Rank = FMath::CeilToInt(FMath::Clamp(Percentile, 0.0, 100.0) / 100.0 * SortedSamples.Num());
+		return SortedSamples[FMath::Clamp(Rank - 1, 0, SortedSamples.Num() - 1)];
+	}
+
+	FString ToString() const
+	{
+		return FString::Printf(TEXT("avg %.2fms, p50 %.2fms, p95 %.2fms, p99 %.2fms, max %.2fms over %d samples"),
+			GetAverageSeconds() * 1000.0, GetPercentileSeconds(50) * 1000.0, GetPercentileSeconds(95) * 1000.0,
+			GetPercentileSeconds(99) * 1000.0, MaxSeconds * 1000.0, Count);
+	}
+};
@@ -0,0 +1,237 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+#include <atomic>
+#include "HAL/Event.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/ScopeLock.h"
+#include "ThreadScheduling.h"
+
+/**
+ * @brief A pool of worker threads that process items concurrently, then finish them strictly in the order they were
+ * pushed.
+ *
+ * Workers take items from a shared queue, so whichever worker is free takes the next item. Finished items wait in a
+ * reorder buffer until every item pushed before them has been finished, so the finish function sees them in push order
+ * regardless of how long each took to process. It is never called concurrently, but may be called from any worker.
+ *
+ * At most one item per worker is in the pool at once, so pushing has to wait for a worker to be free. There must be
+ * exactly one thread pushing items.
+ */
+template <typename ItemType>
+class TOrderedWorkerPool
+{
+public:
+	// Called concurrently by the workers. WorkerIndex is unique to the worker calling it, from 0 to NumWorkers - 1.
+	using FProcessFunction = TFunction<void(ItemType& Item, int32 WorkerIndex)>;
+	using FFinishFunction = TFunction<void(ItemType& Item)>;
+
+	TOrderedWorkerPool(const FString& InName, int32 InNumWorkers, FProcessFunction InProcessFunction,
+	                   FFinishFunction InFinishFunction)
+		: Name(InName)
+		, NumWorkers(FMath::Max(InNumWorkers, 1))
+		, ProcessFunction(MoveTemp(InProcessFunction))
+		, FinishFunction(MoveTemp(InFinishFunction))
+		, NextPushTicket(0)
+		, NextFinishTicket(0)
+		, NumInFlight(0)
+		, bRunning(false)
+	{
+		WorkEvent = FPlatformProcess::GetSynchEventFromPool(false);
+		FinishedEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	}
+
+	~TOrderedWorkerPool()
+	{
+		Stop();
+
+		FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+		WorkEvent = nullptr;
+		FPlatformProcess::ReturnSynchEventToPool(FinishedEvent);
+		FinishedEvent = nullptr;
+	}
+
+	void Start(const FThreadSchedulingSettings& Scheduling = FThreadSchedulingSettings())
+	{
+		checkf(!IsRunning(), TEXT("WorkerPool '%s': Already running"), *Name);
+
+		bRunning = true;
+		for (int32 i = 0; i < NumWorkers; i++)
+		{
+			TUniquePtr<FWorker>& Worker = Workers.Add_GetRef(MakeUnique<FWorker>(*this, i));
+			const FString ThreadName = FString::Printf(TEXT("%s.Worker%d"), *Name, i);
+			Worker->Thread = FRunnableThread::Create(Worker.Get(), *ThreadName, 0, Scheduling.Priority,
+				Scheduling.GetThreadAffinityMask());
+			checkf(Worker->Thread, TEXT("Could not create Thread '%s'"), *ThreadName);
+		}
+	}
+
+	/**
+	 * @brief Stops every worker, waiting for any item currently being processed. Unfinished items are discarded.
+	 */
+	void Stop()
+	{
+		if (!IsRunning())
+			return;
+
+		bRunning = false;
+		for (int32 i = 0; i < NumWorkers; i++)
+			WorkEvent->Trigger();
+		FinishedEvent->Trigger();
+
+		for (const TUniquePtr<FWorker>& Worker : Workers)
+		{
+			Worker->Thread->Kill(true);
+			delete Worker->Thread;
+			Worker->Thread = nullptr;
+		}
+		Workers.Empty();
+
+		PendingItems.Empty();
+		CompletedItems.Empty();
+	}
+
+	/**
+	 * @brief Queues an item for the next free worker. Call WaitUntilCanPush first, otherwise more items than workers
+	 * can end up queued. Only call from the pushing thread.
+	 * @return False if the pool isn't running.
+	 */
+	bool Push(ItemType&& Item)
+	{
+		if (!IsRunning())
+			return false;
+
+		NumInFlight.fetch_add(1, std::memory_order_acq_rel);
+		{
+			FScopeLock Lock(&PendingItemsLock);
+			PendingItems.Emplace(NextPushTicket++, MoveTemp(Item));
+		}
+		WorkEvent->Trigger();
+		return true;
+	}
+
+	/**
+	 * @brief Blocks the pushing thread until a worker is free, or the timeout expires.
+	 * @return True if a worker is free.
+	 */
+	bool WaitUntilCanPush(double TimeoutSeconds)
+	{
+		if (!IsRunning())
+			return false;
+
+		if (NumInFlight.load(std::memory_order_acquire) < NumWorkers)
+			return true;
+
+		FinishedEvent->Wait(FTimespan::FromSeconds(TimeoutSeconds));
+		return IsRunning() && NumInFlight.load(std::memory_order_acquire) < NumWorkers;
+	}
+
+	bool IsRunning() const { return bRunning.load(std::memory_order_acquire); }
+	int32 GetNumWorkers() const { return NumWorkers; }
+
+private:
+	using FTicketedItem = TPair<uint64, ItemType>;
+
+	class FWorker : public FRunnable
+	{
+	public:
+		FWorker(TOrderedWorkerPool& InPool, int32 InWorkerIndex)
+			: Pool(InPool)
+			, WorkerIndex(InWorkerIndex)
+		{ }
+
+		virtual uint32 Run() override
+		{
+			// Executed on worker thread.
+
+			FTicketedItem TicketedItem;
+			while (Pool.IsRunning())
+			{
+				if (!Pool.TakePendingItem(OUT TicketedItem))
+				{
+					Pool.WorkEvent->Wait(100);
+					continue;
+				}
+
+				Pool.ProcessFunction(TicketedItem.Value, WorkerIndex);
+				Pool.CompleteItem(MoveTemp(TicketedItem));
+				TicketedItem = FTicketedItem();
+			}
+
+			return 0;
+		}
+
+	public:
+		FRunnableThread* Thread = nullptr;
+
+	private:
+		TOrderedWorkerPool& Pool;
+		int32 WorkerIndex;
+	};
+
+	bool TakePendingItem(FTicketedItem& OutItem)
+	{
+		// Executed on worker thread.
+
+		FScopeLock Lock(&PendingItemsLock);
+		if (PendingItems.Num() == 0)
+			return false;
+
+		OutItem = MoveTemp(PendingItems[0]);
+		PendingItems.RemoveAt(0, 1, false);
+
+		// Events only wake one waiting worker, so pass it on if there's more work.
+		if (PendingItems.Num() > 0)
+			WorkEvent->Trigger();
+
+		return true;
+	}
+
+	void CompleteItem(FTicketedItem&& Item)
+	{
+		// Executed on worker thread.
+
+		FScopeLock Lock(&ReorderLock);
+		CompletedItems.Add(Item.Key, MoveTemp(Item.Value));
+
+		// Finish every item that is no longer waiting on an earlier one.
+		ItemType NextItem;
+		while (IsRunning() && CompletedItems.RemoveAndCopyValue(NextFinishTicket, OUT NextItem))
+		{
+			FinishFunction(NextItem);
+			NextItem = ItemType();
+			NextFinishTicket++;
+
+			NumInFlight.fetch_sub(1, std::memory_order_acq_rel);
+			FinishedEvent->Trigger();
+		}
+	}
+
+private:
+	FString Name;
+	int32 NumWorkers;
+	FProcessFunction ProcessFunction;
+	FFinishFunction FinishFunction;
+	TArray<TUniquePtr<FWorker>> Workers;
+
+	// Items waiting for a free worker, oldest first.
+	FCriticalSection PendingItemsLock;
+	TArray<FTicketedItem> PendingItems;
+	uint64 NextPushTicket;
+
+	// Items that have been processed but are still waiting on an earlier item to finish.
+	FCriticalSection ReorderLock;
+	TMap<uint64, ItemType> CompletedItems;
+	uint64 NextFinishTicket;
+
+	// Items pushed but not finished yet.
+	std::atomic<int32> NumInFlight;
+	std::atomic<bool> bRunning;
+
+	FEvent* WorkEvent;
+	FEvent* FinishedEvent;
+};
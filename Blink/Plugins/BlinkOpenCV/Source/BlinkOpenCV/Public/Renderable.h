@@ -4,10 +4,57 @@
 
 #pragma once
 
+#include <atomic>
+
 class BLINKOPENCV_API FRenderable
 {
 public:
 	virtual void Render() = 0;
 	virtual void StopRendering() = 0;
 	virtual ~FRenderable() = default;
+
+	/**
+	 * @brief Registers interest in this object's frames, i.e. from a window, recorder or texture output. Frames are only
+	 * kept for rendering, and debug output only produced, while at least one subscriber is registered. Every call must
+	 * be matched by a call to RemoveFrameSubscriber. Safe to call from any thread.
+	 */
+	void AddFrameSubscriber() { NumFrameSubscribers.fetch_add(1, std::memory_order_relaxed); }
+	void RemoveFrameSubscriber()
+	{
+		const int32 PreviousNumSubscribers = NumFrameSubscribers.fetch_sub(1, std::memory_order_relaxed);
+		checkf(PreviousNumSubscribers > 0, TEXT("Removed a frame subscriber that was never added"));
+	}
+
+	/**
+	 * @brief Is anything interested in this object's frames? Safe to call from any thread.
+	 */
+	bool HasFrameSubscribers() const { return NumFrameSubscribers.load(std::memory_order_relaxed) > 0; }
+
+protected:
+	/**
+	 * @brief Subscribes the object's own window the first time it is rendered, and unsubscribes it once it stops. Call
+	 * from Render and StopRendering respectively.
+	 */
+	void SubscribeWindow()
+	{
+		if (!bWindowSubscribed)
+		{
+			bWindowSubscribed = true;
+			AddFrameSubscriber();
+		}
+	}
+	void UnsubscribeWindow()
+	{
+		if (bWindowSubscribed)
+		{
+			bWindowSubscribed = false;
+			RemoveFrameSubscriber();
+		}
+	}
+
+private:
+	std::atomic<int32> NumFrameSubscribers = 0;
+
+	// Only used by the game thread.
+	bool bWindowSubscribed = false;
 };
@@ -0,0 +1,238 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+#include <atomic>
+#include "BlinkOpenCV.h"
+#include "Containers/CircularQueue.h"
+#include "HAL/Event.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "LatencyStats.h"
+#include "ThreadScheduling.h"
+
+/**
+ * @brief A chain of processing stages, each running on its own thread and connected to the next by a bounded,
+ * lock-free SPSC queue.
+ *
+ * Items go through the stages in the order they were pushed, so while one stage works on item N, the stage before it
+ * can already work on item N+1. Throughput is then limited by the slowest stage rather than by all of them added
+ * together, while the time each item spends in the graph stays roughly the same.
+ *
+ * A full queue blocks the stage feeding it, so no item is dropped once it is inside the graph and pushing blocks once
+ * the graph is saturated. There must be exactly one thread pushing items.
+ */
+template <typename ItemType>
+class TStageGraph
+{
+public:
+	using FStageFunction = TFunction<void(ItemType&)>;
+
+	/**
+	 * @param InQueueCapacity How many items can wait in front of each stage. Every waiting item adds a stage's worth of
+	 * latency, so keep this low.
+	 */
+	explicit TStageGraph(const FString& InName, int32 InQueueCapacity = 1)
+		: Name(InName)
+		, QueueCapacity(FMath::Max(InQueueCapacity, 1))
+		, bRunning(false)
+	{ }
+
+	~TStageGraph()
+	{
+		Stop();
+	}
+
+	/**
+	 * @brief Appends a stage to the end of the graph. Only call before Start.
+	 */
+	void AddStage(const FString& StageName, FStageFunction Function)
+	{
+		checkf(!IsRunning(), TEXT("StageGraph '%s': Stages can't be added while it is running"), *Name);
+		Stages.Add(MakeUnique<FStage>(*this, Name + TEXT(".") + StageName, MoveTemp(Function), QueueCapacity));
+	}
+
+	/**
+	 * @brief Starts a thread for every stage, with the given priority and affinity.
+	 */
+	void Start(const FThreadSchedulingSettings& Scheduling = FThreadSchedulingSettings())
+	{
+		checkf(!IsRunning() && Stages.Num() > 0, TEXT("StageGraph '%s': Has no stages or is already running"), *Name);
+
+		for (int32 i = 0; i < Stages.Num(); i++)
+			Stages[i]->NextStage = i + 1 < Stages.Num() ? Stages[i + 1].Get() : nullptr;
+
+		bRunning = true;
+		for (const TUniquePtr<FStage>& Stage : Stages)
+		{
+			Stage->Thread = FRunnableThread::Create(Stage.Get(), *Stage->Name, 0, Scheduling.Priority,
+				Scheduling.GetThreadAffinityMask());
+			checkf(Stage->Thread, TEXT("Could not create Thread '%s'"), *Stage->Name);
+		}
+	}
+
+	/**
+	 * @brief Stops every stage, waiting for any item currently being processed. Items still queued are discarded.
+	 */
+	void Stop()
+	{
+		if (!IsRunning())
+			return;
+
+		bRunning = false;
+		for (const TUniquePtr<FStage>& Stage : Stages)
+			Stage->Wake();
+
+		for (const TUniquePtr<FStage>& Stage : Stages)
+		{
+			Stage->Thread->Kill(true);
+			delete Stage->Thread;
+			Stage->Thread = nullptr;
+
+			UE_LOG(LogBlinkOpenCV, Display, TEXT("Thread '%s' processing time: %s."), *Stage->Name,
+				*Stage->ProcessingTime.ToString());
+		}
+	}
+
+	/**
+	 * @brief Hands an item to the first stage, waiting for room if the graph is saturated.
+	 * Only call from the pushing thread.
+	 * @return False if the graph was stopped before there was room.
+	 */
+	bool Push(ItemType&& Item)
+	{
+		return IsRunning() && Stages[0]->Enqueue(MoveTemp(Item));
+	}
+
+	/**
+	 * @brief Blocks the pushing thread until the first stage has room for another item, or the timeout expires.
+	 * Used to take the newest frame once there is room, rather than pushing a frame that will wait in the queue.
+	 * @return True if there is room.
+	 */
+	bool WaitUntilCanPush(double TimeoutSeconds)
+	{
+		return IsRunning() && Stages[0]->WaitForSpace(TimeoutSeconds);
+	}
+
+	bool IsRunning() const { return bRunning.load(std::memory_order_acquire); }
+
+private:
+	class FStage : public FRunnable
+	{
+	public:
+		FStage(const TStageGraph& InGraph, const FString& InName, FStageFunction&& InFunction, int32 InQueueCapacity)
+			: Name(InName)
+			, Graph(InGraph)
+			, Function(MoveTemp(InFunction))
+			, Capacity(InQueueCapacity)
+			, Queue(InQueueCapacity + 1)
+			, NumQueued(0)
+		{
+			ItemEvent = FPlatformProcess::GetSynchEventFromPool(false);
+			SpaceEvent = FPlatformProcess::GetSynchEventFromPool(false);
+		}
+
+		virtual ~FStage() override
+		{
+			FPlatformProcess::ReturnSynchEventToPool(ItemEvent);
+			ItemEvent = nullptr;
+			FPlatformProcess::ReturnSynchEventToPool(SpaceEvent);
+			SpaceEvent = nullptr;
+		}
+
+		virtual uint32 Run() override
+		{
+			// Executed on stage thread.
+
+			ItemType Item;
+			while (Graph.IsRunning())
+			{
+				if (!Queue.Dequeue(OUT Item))
+				{
+					ItemEvent->Wait(100);
+					continue;
+				}
+				NumQueued.fetch_sub(1, std::memory_order_release);
+				SpaceEvent->Trigger();
+
+				const double StartTime = FPlatformTime::Seconds();
+				Function(Item);
+				ProcessingTime.Add(FPlatformTime::Seconds() - StartTime);
+
+				if (NextStage && !NextStage->Enqueue(MoveTemp(Item)))
+					break;
+
+				// Don't hold onto the item's frames until the next one arrives.
+				Item = ItemType();
+			}
+
+			return 0;
+		}
+
+		bool Enqueue(ItemType&& Item)
+		{
+			// Executed on previous stage's thread, or the pushing thread.
+
+			while (!HasSpace())
+			{
+				if (!Graph.IsRunning())
+					return false;
+				SpaceEvent->Wait(100);
+			}
+
+			// Items are only counted off once they've been dequeued, so the queue always has room for what's counted.
+			verify(Queue.Enqueue(MoveTemp(Item)));
+			NumQueued.fetch_add(1, std::memory_order_release);
+			ItemEvent->Trigger();
+			return true;
+		}
+
+		bool WaitForSpace(double TimeoutSeconds)
+		{
+			// Executed on pushing thread.
+
+			if (HasSpace())
+				return true;
+
+			SpaceEvent->Wait(FTimespan::FromSeconds(TimeoutSeconds));
+			return HasSpace();
+		}
+
+		bool HasSpace() const { return NumQueued.load(std::memory_order_acquire) < Capacity; }
+
+		void Wake()
+		{
+			ItemEvent->Trigger();
+			SpaceEvent->Trigger();
+		}
+
+	public:
+		FString Name;
+		FRunnableThread* Thread = nullptr;
+		FStage* NextStage = nullptr;
+
+		// Only written to by the stage's thread, so only read once it has stopped.
+		FLatencyStats ProcessingTime;
+
+	private:
+		const TStageGraph& Graph;
+		FStageFunction Function;
+
+		// TCircularQueue rounds its size up to a power of two, so it can hold more than Capacity. NumQueued is what
+		// actually limits it.
+		int32 Capacity;
+		TCircularQueue<ItemType> Queue;
+		std::atomic<int32> NumQueued;
+
+		// Signalled when an item is queued, and when one is taken off the queue.
+		FEvent* ItemEvent;
+		FEvent* SpaceEvent;
+	};
+
+	FString Name;
+	int32 QueueCapacity;
+	TArray<TUniquePtr<FStage>> Stages;
+	std::atomic<bool> bRunning;
+};
@@ -4,23 +4,30 @@
 
 #pragma once
 
+#include "FeatureDetector.h"
 #include "VideoReader.h"
 
 class FEyeDetector;
 class BLINKOPENCV_API FTestVideoReader : public FVideoReader
 {
 public:
-	FTestVideoReader(int32 InCameraIndex, float InRefreshRate = 1.f/30.f, FVector2D InResizeDimensions = FVector2D());
-	FTestVideoReader(const FString& InVideoSource, float InRefreshRate = 1.f/30.f, FVector2D InResizeDimensions = FVector2D());
+	FTestVideoReader(int32 InCameraIndex, float InRefreshRate = 1.f/30.f, FVector2D InResizeDimensions = FVector2D(),
+	                 const FFeatureDetectorSettings& InDetectorSettings = FFeatureDetectorSettings());
+	FTestVideoReader(const FString& InVideoSource, float InRefreshRate = 1.f/30.f, FVector2D InResizeDimensions = FVector2D(),
+	                 const FFeatureDetectorSettings& InDetectorSettings = FFeatureDetectorSettings());
+	FTestVideoReader(const FCaptureSettings& InCaptureSettings, float InRefreshRate = 1.f/30.f, FVector2D InResizeDimensions = FVector2D(),
+	                 const FFeatureDetectorSettings& InDetectorSettings = FFeatureDetectorSettings());
+
+	virtual ~FTestVideoReader() override;
 
 	const TWeakPtr<FEyeDetector> GetEyeDetector() const { return EyeDetector; }
 	
 private:
 	TSharedPtr<FEyeDetector> EyeDetector;
+	FFeatureDetectorSettings DetectorSettings;
 
 protected:
 	virtual void Start() override;
-	virtual void Exit() override;
 
-	virtual void Stop() override;
+	virtual void OnDestroy() override;
 };
@@ -0,0 +1,59 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+/**
+ * @brief The priority and cores a capture or vision thread runs with.
+ */
+struct BLINKOPENCV_API FThreadSchedulingSettings
+{
+	EThreadPriority Priority = TPri_AboveNormal;
+
+	/**
+	 * @brief A bit per logical processor the thread may run on. 0 lets it run on any of them.
+	 */
+	uint64 AffinityMask = 0;
+
+	/**
+	 * @brief The mask to give FRunnableThread::Create, which expects every bit set rather than 0 for no affinity.
+	 */
+	uint64 GetThreadAffinityMask() const
+	{
+		return AffinityMask != 0 ? AffinityMask : FPlatformAffinity::GetNoAffinityMask();
+	}
+
+	/**
+	 * @brief Picks settings for the capture thread based on the number of cores, so it stays off the game and render
+	 * threads' cores.
+	 *
+	 * The first two physical cores are left to the game and render threads. The capture thread gets the last physical
+	 * core, and is given a high priority since it is short-lived but latency-critical. Below 4 physical cores there's
+	 * nothing to spare, so it isn't pinned and runs at normal priority.
+	 */
+	static FThreadSchedulingSettings AutomaticCapture();
+
+	/**
+	 * @brief Picks settings for the detector threads based on the number of cores, so they stay off the game and
+	 * render threads' cores.
+	 *
+	 * The detectors get every physical core between the ones left to the game and render threads and the one given to
+	 * the capture thread, at normal priority so long detections can't starve anything else scheduled there. Below 4
+	 * physical cores, they aren't pinned and run slightly below normal priority.
+	 */
+	static FThreadSchedulingSettings AutomaticDetector();
+
+private:
+	// The first physical cores, left to the game and render threads.
+	static constexpr int32 ReservedCores = 2;
+
+	// Fewer physical cores than this, and nothing is pinned.
+	static constexpr int32 MinCoresToPin = 4;
+
+	/**
+	 * @brief The mask of every logical processor on physical cores [FirstCore, LastCore].
+	 * Assumes a physical core's logical processors are numbered next to each other.
+	 */
+	static uint64 GetCoreRangeMask(int32 FirstCore, int32 LastCore);
+};
@@ -0,0 +1,68 @@
+﻿// Copyright 2022 Liam Hall. All Rights Reserved.
+// Created on 18/10/2026.
+// NHE2422 Advanced Computer Games Development Assignment 2.
+
+#pragma once
+
+#include "OpenCVHelper.h"
+#include "PreOpenCVHeaders.h"
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include "PostOpenCVHeaders.h"
+
+class FFrameAnnotations;
+
+/**
+ * @brief A single frame published by a VideoReader.
+ *
+ * Copying a frame only copies the cv::Mat header; the pixels are reference counted and shared between every copy.
+ * Consumers must therefore treat the Image as read-only and never write into its pixels.
+ *
+ * The Image is either BGR or single-channel luma, depending on how the VideoReader was configured.
+ */
+struct FVideoFrame
+{
+	cv::Mat Image;
+
+	// The full planar YUV frame the Image is a view into, when the Image is its luma plane. Empty otherwise.
+	cv::Mat SourceImage;
+
+	// The cv::ColorConversionCodes value to convert the SourceImage to BGR.
+	int32 SourceConversionCode = -1;
+
+	// Monotonically increasing number assigned by the VideoReader. 0 means no frame has been published yet.
+	uint64 SequenceNumber = 0;
+
+	// FPlatformTime::Seconds() at the moment the frame was read from the VideoStream. Monotonic, so it can be compared
+	// against FPlatformTime::Seconds() on any thread to get the frame's age.
+	double CaptureTime = 0;
+
+	// FPlatformTime::Seconds() at the moment the VideoReader published the frame to its consumers.
+	double PublishTime = 0;
+
+	// Where the frame is in the stream (seconds), from CAP_PROP_POS_MSEC or the frame index when replaying. This is the
+	// stream position the VideoStream reports, not the buffer's PTS. Negative if the stream doesn't report one.
+	double StreamPosition = -1;
+
+	// What a detector found in the frame, to draw over it when rendered. Only set by detectors, while rendering.
+	TSharedPtr<const FFrameAnnotations> Annotations;
+
+	bool IsValid() const { return SequenceNumber > 0 && !Image.empty(); }
+
+	/**
+	 * @brief Gets the frame in BGR, converting it if it was captured in luma only. Intended for debug rendering, since
+	 * converting allocates a new image every call.
+	 */
+	cv::Mat GetColourImage() const
+	{
+		if (Image.empty() || Image.channels() == 3)
+			return Image;
+
+		cv::Mat ColourImage;
+		if (!SourceImage.empty())
+			cv::cvtColor(SourceImage, OUT ColourImage, SourceConversionCode);
+		else
+			cv::cvtColor(Image, OUT ColourImage, cv::COLOR_GRAY2BGR);
+		return ColourImage;
+	}
+};
@@ -15,22 +15,31 @@
 #include <opencv2/cudawarping.hpp>
 #include <opencv2/cudacodec.hpp>
 #include "PostOpenCVHeaders.h"
+#include "Async/Future.h"
+#include "CapturePipeline.h"
+#include "EulerRunnable.h"
+#include "FrameMailbox.h"
+#include "FramePool.h"
+#include "FrameStageStats.h"
 #include "Renderable.h"
 
-class BLINKOPENCV_API FVideoReader : public FRunnable, public FRenderable
+class BLINKOPENCV_API FVideoReader : public FEulerThread, public FRenderable
 {
 public:
 	FVideoReader(int32 InCameraIndex, float InRefreshRate = 1.f / 30.f, FVector2D InResizeDimensions = FVector2D(),
 	             const FString InWindowName = "Camera");
 	FVideoReader(const FString& InVideoSource, float InRefreshRate = 1.f / 30.f,
 	             FVector2D InResizeDimensions = FVector2D(), const FString InWindowName = "Video");
+	FVideoReader(const FCaptureSettings& InCaptureSettings, float InRefreshRate = 1.f / 30.f,
+	             FVector2D InResizeDimensions = FVector2D(), const FString InWindowName = "Camera");
 	
 public:
-	// Overriden from FRunnable
-	virtual bool Init() override;
-	virtual uint32 Run() override;
-	virtual void Exit() override;
-	virtual void Stop() override;
+	// Overriden from FEulerThread
+	virtual void OnPreStart() override;
+	virtual void OnStart() override;
+	virtual void OnTick(const double& DeltaTime) override;
+	virtual void OnPreStop() override;
+	virtual void OnStop() override;
 
 	// Overriden from FRenderable
 	virtual void Render() override;
@@ -39,38 +48,92 @@ public:
 	virtual ~FVideoReader() override;
 
 private:
+	enum class EConnectionState : uint8
+	{
+		Disconnected,
+		// The VideoStream is being opened on another thread.
+		Connecting,
+		WaitingToReconnect,
+		Connected
+	};
+	
 	// Config vars.
-	int32 CameraIndex;
-	std::string VideoSource;
-	cv::Point ResizeDimensions;
+	FCaptureSettings CaptureSettings;
 	float RefreshRate;
 	std::string WindowName;
 
 	// State vars.
-	FRunnableThread* Thread;
-	bool bThreadActive;
 	cv::VideoCapture VideoStream;
-	TSharedPtr<cv::Mat> CurrentFrame;
+	EConnectionState ConnectionState;
+	TFuture<TSharedPtr<cv::VideoCapture>> PendingVideoStream;
+	int32 FailedConnectionAttempts;
+	double NextConnectionTime;
+	ECaptureOutputFormat OutputFormat;
+	cv::Size FrameSize;
+	int32 FrameType;
+	double StreamFrameRate;
+	std::atomic<uint64> FrameSequenceNumber;
+	bool bReplayFinished;
+	double ReplayStartTime;
+	float AdaptedRefreshRate;
+	FFrameStageStats FrameStats;
+
+	// Must outlive every frame it has handed out, so is declared before anything that can hold onto a frame.
+	FFramePool FramePool;
+	TArray<TSharedPtr<FFrameMailbox>> FrameMailboxes;
 	bool bVideoActive;
-	double PreviousTime;
 	TArray<TWeakPtr<FRenderable>> ChildRenderers;
+
+	// Game thread's view of the VideoStream, used for rendering. Only published to while there are frame subscribers.
+	FFrameMailbox RenderMailbox;
+	FVideoFrame RenderFrame;
+	cv::Mat RenderColourImage;
 	
 public:
 	/**
-	 * @brief Gets the current fully-processed frame.
+	 * @brief Opens a VideoStream with the given pipeline and grabs its first frame, so it is fully negotiated and ready
+	 * to be read from. Blocks for as long as that takes, so shouldn't be called from a thread that delivers frames.
+	 * @return The opened VideoStream, or null if it could not be opened.
+	 */
+	static TSharedPtr<cv::VideoCapture> OpenVideoStream(const FString& Pipeline);
+	
+	/**
+	 * @brief Creates a mailbox which will receive every fully-processed frame from now on.
+	 *
+	 * Each consumer thread should own its own mailbox. Only call from the VideoReader thread (i.e. from Start).
 	 */
-	TSharedPtr<cv::Mat> GetFrame() const { return CurrentFrame; }
+	TSharedPtr<FFrameMailbox> CreateFrameMailbox();
 
 	/**
-	 * @brief Is the thread currently running?
+	 * @brief The sequence number of the newest fully-processed frame.
 	 */
-	FORCEINLINE bool IsActive() const { return bThreadActive; }
+	uint64 GetFrameSequenceNumber() const { return FrameSequenceNumber.load(std::memory_order_acquire); }
 
 	/**
 	 * @brief Is the video stream currently active?
 	 */
 	bool IsVideoActive() const { return bVideoActive; }
 
+	/**
+	 * @brief Is a file being replayed as fast as the consumers can keep up? If so, frame timestamps should be used in
+	 * place of the wall clock. Safe to call from any thread.
+	 */
+	bool IsReplaying() const { return CaptureSettings.bReplay; }
+
+	/**
+	 * @brief What happened to the frames at the capture stage. Can be read from any thread.
+	 */
+	const FFrameStageStats& GetFrameStats() const { return FrameStats; }
+
+	/**
+	 * @brief Are frames captured as planar YUV, with consumers given only the luma plane?
+	 */
+	bool IsPlanarYuv() const
+	{
+		return OutputFormat == ECaptureOutputFormat::NV12 || OutputFormat == ECaptureOutputFormat::I420
+			|| OutputFormat == ECaptureOutputFormat::YV12;
+	}
+
 protected:
 	/**
 	 * @brief Executed whenever a new frame has been retrieved from the VideoStream.
@@ -78,6 +141,14 @@ protected:
 	 * @param Frame The current frame from the VideoStream.
 	 */
 	virtual void ProcessNextFrame(cv::Mat& Frame);
+
+	/**
+	 * @brief Hands a fully-processed frame to every consumer without copying its pixels and wakes any waiting
+	 * consumers.
+	 * @param CaptureTime FPlatformTime::Seconds() at the moment the frame was read.
+	 * @param StreamPosition Where the frame is in the stream (seconds). Negative if unknown.
+	 */
+	void PublishFrame(const cv::Mat& Frame, double CaptureTime, double StreamPosition);
 	
 	/**
 	 * @brief Override this to add any logic that should be executed everytime the VideoStream has been initialised and
@@ -91,15 +162,36 @@ protected:
 
 private:
 	/**
-	 * @brief Establishes the connection to the VideoStream.
+	 * @brief Advances the connection to the VideoStream without ever blocking: opening happens on another thread, and
+	 * failed attempts are retried with exponential backoff.
+	 */
+	void UpdateConnection();
+
+	/**
+	 * @brief Starts opening the VideoStream on another thread, or takes over the pipeline pre-opened at startup.
 	 */
-	void InitialiseVideoStream();
+	void BeginConnecting();
+
+	/**
+	 * @brief Finishes establishing the connection once the VideoStream has been opened.
+	 */
+	void FinishConnecting(const TSharedPtr<cv::VideoCapture>& OpenedVideoStream);
+
+	/**
+	 * @brief Waits an exponentially increasing amount of time before trying to open the VideoStream again.
+	 */
+	void ScheduleReconnect();
 
 	void PrintVideoStreamProperties() const;
 
 	/**
-	 * @brief Keeps track of delta-time in a thread-independent way.
-	 * @return The current delta time.
+	 * @brief Blocks until every consumer has taken the last published frame, so none are dropped while replaying.
+	 */
+	void WaitForConsumers();
+
+	/**
+	 * @brief Slows the refresh rate down while any consumer hasn't taken the last published frame yet, since reading
+	 * faster only produces frames it will never see. Speeds back up to RefreshRate once every consumer keeps up.
 	 */
-	double UpdateAndGetDeltaTime();
+	void AdaptRefreshRate();
 };